@@ -2,9 +2,61 @@
 #define ACTIVATION_FUNCTIONS_HPP
 
 #include <cmath>
+#include <type_traits>
+#include <Eigen/Core>
+#include "HaDo/base/FastActivationFunctions.hpp"
 
 namespace hado {
     
+/**
+ * Every functor below has a scalar operator() and a packetOp() working on
+ * Eigen SIMD packets. The matching Eigen::internal::functor_traits at the
+ * bottom of this file tell Eigen when the packet path is available, so
+ * unaryExpr(Activation()) is vectorised wherever the scalar type allows it.
+*/
+
+/**
+ * @brief Identity activation function, for layers with a built in activation
+ * that should not apply one (a separate ActivationLayer can then be fused in)
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct identity {
+    [[nodiscard]] inline T operator()(T x) const {
+        return x;
+    }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        return x;
+    }
+};
+
+/**
+ * @brief Derivative of identity activation function
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct identity_prime {
+    [[nodiscard]] inline T operator()(T) const {
+        return 1;
+    }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet&) const {
+        return Eigen::internal::pset1<Packet>(T(1));
+    }
+
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return Eigen::ArrayBase<Derived>::Constant(y.rows(), y.cols(), T(1));
+    }
+};
+
 /**
  * @brief ReLU activation function
  * 
@@ -16,6 +68,11 @@ struct relu {
     [[nodiscard]] inline T operator()(T x) const {
         return x > 0 ? x : 0;
     }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        return Eigen::internal::pmax(x, Eigen::internal::pzero(x));
+    }
 };
 
 /**
@@ -29,6 +86,18 @@ struct relu_prime {
     [[nodiscard]] inline T operator()(T x) const {
         return x > 0 ? 1 : 0;
     }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        using namespace Eigen::internal;
+        return pand(pcmp_lt(pzero(x), x), pset1<Packet>(T(1)));
+    }
+
+    // Same derivative from the stored output, relu(x) > 0 exactly when x > 0
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return (y > T(0)).template cast<T>();
+    }
 };
 
 /**
@@ -40,7 +109,13 @@ template<typename T=float, typename =
     std::enable_if_t<std::is_arithmetic_v<T>, T>>
 struct sigmoid {
     [[nodiscard]] inline T operator()(T x) const {
-        return 1 / (1 + exp(-x));
+        return 1 / (1 + std::exp(-x));
+    }
+
+    // Eigen's logistic kernel is range reduced and safe for large |x|
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        return Eigen::internal::scalar_logistic_op<T>().packetOp(x);
     }
 };
 
@@ -57,6 +132,19 @@ struct sigmoid_prime {
         T x = f(inp);
         return x * (1 - x);
     }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& inp) const {
+        using namespace Eigen::internal;
+        const Packet x = sigmoid<T>().packetOp(inp);
+        return pmul(x, psub(pset1<Packet>(T(1)), x));
+    }
+
+    // Same derivative from the stored output y = sigmoid(x), no exp needed
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return y * (T(1) - y);
+    }
 };
 
 /**
@@ -70,6 +158,36 @@ struct f_tanh {
     [[nodiscard]] inline T operator()(T x) const {
         return std::tanh(x);
     }
+
+    /**
+     * Uses Eigen's rational tanh where the packet type provides one (float).
+     * Otherwise tanh(|x|) = (1 - e) / (1 + e) with e = exp(-2|x|), switching
+     * to the odd Taylor series below 0.05 where that quotient cancels.
+    */
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        using namespace Eigen::internal;
+        if constexpr (packet_traits<T>::HasTanh) {
+            return ptanh(x);
+        } else {
+            const Packet one = pset1<Packet>(T(1));
+            const Packet ax = pabs(x);
+
+            const Packet e = pexp(pmul(pset1<Packet>(T(-2)), ax));
+            const Packet quotient = pdiv(psub(one, e), padd(one, e));
+
+            const Packet x2 = pmul(ax, ax);
+            Packet series = pset1<Packet>(T(62) / T(2835));
+            series = pmadd(series, x2, pset1<Packet>(T(-17) / T(315)));
+            series = pmadd(series, x2, pset1<Packet>(T(2) / T(15)));
+            series = pmadd(series, x2, pset1<Packet>(T(-1) / T(3)));
+            series = pmadd(series, x2, one);
+            series = pmul(ax, series);
+
+            const Packet res = pselect(pcmp_lt(ax, pset1<Packet>(T(0.05))), series, quotient);
+            return pselect(pcmp_lt(x, pzero(x)), pnegate(res), res);
+        }
+    }
 };
 
 /**
@@ -84,6 +202,114 @@ struct f_tanh_prime {
         T tanhx = std::tanh(x);
         return 1 - tanhx * tanhx;
     }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        using namespace Eigen::internal;
+        const Packet tanhx = f_tanh<T>().packetOp(x);
+        return psub(pset1<Packet>(T(1)), pmul(tanhx, tanhx));
+    }
+
+    // Same derivative from the stored output y = tanh(x), no tanh needed
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return T(1) - y.square();
+    }
+};
+
+/**
+ * @brief Trait telling whether ActivationPrime can compute the derivative from
+ * the activation output through a static from_output(y) (sigma * (1 - sigma),
+ * 1 - tanh^2, ...). Layers use it to store whichever of input or output the
+ * backward pass needs, so backward never re-evaluates a transcendental.
+ *
+ * @tparam ActivationPrime Derivative functor
+ * @tparam T Data type (float, double, long double)
+*/
+template<typename ActivationPrime, typename T, typename = void>
+struct derivative_from_output : std::false_type {};
+
+template<typename ActivationPrime, typename T>
+struct derivative_from_output<ActivationPrime, T, std::void_t<decltype(
+    ActivationPrime::from_output(std::declval<const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>&>()))>>
+    : std::true_type {};
+
+template<typename ActivationPrime, typename T>
+inline constexpr bool derivative_from_output_v = derivative_from_output<ActivationPrime, T>::value;
+
+}
+
+namespace Eigen::internal {
+
+// Packet support for the activation functors, see the note at the top of the file
+
+template<typename T, typename E>
+struct functor_traits<hado::identity<T, E>> {
+    enum {
+        Cost = 0,
+        PacketAccess = packet_traits<T>::Vectorizable
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::identity_prime<T, E>> {
+    enum {
+        Cost = 0,
+        PacketAccess = packet_traits<T>::Vectorizable
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::relu<T, E>> {
+    enum {
+        Cost = NumTraits<T>::AddCost,
+        PacketAccess = packet_traits<T>::Vectorizable && packet_traits<T>::HasMax
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::relu_prime<T, E>> {
+    enum {
+        Cost = NumTraits<T>::AddCost,
+        PacketAccess = packet_traits<T>::Vectorizable && packet_traits<T>::HasCmp
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::sigmoid<T, E>> {
+    enum {
+        Cost = functor_traits<scalar_logistic_op<T>>::Cost,
+        PacketAccess = packet_traits<T>::Vectorizable && functor_traits<scalar_logistic_op<T>>::PacketAccess
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::f_tanh<T, E>> {
+    enum {
+        Cost = packet_traits<T>::HasTanh
+            ? int(functor_traits<scalar_tanh_op<T>>::Cost)
+            : int(functor_traits<scalar_exp_op<T>>::Cost) + 8 * int(NumTraits<T>::MulCost)
+                + int(scalar_div_cost<T, packet_traits<T>::HasDiv>::value),
+        PacketAccess = packet_traits<T>::Vectorizable
+            && (packet_traits<T>::HasTanh
+                || (packet_traits<T>::HasExp && packet_traits<T>::HasDiv && packet_traits<T>::HasCmp))
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::sigmoid_prime<T, E>> {
+    enum {
+        Cost = int(functor_traits<hado::sigmoid<T, E>>::Cost) + int(NumTraits<T>::AddCost) + int(NumTraits<T>::MulCost),
+        PacketAccess = functor_traits<hado::sigmoid<T, E>>::PacketAccess
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::f_tanh_prime<T, E>> {
+    enum {
+        Cost = int(functor_traits<hado::f_tanh<T, E>>::Cost) + int(NumTraits<T>::AddCost) + int(NumTraits<T>::MulCost),
+        PacketAccess = functor_traits<hado::f_tanh<T, E>>::PacketAccess
+    };
 };
 
 }
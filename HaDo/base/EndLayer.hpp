@@ -4,6 +4,8 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <memory>
+#include <cmath>
+#include <iostream>
 
 using Eigen::Matrix;
 using std::vector;
@@ -42,6 +44,9 @@ protected:
     // Columns in input matrix
     int C;
 
+    // Whether backward adds parameter gradients to the accumulators instead of updating
+    bool accumulate = false;
+
     /**
      * @brief Constructor for basic end layer of neural network
      * 
@@ -51,6 +56,27 @@ protected:
     */
     EndLayer(const int D, const int R, const int C) : D(D), R(R), C(C) {}
 
+    /**
+     * @brief If true_res is a single 1x1 matrix, treat it as a class index, check
+     * it is an integer in [0, classes) and return it. Otherwise return -1.
+     * 
+     * @param true_res True result tensor
+     * @param classes Number of classes
+    */
+    int classIndex(const vector<MatrixD>& true_res, const int classes) const {
+        if (true_res.size() != 1 || true_res[0].rows() != 1 || true_res[0].cols() != 1){
+            return -1;
+        }
+
+        const T index = true_res[0](0, 0);
+        if (index < 0 || index >= classes || index != std::floor(index)){
+            std::cerr << "Class index " << index << " must be an integer in [0, "
+                << classes << ")" << endl;
+            throw std::invalid_argument("Class index out of range.");
+        }
+        return static_cast<int>(index);
+    }
+
 public:
 
     // Getters
@@ -90,6 +116,104 @@ public:
     // Calculate error gradient w.r.t results
     virtual vector<MatrixD> backward(
         vector<MatrixD>& res, vector<MatrixD>& true_res) = 0;
+
+    // Calculate error gradient w.r.t results and update any parameters the end layer owns
+    virtual vector<MatrixD> backward(
+        vector<MatrixD>& res, vector<MatrixD>& true_res, const T learning_rate) {
+        (void) learning_rate;
+        return backward(res, true_res);
+    }
+
+    /**
+     * @brief Error for testing. Defaults to forward, end layers whose training
+     * error is only an estimate (i.e. sampled softmax) return the exact one.
+     *
+     * @param res Output of the last layer
+     * @param true_res True result tensor
+    */
+    virtual T testForward(vector<MatrixD>& res, vector<MatrixD>& true_res) {
+        return forward(res, true_res);
+    }
+
+    /**
+     * @brief Prediction from the output of the last layer. Defaults to that
+     * output, end layers owning the output projection return their own.
+     *
+     * @param res Output of the last layer
+    */
+    virtual vector<MatrixD> predict(const vector<MatrixD>& res) const {
+        return res;
+    }
+
+    /**
+     * @brief Restart the random draws of the end layer (i.e. the negatives of
+     * sampled softmax) from seed, so clones draw independently of the layer
+     * they were copied from. Does nothing for end layers without draws.
+     *
+     * @param seed New seed
+    */
+    virtual void reseed(const unsigned seed) {
+        (void) seed;
+    }
+
+    // Whether the end layer owns trainable parameters, which backward updates
+    [[nodiscard]] virtual bool hasParameters() const {
+        return false;
+    }
+
+    /**
+     * @brief Parameter tensors of the end layer, in a fixed order. Empty for
+     * end layers without parameters.
+    */
+    virtual vector<MatrixD*> parameters() {
+        return {};
+    }
+
+    /**
+     * @brief Gradient accumulators matching parameters(), summed by backward
+     * while accumulating (see setGradientAccumulation).
+    */
+    virtual vector<MatrixD*> gradients() {
+        return {};
+    }
+
+    /**
+     * @brief Switch backward between updating the parameters straight away
+     * (the default) and adding their gradients to the accumulators, as
+     * Layer::setGradientAccumulation. Zeroes the accumulators.
+     *
+     * @param enabled Whether to accumulate
+    */
+    void setGradientAccumulation(const bool enabled) {
+        accumulate = enabled;
+        zeroGradients();
+    }
+    [[nodiscard]] bool isAccumulatingGradients() const { return accumulate; }
+
+    // Reset the accumulators to zero, sized like the parameters
+    void zeroGradients() {
+        vector<MatrixD*> params = parameters();
+        vector<MatrixD*> grads = gradients();
+        for (size_t i = 0; i < grads.size(); i++) {
+            grads[i]->setZero(params[i]->rows(), params[i]->cols());
+        }
+    }
+
+    /**
+     * @brief Gradient descent step with the accumulated gradients, which are
+     * then zeroed.
+     *
+     * @param learning_rate Learning rate for gradient descent
+     * @param scale Factor on the accumulated gradients, e.g. 1 / batch size (optional)
+    */
+    void applyGradients(const T learning_rate, const T scale = 1) {
+        vector<MatrixD*> params = parameters();
+        vector<MatrixD*> grads = gradients();
+        for (size_t i = 0; i < grads.size(); i++) {
+            *params[i] -= (learning_rate * scale) * *grads[i];
+            grads[i]->setZero();
+        }
+    }
 };
 
 }
@@ -0,0 +1,285 @@
+#ifndef FAST_ACTIVATION_FUNCTIONS_HPP
+#define FAST_ACTIVATION_FUNCTIONS_HPP
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <Eigen/Core>
+
+namespace hado {
+
+/**
+ * Approximate activation functions for inference. Each one documents its
+ * maximum absolute error over the whole real line in max_error, which
+ * test/base/test_fast_activation_functions.cpp checks exhaustively.
+ *
+ * Use them as explicit template arguments, i.e.
+ * ActivationLayer<fast_tanh<>, fast_tanh_prime<>>. sigmoid and f_tanh always
+ * stay exact, so every translation unit sees the same definitions.
+*/
+
+/**
+ * @brief Rational tanh approximation, the [7/6] Pade approximant of tanh with
+ * the input clamped to +/-4.785. Maximum absolute error 7.5e-5.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct fast_tanh {
+    static constexpr double max_error = 7.5e-5;
+
+    // Input clamp minimising the error of the approximant
+    static constexpr T clamp = T(4.785);
+
+    [[nodiscard]] inline T operator()(T x) const {
+        x = std::min(std::max(x, -clamp), clamp);
+        const T x2 = x * x;
+        const T p = T(135135) + x2 * (T(17325) + x2 * (T(378) + x2));
+        const T q = T(135135) + x2 * (T(62370) + x2 * (T(3150) + x2 * T(28)));
+        return x * p / q;
+    }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& inp) const {
+        using namespace Eigen::internal;
+        const Packet x = pmin(pmax(inp, pset1<Packet>(-clamp)), pset1<Packet>(clamp));
+        const Packet x2 = pmul(x, x);
+        Packet p = padd(x2, pset1<Packet>(T(378)));
+        p = pmadd(p, x2, pset1<Packet>(T(17325)));
+        p = pmadd(p, x2, pset1<Packet>(T(135135)));
+        Packet q = pmul(x2, pset1<Packet>(T(28)));
+        q = padd(q, pset1<Packet>(T(3150)));
+        q = pmadd(q, x2, pset1<Packet>(T(62370)));
+        q = pmadd(q, x2, pset1<Packet>(T(135135)));
+        return pdiv(pmul(x, p), q);
+    }
+};
+
+/**
+ * @brief Derivative of fast_tanh, 1 - fast_tanh(x)^2. Maximum absolute error 1.5e-4.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct fast_tanh_prime {
+    static constexpr double max_error = 1.5e-4;
+
+    [[nodiscard]] inline T operator()(T x) const {
+        const T tanhx = fast_tanh<T>()(x);
+        return 1 - tanhx * tanhx;
+    }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        using namespace Eigen::internal;
+        const Packet tanhx = fast_tanh<T>().packetOp(x);
+        return psub(pset1<Packet>(T(1)), pmul(tanhx, tanhx));
+    }
+
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return T(1) - y.square();
+    }
+};
+
+/**
+ * @brief Sigmoid through the rational tanh, 0.5 + 0.5 * fast_tanh(x / 2).
+ * Maximum absolute error 4e-5.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct fast_sigmoid {
+    static constexpr double max_error = 4e-5;
+
+    [[nodiscard]] inline T operator()(T x) const {
+        return T(0.5) + T(0.5) * fast_tanh<T>()(T(0.5) * x);
+    }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& x) const {
+        using namespace Eigen::internal;
+        const Packet half = pset1<Packet>(T(0.5));
+        return pmadd(half, fast_tanh<T>().packetOp(pmul(half, x)), half);
+    }
+};
+
+/**
+ * @brief Derivative of fast_sigmoid, s * (1 - s). Maximum absolute error 4e-5.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct fast_sigmoid_prime {
+    static constexpr double max_error = 4e-5;
+
+    [[nodiscard]] inline T operator()(T inp) const {
+        const T x = fast_sigmoid<T>()(inp);
+        return x * (1 - x);
+    }
+
+    template<typename Packet>
+    [[nodiscard]] inline Packet packetOp(const Packet& inp) const {
+        using namespace Eigen::internal;
+        const Packet x = fast_sigmoid<T>().packetOp(inp);
+        return pmul(x, psub(pset1<Packet>(T(1)), x));
+    }
+
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return y * (T(1) - y);
+    }
+};
+
+/**
+ * @brief Piecewise-linear sigmoid interpolating 321 exact values on [-10, 10]
+ * (step 1/16) and saturating outside. Maximum absolute error 5e-5. Scalar only,
+ * the table lookup does not vectorise.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct pwl_sigmoid {
+    static constexpr double max_error = 5e-5;
+
+    static constexpr int range = 10;
+    static constexpr int steps_per_unit = 16;
+    static constexpr int count = 2 * range * steps_per_unit + 1;
+
+    // Knots are computed once on first use
+    static const std::array<T, count>& knots() {
+        static const std::array<T, count> table = [](){
+            std::array<T, count> res{};
+            for (int i = 0; i < count; i++) {
+                const double x = -range + static_cast<double>(i) / steps_per_unit;
+                res[i] = static_cast<T>(1 / (1 + std::exp(-x)));
+            }
+            return res;
+        }();
+        return table;
+    }
+
+    [[nodiscard]] inline T operator()(T x) const {
+        if (std::isnan(x)) return x;
+        if (x <= -range) return 0;
+        if (x >= range) return 1;
+
+        const auto& table = knots();
+        const T t = (x + range) * steps_per_unit;
+        const int k = std::min(static_cast<int>(t), count - 2);
+        return table[k] + (table[k + 1] - table[k]) * (t - k);
+    }
+};
+
+/**
+ * @brief Derivative of pwl_sigmoid expressed through its value, s * (1 - s).
+ * Maximum absolute error 5e-5.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct pwl_sigmoid_prime {
+    static constexpr double max_error = 5e-5;
+
+    [[nodiscard]] inline T operator()(T inp) const {
+        const T x = pwl_sigmoid<T>()(inp);
+        return x * (1 - x);
+    }
+
+    template<typename Derived>
+    [[nodiscard]] static inline auto from_output(const Eigen::ArrayBase<Derived>& y) {
+        return y * (T(1) - y);
+    }
+};
+
+/**
+ * @brief Exponential built from the float bit layout: 2^floor(y) is written
+ * straight into the exponent field and 2^frac(y) comes from a degree 4 minimax
+ * polynomial, with y = x / ln 2. Maximum relative error 1e-5 while the result is
+ * a normal number; outside that the input is clamped. long double uses std::exp.
+ *
+ * @tparam T Data type (float, double, long double) (optional)
+*/
+template<typename T=float, typename =
+    std::enable_if_t<std::is_arithmetic_v<T>, T>>
+struct fast_exp {
+    static constexpr double max_relative_error = 1e-5;
+
+    [[nodiscard]] inline T operator()(T x) const {
+        if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
+            using Bits = std::conditional_t<std::is_same_v<T, float>, std::uint32_t, std::uint64_t>;
+            constexpr int mantissa_bits = std::numeric_limits<T>::digits - 1;
+            constexpr int bias = std::numeric_limits<T>::max_exponent - 1;
+
+            if (std::isnan(x)) return x;
+
+            // Keep 2^floor(y) a normal number
+            T y = x * T(1.4426950408889634);
+            y = std::min(std::max(y, T(1 - bias)), T(bias) + T(0.999));
+
+            const T n = std::floor(y);
+            const T f = y - n;
+            const T p = T(1.0000025933706653) + f * (T(0.693003834471064)
+                + f * (T(0.2414427568861899) + f * (T(0.0520114606190554)
+                + f * T(0.013534167911694569))));
+
+            const Bits exponent = static_cast<Bits>(static_cast<std::int64_t>(n) + bias) << mantissa_bits;
+            return p * std::bit_cast<T>(exponent);
+        } else {
+            return std::exp(x);
+        }
+    }
+};
+
+}
+
+namespace Eigen::internal {
+
+// Packet support for the rational approximations, the others stay scalar
+
+template<typename T, typename E>
+struct functor_traits<hado::fast_tanh<T, E>> {
+    enum {
+        Cost = 10 * int(NumTraits<T>::MulCost) + int(scalar_div_cost<T, packet_traits<T>::HasDiv>::value),
+        PacketAccess = packet_traits<T>::Vectorizable && packet_traits<T>::HasDiv
+            && packet_traits<T>::HasMin && packet_traits<T>::HasMax
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::fast_tanh_prime<T, E>> {
+    enum {
+        Cost = int(functor_traits<hado::fast_tanh<T, E>>::Cost) + int(NumTraits<T>::AddCost) + int(NumTraits<T>::MulCost),
+        PacketAccess = functor_traits<hado::fast_tanh<T, E>>::PacketAccess
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::fast_sigmoid<T, E>> {
+    enum {
+        Cost = int(functor_traits<hado::fast_tanh<T, E>>::Cost) + int(NumTraits<T>::AddCost) + 2 * int(NumTraits<T>::MulCost),
+        PacketAccess = functor_traits<hado::fast_tanh<T, E>>::PacketAccess
+    };
+};
+
+template<typename T, typename E>
+struct functor_traits<hado::fast_sigmoid_prime<T, E>> {
+    enum {
+        Cost = int(functor_traits<hado::fast_sigmoid<T, E>>::Cost) + int(NumTraits<T>::AddCost) + int(NumTraits<T>::MulCost),
+        PacketAccess = functor_traits<hado::fast_sigmoid<T, E>>::PacketAccess
+    };
+};
+
+}
+
+#endif // FAST_ACTIVATION_FUNCTIONS_HPP
@@ -7,8 +7,11 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <iostream>
+#include <string>
 #include <json/json.hpp>
+#include "HaDo/util/SharedParameters.hpp"
 
 using Eigen::Dynamic;
 using Eigen::Matrix;
@@ -19,6 +22,32 @@ using std::endl;
 
 namespace hado {
 
+/**
+ * @brief Static cost of one sample through a layer, see Layer::cost. FLOPs
+ * count a multiply and an add as two, and activation functions as one.
+*/
+struct LayerCost {
+    std::string name;
+    double forward_flops = 0;
+    double backward_flops = 0;
+    size_t parameters = 0;
+    size_t parameter_bytes = 0;
+
+    // Input and output of forward
+    size_t activation_bytes = 0;
+
+    // Kept by forward for backward while training
+    size_t saved_bytes = 0;
+
+    // Bytes forward reads and writes: input, output and parameters
+    [[nodiscard]] size_t forwardBytes() const { return activation_bytes + parameter_bytes; }
+
+    // Forward FLOPs per byte moved
+    [[nodiscard]] double intensity() const {
+        return forwardBytes() == 0 ? 0 : forward_flops / static_cast<double>(forwardBytes());
+    }
+};
+
 /**
  * @brief Base layer class. T will only work for float, double,
  * or long double. Can't construct this directly, must derive a
@@ -61,6 +90,18 @@ protected:
     // Convenience typedef
     typedef Matrix<T, Dynamic, Dynamic> MatrixD;
 
+    // Whether forward keeps what backward needs, off for inference only passes
+    bool training = true;
+
+    // Whether backward adds parameter gradients to the accumulators instead of updating
+    bool accumulate = false;
+
+    // Whether forward and backward take a batch of samples as columns, see setColumnBatch
+    bool column_batch = false;
+
+    // Parameters trained in place of the layer's own, see shareParameters
+    vector<MatrixD*> shared;
+
     /**
      * @brief Layer constructor to instantiate input and output vectors
      *
@@ -84,7 +125,7 @@ protected:
     }
 
     // Copy constructor
-    Layer(const Layer &other) : inp(other.inp), out(other.out)
+    Layer(const Layer &other) : training(other.training), inp(other.inp), out(other.out)
     {
         I = other.getInputDepth();
         O = other.getOutputDepth();
@@ -111,7 +152,7 @@ public:
     void constexpr assertInputDimensions(const vector<MatrixD> &input_tensor) const {
         if (input_tensor.size() != static_cast<size_t>(this->I)
             || input_tensor[0].rows() != this->RI
-            || input_tensor[0].cols() != this->CI){
+            || (input_tensor[0].cols() != this->CI && !column_batch)){
             std::cerr << "Expected depth " << this->I << ", got depth " << input_tensor.size() << endl;
             std::cerr << "Expected rows " << this->RI << ", got rows " << input_tensor[0].rows() << endl;
             std::cerr << "Expected cols " << this->CI << ", got cols " << input_tensor[0].cols() << endl;
@@ -123,7 +164,7 @@ public:
     void constexpr assertOutputDimensions(const vector<MatrixD> &output_tensor) const {
         if (output_tensor.size() != static_cast<size_t>(this->O)
             || output_tensor[0].rows() != this->RO
-            || output_tensor[0].cols() != this->CO){
+            || (output_tensor[0].cols() != this->CO && !column_batch)){
             std::cerr << "Expected depth " << this->O << ", got depth " << output_tensor.size() << endl;
             std::cerr << "Expected rows " << this->RO << ", got rows " << output_tensor[0].rows() << endl;
             std::cerr << "Expected cols " << this->CO << ", got cols " << output_tensor[0].cols() << endl;
@@ -143,9 +184,310 @@ public:
     virtual vector<MatrixD> forward(
         vector<MatrixD> &input_tensor) = 0;
 
+    /**
+     * @brief Forward propagation into a tensor owned by the caller, so its
+     * storage can be reused across calls (see LayerVector::infer). Layers that
+     * can write their output in place override this.
+     *
+     * @param input_tensor Input tensor, may be consumed
+     * @param output_tensor Output tensor to overwrite
+    */
+    virtual void forwardInto(vector<MatrixD> &input_tensor, vector<MatrixD> &output_tensor) {
+        output_tensor = forward(input_tensor);
+    }
+
+    /**
+     * @brief Inference kernel of a compiled plan (see InferencePlan). Reads the
+     * input, overwrites an output tensor already of the output dimensions, and
+     * may use the scratch tensors it is given. Kernels keep their own copy of
+     * the parameters and no other state, so one can run on several threads.
+    */
+    typedef std::function<void(const vector<MatrixD>&, vector<MatrixD>&, vector<MatrixD>&)> InferenceKernel;
+
+    /**
+     * @brief Compile the layer's forward pass for inference. Dimensions are
+     * checked once by the plan rather than on every call.
+     *
+     * @return InferenceKernel Kernel, or empty if the layer has none
+    */
+    virtual InferenceKernel compileInference() const {
+        return nullptr;
+    }
+
+    /**
+     * @brief Whether the compiled kernel also accepts a batch of one column
+     * samples side by side as columns of a single matrix, and treats each
+     * column separately (see InferencePlan::predictBatch).
+    */
+    [[nodiscard]] virtual bool batchesColumns() const {
+        return false;
+    }
+
+    /**
+     * @brief Whether forward and backward also take a batch of one column
+     * samples side by side as columns of a single matrix while training, with
+     * backward summing the parameter gradients over the columns (see
+     * setColumnBatch and Pipeline::trainBatch).
+    */
+    [[nodiscard]] virtual bool trainsColumns() const {
+        return false;
+    }
+
+    // Let forward and backward take any number of columns, for layers that trainsColumns
+    void setColumnBatch(const bool enabled) { column_batch = enabled; }
+    [[nodiscard]] bool isColumnBatch() const { return column_batch; }
+
+    // Switch between training (forward keeps state for backward) and inference
+    void setTraining(const bool enabled) { training = enabled; }
+    [[nodiscard]] bool isTraining() const { return training; }
+
+    // Elements of a tensor entering and leaving the layer
+    [[nodiscard]] size_t inputElements() const { return static_cast<size_t>(I) * RI * CI; }
+    [[nodiscard]] size_t outputElements() const { return static_cast<size_t>(O) * RO * CO; }
+
+    /**
+     * @brief Elements forward keeps for backward while training, used by the
+     * memory planner. Defaults to a copy of the input and of the output.
+    */
+    [[nodiscard]] virtual size_t savedActivationElements() const {
+        return inputElements() + outputElements();
+    }
+
+    // Name used in reports
+    [[nodiscard]] virtual std::string name() const {
+        return "Layer";
+    }
+
+    // Number of trainable parameters
+    [[nodiscard]] virtual size_t parameterCount() const {
+        return 0;
+    }
+
+    // FLOPs of forward for one sample, defaults to one per output element
+    [[nodiscard]] virtual double forwardFlops() const {
+        return static_cast<double>(outputElements());
+    }
+
+    /**
+     * @brief FLOPs of backward for one sample, without the parameter update.
+     * Defaults to two per output element (derivative and product).
+    */
+    [[nodiscard]] virtual double backwardFlops() const {
+        return 2.0 * static_cast<double>(outputElements());
+    }
+
+    /**
+     * @brief Static cost of the layer for one sample, from its dimensions
+     * only. Backward includes the gradient descent update, two FLOPs per
+     * parameter.
+     *
+     * @return LayerCost Cost of the layer
+    */
+    [[nodiscard]] LayerCost cost() const {
+        LayerCost cost;
+        cost.name = name();
+        cost.forward_flops = forwardFlops();
+        cost.backward_flops = backwardFlops() + 2.0 * static_cast<double>(parameterCount());
+        cost.parameters = parameterCount();
+        cost.parameter_bytes = parameterCount() * sizeof(T);
+        cost.activation_bytes = (inputElements() + outputElements()) * sizeof(T);
+        cost.saved_bytes = savedActivationElements() * sizeof(T);
+        return cost;
+    }
+
+    /**
+     * @brief Parameter tensors of the layer, in a fixed order. Empty for layers
+     * without parameters.
+    */
+    virtual vector<MatrixD*> parameters() {
+        return {};
+    }
+
+    /**
+     * @brief Gradient accumulators matching parameters(), summed by backward
+     * while accumulating (see setGradientAccumulation).
+    */
+    virtual vector<MatrixD*> gradients() {
+        return {};
+    }
+
+    /**
+     * @brief Switch backward between updating the parameters straight away
+     * (the default) and adding their gradients to the accumulators, applied
+     * later by applyGradients, e.g. once per minibatch. Zeroes the accumulators.
+     *
+     * @param enabled Whether to accumulate
+    */
+    void setGradientAccumulation(const bool enabled) {
+        accumulate = enabled;
+        zeroGradients();
+    }
+    [[nodiscard]] bool isAccumulatingGradients() const { return accumulate; }
+
+    // Reset the accumulators to zero, sized like the parameters
+    void zeroGradients() {
+        vector<MatrixD*> params = parameters();
+        vector<MatrixD*> grads = gradients();
+        for (size_t i = 0; i < grads.size(); i++) {
+            grads[i]->setZero(params[i]->rows(), params[i]->cols());
+        }
+    }
+
+    /**
+     * @brief Gradient descent step with the accumulated gradients, which are
+     * then zeroed.
+     *
+     * @param learning_rate Learning rate for gradient descent
+     * @param scale Factor on the accumulated gradients, e.g. 1 / batch size (optional)
+    */
+    void applyGradients(const T learning_rate, const T scale = 1) {
+        vector<MatrixD*> params = parameters();
+        vector<MatrixD*> grads = gradients();
+        for (size_t i = 0; i < grads.size(); i++) {
+            *params[i] -= (learning_rate * scale) * *grads[i];
+            grads[i]->setZero();
+        }
+    }
+
+    /**
+     * @brief Train the parameters of source instead of the layer's own, as one
+     * of several threads that each run a copy of the layers and update one set
+     * of parameters without locks (see Hogwild). Before each forward,
+     * pullShared copies in the shared parameters that forward reads. Backward
+     * subtracts the parameter gradients from the shared parameters with
+     * relaxed atomic element updates (see SharedParameters): layers that know
+     * which parameters a sample touches (Dense, DenseActivation) do so in
+     * backward, the others accumulate and pushShared updates after backward.
+     *
+     * @param source Copy of this layer owning the shared parameters, which
+     * must outlive the sharing, or nullptr to train the own parameters again
+    */
+    void shareParameters(Layer<T>* source) {
+        shared.clear();
+        if (source != nullptr) {
+            vector<MatrixD*> own = parameters();
+            vector<MatrixD*> theirs = source->parameters();
+            for (size_t i = 0; i < own.size(); i++) {
+                if (i >= theirs.size() || own[i]->rows() != theirs[i]->rows()
+                    || own[i]->cols() != theirs[i]->cols()) {
+                    throw std::invalid_argument("Shared parameters must match the layer's own.");
+                }
+            }
+            shared = std::move(theirs);
+        }
+        setGradientAccumulation(!shared.empty());
+    }
+    [[nodiscard]] bool isSharingParameters() const { return !shared.empty(); }
+
+    /**
+     * @brief Copy in the shared parameters forward reads for the input (see
+     * shareParameters). Defaults to all of them.
+     *
+     * @param input_tensor Input of the coming forward
+    */
+    virtual void pullShared(const vector<MatrixD>& input_tensor) {
+        (void) input_tensor;
+        vector<MatrixD*> own = parameters();
+        for (size_t i = 0; i < shared.size(); i++) {
+            SharedParameters<T>::load(shared[i]->data(), own[i]->data(), own[i]->size());
+        }
+    }
+
+    /**
+     * @brief Subtract learning_rate times the accumulated gradients from the
+     * shared parameters, then zero them (see shareParameters). Layers whose
+     * backward updates the shared parameters itself do nothing here.
+     *
+     * @param learning_rate Learning rate for gradient descent
+    */
+    virtual void pushShared(const T learning_rate) {
+        vector<MatrixD*> grads = gradients();
+        for (size_t i = 0; i < shared.size(); i++) {
+            SharedParameters<T>::subtract(shared[i]->data(), grads[i]->data(), learning_rate, grads[i]->size());
+            grads[i]->setZero();
+        }
+    }
+
+    /**
+     * @brief Free what forward kept for backward, keeping the tensor depths.
+     * Used by checkpointing, which recomputes it before backward. Layers that
+     * keep more than inp and out override this.
+    */
+    virtual void clearActivations() {
+        for (auto& m : inp) {
+            m.resize(0, 0);
+        }
+        for (auto& m : out) {
+            m.resize(0, 0);
+        }
+    }
+
     // Backward propagation
     virtual vector<MatrixD> backward(
         vector<MatrixD> &output_gradient, T learning_rate) = 0;
+
+    /**
+     * @brief Backward propagation into a tensor owned by the caller, so its
+     * storage can be reused across calls (see LayerVector::backward). Layers
+     * that can write the input gradient in place override this.
+     *
+     * @param output_gradient Gradient w.r.t. the output, may be consumed
+     * @param input_gradient Gradient w.r.t. the input to overwrite
+     * @param learning_rate Learning rate for gradient descent
+    */
+    virtual void backwardInto(vector<MatrixD> &output_gradient, vector<MatrixD> &input_gradient, const T learning_rate) {
+        input_gradient = backward(output_gradient, learning_rate);
+    }
+
+    /**
+     * @brief Single layer computing this layer followed by next, used by
+     * LayerVector::fuse. Layers that know a fused form override this.
+     *
+     * @param next Layer directly after this one
+     * @return Fused layer, or nullptr if there is none
+    */
+    virtual std::unique_ptr<Layer<T>> fuseWithNext(const Layer<T>& next) const {
+        (void) next;
+        return nullptr;
+    }
+
+    /**
+     * @brief Single layer computing previous followed by this layer, for fused
+     * forms only the second layer knows about.
+     *
+     * @param previous Layer directly before this one
+     * @return Fused layer, or nullptr if there is none
+    */
+    virtual std::unique_ptr<Layer<T>> fuseWithPrevious(const Layer<T>& previous) const {
+        (void) previous;
+        return nullptr;
+    }
+};
+
+/**
+ * @brief Sets the training mode of a layer for the lifetime of the guard, and
+ * puts back the mode it had before on exit, also when an exception unwinds.
+ *
+ * @tparam T Data type of the layer
+*/
+template <typename T>
+class TrainingModeGuard
+{
+private:
+    Layer<T>& layer;
+    const bool previous;
+
+public:
+    TrainingModeGuard(Layer<T>& layer, const bool enabled)
+        : layer(layer), previous(layer.isTraining())
+    {
+        layer.setTraining(enabled);
+    }
+
+    ~TrainingModeGuard() { layer.setTraining(previous); }
+
+    TrainingModeGuard(const TrainingModeGuard&) = delete;
+    TrainingModeGuard& operator=(const TrainingModeGuard&) = delete;
 };
 
 }
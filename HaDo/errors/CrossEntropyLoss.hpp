@@ -74,6 +74,9 @@ public:
         return loss;
     }
 
+    // Keep the overload taking a learning rate visible
+    using EndLayer<T>::backward;
+
     /**
      * @brief Backward pass of the CrossEntropyLoss layer
      * 
@@ -0,0 +1,270 @@
+#ifndef HIERARCHICAL_SOFTMAX_LOSS_HPP
+#define HIERARCHICAL_SOFTMAX_LOSS_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/EndLayer.hpp"
+#include <memory>
+#include <queue>
+#include <algorithm>
+#include <utility>
+#include <functional>
+#include <cmath>
+#include <iostream>
+
+using Eigen::Matrix;
+using std::vector;
+using Eigen::Dynamic;
+
+namespace hado {
+
+/**
+ * @brief Hierarchical softmax end layer for very large numbers of classes.
+ * Classes are the leaves of a Huffman tree built from class frequencies, and
+ * each of the classes - 1 inner nodes owns a vector deciding between its two
+ * children with a sigmoid. The network ends at the hidden vector.
+ *
+ * @details The probability of a class is the product of the decisions on its
+ * path from the root, so the loss and its gradient touch O(log classes) inner
+ * nodes (fewer for frequent classes) instead of every class.
+ *
+ * Use predict() for the full class probabilities at inference. The true result
+ * is a 1x1 class index or a one-hot vector of classes rows.
+ *
+ * @tparam T scalar type (float, double, long double)
+*/
+template<typename T=float>
+class HierarchicalSoftmaxLoss : public EndLayer<T> {
+private:
+
+    // Convenience typedef
+    using typename EndLayer<T>::MatrixD;
+
+    // Number of classes
+    int classes;
+
+    // One column per inner node, and bias
+    MatrixD weights;
+    MatrixD bias;
+
+    // Gradients summed over backward calls while accumulating
+    MatrixD accumulated_weights;
+    MatrixD accumulated_bias;
+
+    // Inner nodes from the root to each class, and the branch taken at each
+    // (1 for the first child, whose probability is the sigmoid)
+    vector<vector<int>> paths;
+    vector<vector<T>> codes;
+
+    // Children of each inner node, leaves are 0..classes-1 and inner node i is classes + i
+    vector<std::pair<int, int>> children;
+
+    /**
+     * @brief Build the Huffman tree and the path of every class.
+     *
+     * @param frequencies Frequency of each class
+    */
+    void buildTree(const vector<double>& frequencies) {
+        typedef std::pair<double, int> Entry;
+        std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> queue;
+        for (int i = 0; i < classes; i++){
+            queue.push({frequencies[i], i});
+        }
+
+        // Merge the two least frequent nodes until only the root is left
+        vector<int> parent(2 * classes - 1, -1);
+        vector<T> branch(2 * classes - 1, 0);
+        children.clear();
+        while (queue.size() > 1){
+            const Entry first = queue.top(); queue.pop();
+            const Entry second = queue.top(); queue.pop();
+
+            const int node = classes + static_cast<int>(children.size());
+            children.push_back({first.second, second.second});
+            parent[first.second] = node;
+            branch[first.second] = 1;
+            parent[second.second] = node;
+            branch[second.second] = 0;
+            queue.push({first.first + second.first, node});
+        }
+
+        paths.assign(classes, {});
+        codes.assign(classes, {});
+        for (int i = 0; i < classes; i++){
+            for (int node = i; parent[node] != -1; node = parent[node]){
+                paths[i].push_back(parent[node] - classes);
+                codes[i].push_back(branch[node]);
+            }
+            std::reverse(paths[i].begin(), paths[i].end());
+            std::reverse(codes[i].begin(), codes[i].end());
+        }
+    }
+
+    /**
+     * @brief Get the true class from a 1x1 index or a one-hot vector.
+     *
+     * @param true_res True result tensor
+    */
+    int label(const vector<MatrixD>& true_res) const {
+        const int index = this->classIndex(true_res, classes);
+        if (index >= 0){
+            return index;
+        }
+
+        if (true_res.size() != 1 || true_res[0].rows() != classes || true_res[0].cols() != 1){
+            std::cerr << "Expected a 1x1 class index or a " << classes << "x1 one-hot vector" << endl;
+            throw std::invalid_argument("True result must be a class index or one-hot vector.");
+        }
+        int k;
+        true_res[0].col(0).maxCoeff(&k);
+        return k;
+    }
+
+    // Numerically stable log(sigmoid(x))
+    static T logSigmoid(const T x) {
+        return x >= 0 ? -std::log1p(std::exp(-x)) : x - std::log1p(std::exp(x));
+    }
+
+public:
+
+    /**
+     * @brief Construct a new Hierarchical Softmax Loss object.
+     *
+     * @param hidden Rows of the hidden vector from the last layer
+     * @param classes Number of classes
+     * @param frequencies Frequency of each class, frequent classes get shorter
+     * paths. Uniform (a balanced tree) if empty (optional)
+    */
+    HierarchicalSoftmaxLoss(int hidden, int classes, const vector<double>& frequencies = {})
+        : EndLayer<T>(1, hidden, 1), classes(classes),
+          weights(MatrixD::Random(hidden, classes - 1)), bias(MatrixD::Random(classes - 1, 1))
+    {
+        if (classes < 2){
+            std::cerr << "Must be a classification of 2 outputs minimum." << endl;
+            assert(classes >= 2);
+        }
+        if (!frequencies.empty() && frequencies.size() != static_cast<size_t>(classes)){
+            throw std::invalid_argument("Need one frequency per class.");
+        }
+        buildTree(frequencies.empty() ? vector<double>(classes, 1.0) : frequencies);
+    }
+
+    // Copy constructor
+    HierarchicalSoftmaxLoss(const HierarchicalSoftmaxLoss& hsl) = default;
+
+    // Clone
+    unique_ptr<EndLayer<T>> clone() const override {
+        return std::make_unique<HierarchicalSoftmaxLoss<T>>(*this);
+    }
+
+    // Destructor
+    ~HierarchicalSoftmaxLoss() override = default;
+
+    // Getters
+    [[nodiscard]] int getClasses() const { return classes; }
+    [[nodiscard]] const vector<int>& getPath(int k) const { return paths[k]; }
+
+    [[nodiscard]] bool hasParameters() const override { return true; }
+
+    // Weights then bias
+    vector<MatrixD*> parameters() override { return {&weights, &bias}; }
+    vector<MatrixD*> gradients() override { return {&accumulated_weights, &accumulated_bias}; }
+
+    /**
+     * @brief Probability of every class, O(classes * hidden).
+     *
+     * @param res hidden vector from the last layer
+     * @return vector<MatrixD> classes x 1 probabilities
+    */
+    vector<MatrixD> predict(const vector<MatrixD>& res) const override {
+        this->assertInputDimensions(res);
+
+        // Probability of reaching each node, walking down from the root (the last merge)
+        const MatrixD decisions = (weights.transpose() * res[0] + bias).unaryExpr(
+            [](T x){ return T(1) / (T(1) + std::exp(-x)); });
+        vector<T> reach(2 * classes - 1, 0);
+        reach.back() = 1;
+        for (int i = classes - 2; i >= 0; i--){
+            const T p = reach[classes + i];
+            reach[children[i].first] = p * decisions(i, 0);
+            reach[children[i].second] = p * (1 - decisions(i, 0));
+        }
+
+        MatrixD probabilities(classes, 1);
+        for (int i = 0; i < classes; i++){
+            probabilities(i, 0) = reach[i];
+        }
+        return {probabilities};
+    }
+
+    /**
+     * @brief Forward pass, -log P(true class | res) along its tree path.
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @return T loss for that input
+    */
+    T forward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        this->assertInputDimensions(res);
+        const int k = label(true_res);
+
+        T loss = 0;
+        for (size_t d = 0; d < paths[k].size(); d++){
+            const int node = paths[k][d];
+            const T x = weights.col(node).dot(res[0].col(0)) + bias(node, 0);
+            loss -= logSigmoid(codes[k][d] == 1 ? x : -x);
+        }
+        return loss;
+    }
+
+    /**
+     * @brief Gradient w.r.t. the hidden vector, without updating the inner nodes.
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @return vector<MatrixD> gradient w.r.t. res
+    */
+    vector<MatrixD> backward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        return backward(res, true_res, 0);
+    }
+
+    /**
+     * @brief Gradient w.r.t. the hidden vector. Updates only the inner nodes on
+     * the path of the true class, or adds their gradients to the accumulators
+     * (see setGradientAccumulation).
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @param learning_rate Learning rate
+     * @return vector<MatrixD> gradient w.r.t. res
+    */
+    vector<MatrixD> backward(vector<MatrixD>& res, vector<MatrixD>& true_res, const T learning_rate) override {
+        this->assertInputDimensions(res);
+        const int k = label(true_res);
+
+        MatrixD input_gradient = MatrixD::Zero(this->R, 1);
+        for (size_t d = 0; d < paths[k].size(); d++){
+            const int node = paths[k][d];
+            const T x = weights.col(node).dot(res[0].col(0)) + bias(node, 0);
+
+            // d/dx of -log sigmoid(x) is sigmoid(x) - 1, of -log(1 - sigmoid(x)) it is sigmoid(x)
+            const T g = T(1) / (T(1) + std::exp(-x)) - codes[k][d];
+
+            input_gradient.col(0) += g * weights.col(node);
+            if (this->accumulate){
+                accumulated_weights.col(node) += g * res[0].col(0);
+                accumulated_bias(node, 0) += g;
+            } else if (learning_rate != 0){
+                weights.col(node) -= (learning_rate * g) * res[0].col(0);
+                bias(node, 0) -= learning_rate * g;
+            }
+        }
+
+        return {input_gradient};
+    }
+
+};
+
+}
+
+#endif // HIERARCHICAL_SOFTMAX_LOSS_HPP
@@ -59,6 +59,9 @@ public:
         return (error / ((this->D)*(this->R)*(this->C)));
     }
 
+    // Keep the overload taking a learning rate visible
+    using EndLayer<T>::backward;
+
     /**
      * @brief Get derivative of error w.r.t mean squared error for every element in result.
      * 
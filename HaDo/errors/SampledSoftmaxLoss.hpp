@@ -0,0 +1,322 @@
+#ifndef SAMPLED_SOFTMAX_LOSS_HPP
+#define SAMPLED_SOFTMAX_LOSS_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/EndLayer.hpp"
+#include "HaDo/util/AliasSampler.hpp"
+#include <memory>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <iostream>
+
+using Eigen::Matrix;
+using std::vector;
+using Eigen::Dynamic;
+
+namespace hado {
+
+/**
+ * @brief Sampled softmax cross entropy end layer for very large numbers of
+ * classes. It owns the output projection (weights and bias from the hidden
+ * vector to one logit per class), so the network ends at the hidden vector.
+ *
+ * @details Training evaluates the logits of the true class and of num_sampled
+ * negative classes drawn from an alias table, each corrected by -log(expected
+ * count), and takes softmax cross entropy over those only. A drawn class equal
+ * to the true class is masked out. Cost per sample is O(num_sampled * hidden)
+ * instead of O(classes * hidden).
+ *
+ * Use predict() for the full softmax at inference, and testForward for the
+ * exact loss. The true result is a 1x1
+ * class index or a one-hot vector of classes rows.
+ *
+ * @tparam T scalar type (float, double, long double)
+*/
+template<typename T=float>
+class SampledSoftmaxLoss : public EndLayer<T> {
+private:
+
+    // Convenience typedef
+    using typename EndLayer<T>::MatrixD;
+
+    // Number of classes
+    int classes;
+
+    // Number of negative classes drawn per sample
+    int num_sampled;
+
+    // Output projection, one column per class, and bias
+    MatrixD weights;
+    MatrixD bias;
+
+    // Gradients summed over backward calls while accumulating
+    MatrixD accumulated_weights;
+    MatrixD accumulated_bias;
+
+    // Distribution negatives are drawn from
+    AliasSampler<double> sampler;
+    std::mt19937 rng;
+
+    // True class followed by the drawn classes of the last forward pass
+    vector<int> candidates;
+
+    // Gradient of the loss w.r.t. the logit of each candidate
+    MatrixD logit_gradient;
+
+    // Whether the candidates were drawn by a forward pass not yet followed by backward
+    bool drawn_by_forward = false;
+
+    /**
+     * @brief Get the true class from a 1x1 index or a one-hot vector.
+     *
+     * @param true_res True result tensor
+    */
+    int label(const vector<MatrixD>& true_res) const {
+        const int index = this->classIndex(true_res, classes);
+        if (index >= 0){
+            return index;
+        }
+
+        if (true_res.size() != 1 || true_res[0].rows() != classes || true_res[0].cols() != 1){
+            std::cerr << "Expected a 1x1 class index or a " << classes << "x1 one-hot vector" << endl;
+            throw std::invalid_argument("True result must be a class index or one-hot vector.");
+        }
+        int k;
+        true_res[0].col(0).maxCoeff(&k);
+        return k;
+    }
+
+    /**
+     * @brief Draw the negatives for the true class.
+     *
+     * @param k True class
+    */
+    void draw(const int k) {
+        candidates.resize(num_sampled + 1);
+        candidates[0] = k;
+        for (int j = 1; j <= num_sampled; j++){
+            candidates[j] = sampler(rng);
+        }
+    }
+
+    /**
+     * @brief Compute the sampled loss over the current candidates and the
+     * gradient w.r.t. the candidate logits.
+     *
+     * @param hidden hidden x 1 input
+    */
+    T evaluate(const MatrixD& hidden) {
+        const int k = candidates[0];
+
+        // Logits corrected by the log of the expected number of draws
+        MatrixD logits(num_sampled + 1, 1);
+        for (int j = 0; j <= num_sampled; j++){
+            const int c = candidates[j];
+            if (j > 0 && c == k){
+                logits(j, 0) = -std::numeric_limits<T>::infinity();
+                continue;
+            }
+            const double expected = num_sampled * sampler.probability(c);
+            logits(j, 0) = weights.col(c).dot(hidden.col(0)) + bias(c, 0)
+                - (expected > 0 ? static_cast<T>(std::log(expected)) : T(0));
+        }
+
+        const T max = logits.maxCoeff();
+        logit_gradient = (logits.array() - max).exp();
+        const T sum = logit_gradient.sum();
+        logit_gradient /= sum;
+        logit_gradient(0, 0) -= 1;
+
+        return max + std::log(sum) - logits(0, 0);
+    }
+
+public:
+
+    /**
+     * @brief Construct a new Sampled Softmax Loss object.
+     *
+     * @param hidden Rows of the hidden vector from the last layer
+     * @param classes Number of classes
+     * @param num_sampled Negative classes drawn per training sample
+     * @param sampling_weights Weight of each class when drawing negatives,
+     * i.e. class frequencies. Uniform if empty (optional)
+     * @param seed Seed for drawing negatives (optional)
+    */
+    SampledSoftmaxLoss(int hidden, int classes, int num_sampled,
+                       const vector<double>& sampling_weights = {},
+                       unsigned seed = std::random_device{}())
+        : EndLayer<T>(1, hidden, 1), classes(classes), num_sampled(num_sampled),
+          weights(MatrixD::Random(hidden, classes)), bias(MatrixD::Random(classes, 1)),
+          sampler(sampling_weights.empty() ? vector<double>(classes, 1.0) : sampling_weights),
+          rng(seed)
+    {
+        if (classes < 2 || num_sampled < 1){
+            std::cerr << "Must be a classification of 2 outputs minimum, with at least 1 sample." << endl;
+            assert(classes >= 2 && num_sampled >= 1);
+        }
+        if (sampler.size() != classes){
+            throw std::invalid_argument("Need one sampling weight per class.");
+        }
+    }
+
+    // Copy constructor (copies the generator state too, see reseed)
+    SampledSoftmaxLoss(const SampledSoftmaxLoss& ssl) = default;
+
+    // Clone
+    unique_ptr<EndLayer<T>> clone() const override {
+        return std::make_unique<SampledSoftmaxLoss<T>>(*this);
+    }
+
+    // Destructor
+    ~SampledSoftmaxLoss() override = default;
+
+    // Getters
+    [[nodiscard]] int getClasses() const { return classes; }
+    [[nodiscard]] int getNumSampled() const { return num_sampled; }
+    [[nodiscard]] const MatrixD& getWeights() const { return weights; }
+    [[nodiscard]] const MatrixD& getBias() const { return bias; }
+
+    /**
+     * @brief Replace the output projection.
+     *
+     * @param new_weights hidden x classes weights
+     * @param new_bias classes x 1 bias
+    */
+    void setWeights(const MatrixD& new_weights, const MatrixD& new_bias){
+        if (new_weights.rows() != this->R || new_weights.cols() != classes
+            || new_bias.rows() != classes || new_bias.cols() != 1){
+            throw std::invalid_argument("Weights must match dimensions of layer.");
+        }
+        weights = new_weights;
+        bias = new_bias;
+    }
+
+    // Restart the draws of negatives from seed
+    void reseed(const unsigned seed) override {
+        rng.seed(seed);
+        drawn_by_forward = false;
+    }
+
+    [[nodiscard]] bool hasParameters() const override { return true; }
+
+    // Weights then bias
+    vector<MatrixD*> parameters() override { return {&weights, &bias}; }
+    vector<MatrixD*> gradients() override { return {&accumulated_weights, &accumulated_bias}; }
+
+    /**
+     * @brief Full logits over all classes, O(classes * hidden).
+     *
+     * @param res hidden vector from the last layer
+     * @return MatrixD classes x 1 logits
+    */
+    MatrixD logits(const vector<MatrixD>& res) const {
+        this->assertInputDimensions(res);
+        return weights.transpose() * res[0] + bias;
+    }
+
+    /**
+     * @brief Full softmax over all classes, O(classes * hidden).
+     *
+     * @param res hidden vector from the last layer
+     * @return vector<MatrixD> classes x 1 probabilities
+    */
+    vector<MatrixD> predict(const vector<MatrixD>& res) const override {
+        MatrixD probabilities = logits(res);
+        probabilities = (probabilities.array() - probabilities.maxCoeff()).exp();
+        probabilities /= probabilities.sum();
+        return {probabilities};
+    }
+
+    /**
+     * @brief Exact softmax cross entropy over all classes, O(classes * hidden),
+     * for testing where the sampled loss of forward is only an estimate.
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @return T loss for that input
+    */
+    T testForward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        const MatrixD z = logits(res);
+        const T max = z.maxCoeff();
+        return max + std::log((z.array() - max).exp().sum()) - z(label(true_res), 0);
+    }
+
+    /**
+     * @brief Forward pass. Draws negatives and returns the sampled softmax loss.
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @return T sampled loss for that input
+    */
+    T forward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        this->assertInputDimensions(res);
+        draw(label(true_res));
+        drawn_by_forward = true;
+        return evaluate(res[0]);
+    }
+
+    /**
+     * @brief Gradient of the sampled loss w.r.t. the hidden vector, without
+     * updating the output projection.
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @return vector<MatrixD> gradient w.r.t. res
+    */
+    vector<MatrixD> backward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        return backward(res, true_res, 0);
+    }
+
+    /**
+     * @brief Gradient of the sampled loss w.r.t. the hidden vector. Updates the
+     * weights and bias of the candidate classes only, or adds their gradients
+     * to the accumulators (see setGradientAccumulation). Reuses the negatives
+     * drawn by the forward pass directly before it for the same class, and
+     * draws new ones otherwise. The logits are recomputed from res either way.
+     *
+     * @param res hidden vector from the last layer
+     * @param true_res 1x1 class index or one-hot vector
+     * @param learning_rate Learning rate
+     * @return vector<MatrixD> gradient w.r.t. res
+    */
+    vector<MatrixD> backward(vector<MatrixD>& res, vector<MatrixD>& true_res, const T learning_rate) override {
+        this->assertInputDimensions(res);
+        const int k = label(true_res);
+        if (!drawn_by_forward || candidates[0] != k){
+            draw(k);
+        }
+        drawn_by_forward = false;
+        evaluate(res[0]);
+
+        // Gradient w.r.t. the hidden vector uses the weights before the update
+        MatrixD input_gradient = MatrixD::Zero(this->R, 1);
+        for (int j = 0; j <= num_sampled; j++){
+            if (logit_gradient(j, 0) != 0){
+                input_gradient.col(0) += logit_gradient(j, 0) * weights.col(candidates[j]);
+            }
+        }
+
+        if (this->accumulate){
+            for (int j = 0; j <= num_sampled; j++){
+                const int c = candidates[j];
+                accumulated_weights.col(c) += logit_gradient(j, 0) * res[0].col(0);
+                accumulated_bias(c, 0) += logit_gradient(j, 0);
+            }
+        } else if (learning_rate != 0){
+            for (int j = 0; j <= num_sampled; j++){
+                const int c = candidates[j];
+                weights.col(c) -= (learning_rate * logit_gradient(j, 0)) * res[0].col(0);
+                bias(c, 0) -= learning_rate * logit_gradient(j, 0);
+            }
+        }
+
+        return {input_gradient};
+    }
+
+};
+
+}
+
+#endif // SAMPLED_SOFTMAX_LOSS_HPP
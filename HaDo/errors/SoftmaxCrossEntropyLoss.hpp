@@ -0,0 +1,159 @@
+#ifndef SOFTMAX_CROSS_ENTROPY_LOSS_HPP
+#define SOFTMAX_CROSS_ENTROPY_LOSS_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/EndLayer.hpp"
+#include <memory>
+#include <cmath>
+#include <iostream>
+
+using Eigen::Matrix;
+using std::vector;
+using Eigen::Dynamic;
+
+namespace hado {
+
+/**
+ * @brief Softmax followed by cross entropy loss, fused into one end layer
+ * that takes the raw logits of the network.
+ *
+ * @details Forward computes the loss as log-sum-exp(z) - <t, z>, backward
+ * returns softmax(z) - t. The softmax is computed once per training step:
+ * forward keeps it and the next backward uses it, so backward must get the
+ * logits forward saw. A backward without a forward before it computes the
+ * softmax itself. Use it in place of a SoftmaxLayer followed by CrossEntropyLoss.
+ *
+ * The true result is either a one-hot (or any probability) vector of R rows,
+ * or a 1x1 matrix holding the index of the correct class.
+ *
+ * @tparam T scalar type (float, double, long double)
+*/
+template<typename T=float>
+class SoftmaxCrossEntropyLoss : public EndLayer<T> {
+private:
+
+    // Convenience typedef
+    using typename EndLayer<T>::MatrixD;
+
+    // Softmax of the last logits passed forward
+    MatrixD probabilities;
+
+    // Whether probabilities are those of a forward not yet followed by backward
+    bool forwarded = false;
+
+    /**
+     * @brief Compute softmax of the logits into probabilities, and return
+     * log-sum-exp of the logits.
+     *
+     * @param logits R x 1 logits
+    */
+    T computeProbabilities(const MatrixD& logits) {
+        const T max = logits.maxCoeff();
+        probabilities = (logits.array() - max).exp();
+        const T sum = probabilities.sum();
+        probabilities /= sum;
+        return max + std::log(sum);
+    }
+
+    /**
+     * @brief Check the true result is a one-hot vector or a valid class index,
+     * and return the class index, or -1 for a vector.
+     *
+     * @param true_res True result tensor
+    */
+    int labelIndex(const vector<MatrixD>& true_res) const {
+        const int index = this->classIndex(true_res, this->R);
+        if (index < 0){
+            this->assertInputDimensions(true_res);
+        }
+        return index;
+    }
+
+public:
+
+    /**
+     * @brief Construct a new Softmax Cross Entropy Loss object.
+     *
+     * @param R number of classes/rows in output
+    */
+    explicit SoftmaxCrossEntropyLoss(int R) : EndLayer<T>(1, R, 1) {
+        if (R < 2){
+            std::cerr << "Must be a classification of 2 outputs minimum." << endl;
+            assert(R >= 2);
+        }
+    }
+
+    // Copy constructor
+    SoftmaxCrossEntropyLoss(const SoftmaxCrossEntropyLoss& scel)
+        : EndLayer<T>(scel), probabilities(scel.probabilities) {}
+
+    // Clone
+    unique_ptr<EndLayer<T>> clone() const override {
+        return std::make_unique<SoftmaxCrossEntropyLoss<T>>(*this);
+    }
+
+    // Destructor
+    ~SoftmaxCrossEntropyLoss() override = default;
+
+    // Softmax probabilities of the last forward pass
+    [[nodiscard]] const MatrixD& getProbabilities() const { return probabilities; }
+
+    /**
+     * @brief Forward pass, cross entropy of the softmax of res against true_res.
+     *
+     * @param res logits from the previous layer
+     * @param true_res one-hot vector or 1x1 class index
+     * @return T loss for that input
+    */
+    T forward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        // Assert tensor dimensions
+        this->assertInputDimensions(res);
+        const int index = labelIndex(true_res);
+
+        const T log_sum_exp = computeProbabilities(res[0]);
+        forwarded = true;
+
+        // -log softmax(z)_k = log-sum-exp(z) - z_k, weighted by the targets
+        if (index >= 0){
+            return log_sum_exp - res[0](index, 0);
+        }
+        return log_sum_exp * true_res[0].sum() - true_res[0].cwiseProduct(res[0]).sum();
+    }
+
+    // Keep the overload taking a learning rate visible
+    using EndLayer<T>::backward;
+
+    /**
+     * @brief Backward pass, softmax(res) - true_res. Uses the softmax of the
+     * forward pass just before, which must have been given the same res, and
+     * computes it only if there was none.
+     *
+     * @param res logits from the previous layer
+     * @param true_res one-hot vector or 1x1 class index
+     * @return vector<MatrixD> gradient of the loss with respect to the logits
+    */
+    vector<MatrixD> backward(vector<MatrixD>& res, vector<MatrixD>& true_res) override {
+        // Assert tensor dimensions
+        this->assertInputDimensions(res);
+        const int index = labelIndex(true_res);
+
+        if (!forwarded){
+            computeProbabilities(res[0]);
+        }
+        forwarded = false;
+
+        vector<MatrixD> grad = {probabilities};
+        if (index >= 0){
+            grad[0](index, 0) -= 1;
+        } else{
+            grad[0] -= true_res[0];
+        }
+        return grad;
+    }
+
+};
+
+}
+
+#endif
@@ -4,6 +4,11 @@
 #include <Eigen/Dense>
 #include <vector>
 #include "HaDo/base/Layer.hpp"
+#include "HaDo/base/ActivationFunctions.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include "HaDo/layers/DenseLayer.hpp"
+#include "HaDo/layers/DenseActivationLayer.hpp"
+#include "HaDo/layers/ConvolutionalLayer.hpp"
 #include <memory>
 #include <thread>
 #include <iostream>
@@ -19,7 +24,14 @@ namespace hado {
 /**
  * @brief Activation layer class.
  * 
- * @details Activation layer class that applies an activation function
+ * @details Activation layer class that applies an activation function. If
+ * ActivationPrime can work from the activation output (see derivative_from_output)
+ * the layer keeps its output for backward, otherwise it keeps its input.
+ * 
+ * In in-place mode the layer overwrites the input tensor it is given and hands
+ * that same buffer on, so each element is written once and no output copy is
+ * held. Backward then only needs the derivative, which the layer stores on its
+ * own (a byte mask for ReLU).
  * 
  * @tparam Activation Activation function
  * @tparam ActivationPrime Derivative of activation function
@@ -29,8 +41,9 @@ template<typename Activation, typename ActivationPrime, typename T=float>
 class ActivationLayer : public Layer<T> {
 private:
 
-    // Convenience typedef
+    // Convenience typedefs
     using typename Layer<T>::MatrixD;
+    typedef Matrix<bool, Dynamic, Dynamic> MatrixB;
 
     // Convenience variables inaccessible from outside
     // Depth of input and output
@@ -45,6 +58,21 @@ private:
     // Product of rows and columns to decide whether to thread
     int prod;
 
+    // Whether the layer transforms its input buffer instead of writing a new output
+    bool in_place;
+
+    // In-place mode: derivative of the activation at the last input
+    vector<MatrixD> derivative;
+
+    // In-place mode for ReLU: where the last input was positive
+    vector<MatrixB> mask;
+
+    // Whether backward evaluates the derivative from the stored output (else the stored input)
+    static constexpr bool from_output = derivative_from_output_v<ActivationPrime, T>;
+
+    // ReLU derivative is 0 or 1, so in-place mode only keeps a mask
+    static constexpr bool use_mask = std::is_same_v<ActivationPrime, relu_prime<T>>;
+
     // Assert that Activation and ActivationPrime are functions that take a scalar and return a scalar
     static_assert(
         std::is_invocable_r_v<T, Activation, T>,
@@ -64,95 +92,206 @@ public:
      * @param D Depth of input/output tensor
      * @param R Rows in input/output tensor
      * @param C Columns in input/output tensor
+     * @param in_place Overwrite and pass on the input tensor instead of allocating an output (optional)
     */
-    ActivationLayer(int D, int R, int C) :
+    ActivationLayer(int D, int R, int C, bool in_place = false) :
         Layer<T>(D, D, R, C, R, C),
-        D(D), R(R), C(C), prod(R*C)
+        D(D), R(R), C(C), prod(R*C), in_place(in_place)
     {
-        this->inp = vector<MatrixD>(D);
-        this->out = vector<MatrixD>(D);
+        if (in_place){
+            if constexpr (use_mask){
+                mask = vector<MatrixB>(D);
+            } else{
+                derivative = vector<MatrixD>(D);
+            }
+        } else{
+            this->inp = vector<MatrixD>(D);
+            this->out = vector<MatrixD>(D);
+        }
     }
 
     // Copy constructor
     ActivationLayer(const ActivationLayer<Activation, ActivationPrime, T>& other) 
-        : Layer<T>(other.getInputDepth(), other.getOutputDepth(), 
-            other.getInputRows(), other.getInputCols(), 
-            other.getOutputRows(), other.getOutputCols()),
+        : Layer<T>(other),
             D(other.getInputDepth()),
             R(other.getInputRows()),
             C(other.getInputCols()),
-            prod(other.getInputRows() * other.getInputCols())
-    {
-        this->inp = other.inp;
-        this->out = other.out;
-    }
+            prod(other.getInputRows() * other.getInputCols()),
+            in_place(other.in_place),
+            derivative(other.derivative),
+            mask(other.mask) {}
 
     // Clone returning unique pointer
     unique_ptr<Layer<T>> clone() const override {
         return std::make_unique<ActivationLayer<Activation, ActivationPrime, T>>(*this);
     }
 
+    // Cost model, the defaults of one FLOP per element forward and two backward
+    [[nodiscard]] std::string name() const override { return "ActivationLayer"; }
+
     // Destructor
     ~ActivationLayer() override {}
 
+    // Whether the layer works in place
+    bool isInPlace() const { return in_place; }
+
     /**
-     * @brief Forward pass of the activation layer.
+     * @brief Fuse into the layer before: a DenseLayer becomes a DenseActivationLayer,
+     * a ConvolutionalLayer with identity activation takes this activation.
+     *
+     * @param previous Layer directly before this one
+     * @return Fused layer, or nullptr if there is none
+    */
+    unique_ptr<Layer<T>> fuseWithPrevious(const Layer<T>& previous) const override {
+        if (const auto* dense = dynamic_cast<const DenseLayer<T>*>(&previous)){
+            return std::make_unique<DenseActivationLayer<Activation, ActivationPrime, T>>(*dense);
+        }
+
+        typedef ConvolutionalLayer<T, identity<T>, identity_prime<T>> LinearConvolution;
+        if (const auto* conv = dynamic_cast<const LinearConvolution*>(&previous)){
+            auto fused = std::make_unique<ConvolutionalLayer<T, Activation, ActivationPrime>>(
+                conv->getInputDepth(), conv->getOutputDepth(), conv->getInputRows(), conv->getInputCols(),
+                conv->getKernelSize(), conv->getStride(), conv->getPadding());
+            fused->setFilters(conv->getFilters());
+            return fused;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Forward pass of the activation layer. In in-place mode input_tensor
+     * is overwritten and moved into the result.
      * 
      * @param input_tensor Input tensor
      * @return Output tensor of same dimensions as input tensor
     */
+    vector<MatrixD> forward(vector<MatrixD>& input_tensor) override {
+        vector<MatrixD> output;
+        forwardInto(input_tensor, output);
+        return output;
+    }
+
+    /**
+     * @brief Forward pass writing into output_tensor, reusing its storage. When
+     * not training nothing is kept for backward. In in-place mode input_tensor
+     * is overwritten and swapped with output_tensor.
+     * 
+     * @param input_tensor Input tensor
+     * @param output_tensor Output tensor to overwrite
+    */
     #pragma GCC push_options
     #pragma GCC optimize("O2")
-    vector<MatrixD> forward(vector<MatrixD>& input_tensor) override {
+    void forwardInto(vector<MatrixD>& input_tensor, vector<MatrixD>& out_copy) override {
 
         // Assert input tensor dimensions
         this->assertInputDimensions(input_tensor);
 
         // Get copy because we need to pass one forward, and one stays in layer
-        vector<MatrixD> out_copy(D);
+        if (!in_place){
+            out_copy.resize(D);
+        }
         #ifdef _OPENMP
             #include <omp.h>
             if (D > _MAX_DEPTH_UNTIL_THREADING && prod >= _MAX_PROD_UNTIL_THREADING){
                 omp_set_num_threads(D);
                 #pragma omp parallel for
                 for (int i = 0; i < D; i++){
-                    forward_function(input_tensor[i], this->out[i], out_copy[i]);
+                    HADO_TRACE_SPAN("ActivationLayer forward channel", "thread");
+                    forward_depth(i, input_tensor, out_copy);
                 }
             } else{
                 // Iterate through depth of tensor
                 for (int i = 0; i < D; i++){
-                    forward_function(input_tensor[i], this->out[i], out_copy[i]);
+                    forward_depth(i, input_tensor, out_copy);
                 }
             }
         #else
             for (int i = 0; i < D; i++){
-                forward_function(input_tensor[i], this->out[i], out_copy[i]);
+                forward_depth(i, input_tensor, out_copy);
             }
         #endif
 
-        return (out_copy);
+        if (in_place){
+            std::swap(out_copy, input_tensor);
+        }
     }
     #pragma GCC pop_options
+
+    // Inference kernel, applies the activation into the output
+    typename Layer<T>::InferenceKernel compileInference() const override {
+        return [](const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>&){
+            for (size_t i = 0; i < input.size(); i++){
+                output[i] = input[i].unaryExpr(Activation());
+            }
+        };
+    }
+
+    // Element-wise, so any batch of columns
+    [[nodiscard]] bool batchesColumns() const override {
+        return true;
+    }
+
+    // Element-wise, so columns train as separate samples too
+    [[nodiscard]] bool trainsColumns() const override {
+        return true;
+    }
+
+    // Output (or mask/derivative in-place), and the input if the derivative needs it
+    [[nodiscard]] size_t savedActivationElements() const override {
+        if (in_place || from_output){
+            return this->outputElements();
+        }
+        return this->inputElements() + this->outputElements();
+    }
+
+    // Free the kept tensors, including the in-place mask or derivative
+    void clearActivations() override {
+        Layer<T>::clearActivations();
+        for (auto& m : derivative){
+            m.resize(0, 0);
+        }
+        for (auto& m : mask){
+            m.resize(0, 0);
+        }
+    }
     
 
     /**
      * @brief Backward pass of the activation layer. Output gradient tensor must be a size 1 std::vector
-     * of MatrixD. Input gradient tensor (returned) is the same size.
+     * of MatrixD. Input gradient tensor (returned) is the same size. In in-place mode
+     * output_gradient is overwritten and moved into the result.
      * 
      * @param output_gradient Output gradient tensor (one dimensional, must have right size)
      * @param learning_rate Learning rate
      * @return vector<MatrixD> Input gradient tensor
      */
+    vector<MatrixD> backward(vector<MatrixD>& output_gradient, const T learning_rate) override{
+        vector<MatrixD> input_gradient;
+        backwardInto(output_gradient, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    /**
+     * @brief Backward pass writing into input_gradient, reusing its storage. In
+     * in-place mode output_gradient is overwritten and swapped with it.
+     * 
+     * @param output_gradient Output gradient tensor
+     * @param input_gradient Input gradient tensor to overwrite
+     * @param learning_rate Learning rate
+    */
     #pragma GCC diagnostic ignored "-Wunused-parameter"
     #pragma GCC push_options
     #pragma GCC optimize("O2")
-    vector<MatrixD> backward(vector<MatrixD>& output_gradient, const T learning_rate) override{
+    void backwardInto(vector<MatrixD>& output_gradient, vector<MatrixD>& input_gradient, const T learning_rate) override{
 
         // Assert that output gradient tensor is the same size as the input tensor
         this->assertOutputDimensions(output_gradient);
 
-        // Array to store input gradient (not the input)
-        vector<MatrixD> input_gradient(D);
+        // Input gradient (not the input), written in place of the output gradient in in-place mode
+        if (!in_place){
+            input_gradient.resize(D);
+        }
 
         #ifdef _OPENMP
             #include <omp.h>
@@ -160,43 +299,99 @@ public:
                 omp_set_num_threads(D);
                 #pragma omp parallel for
                 for (int i = 0; i < D; i++){
-                    backward_function(output_gradient[i], this->out[i], input_gradient[i]);
+                    HADO_TRACE_SPAN("ActivationLayer backward channel", "thread");
+                    backward_depth(i, output_gradient, input_gradient);
                 }
             } else{
                 // Iterate through depth of tensor
                 for (int i = 0; i < D; i++){
-                    backward_function(output_gradient[i], this->out[i], input_gradient[i]);
+                    backward_depth(i, output_gradient, input_gradient);
                 }
             }
         #else
             // Iterate through depth of tensor
             for (int i = 0; i < D; i++){
-                backward_function(output_gradient[i], this->out[i], input_gradient[i]);
+                backward_depth(i, output_gradient, input_gradient);
             }
         #endif
 
-        return {input_gradient};
+        if (in_place){
+            std::swap(input_gradient, output_gradient);
+        }
     }
     #pragma GCC pop_options
 
 private:
 
+    // Forward pass for a single depth slice
+    void forward_depth(int i, vector<MatrixD>& input_tensor, vector<MatrixD>& out_copy){
+        if (!in_place){
+            if (this->training){
+                forward_function(input_tensor[i], this->inp[i], this->out[i], out_copy[i]);
+            } else{
+                out_copy[i] = input_tensor[i].unaryExpr(Activation());
+            }
+            return;
+        }
+
+        MatrixD& x = input_tensor[i];
+        if (!this->training){
+            x = x.unaryExpr(Activation());
+            return;
+        }
+        if constexpr (use_mask){
+            mask[i] = (x.array() > T(0)).matrix();
+            x = x.unaryExpr(Activation());
+        } else if constexpr (from_output){
+            x = x.unaryExpr(Activation());
+            derivative[i] = ActivationPrime::from_output(x.array()).matrix();
+        } else{
+            derivative[i] = x.unaryExpr(ActivationPrime());
+            x = x.unaryExpr(Activation());
+        }
+    }
+
+    // Backward pass for a single depth slice
+    void backward_depth(int i, vector<MatrixD>& output_gradient, vector<MatrixD>& input_gradient){
+        if (!in_place){
+            backward_function(output_gradient[i], from_output ? this->out[i] : this->inp[i], input_gradient[i]);
+            return;
+        }
+
+        MatrixD& g = output_gradient[i];
+        if constexpr (use_mask){
+            g = mask[i].select(g, MatrixD::Zero(g.rows(), g.cols()));
+        } else{
+            g = g.cwiseProduct(derivative[i]);
+        }
+    }
+
     // Private lambda for forward pass with threading
-    static constexpr auto forward_function = [](MatrixD& input, MatrixD& output, MatrixD& output_copy){
+    static constexpr auto forward_function = [](MatrixD& input, MatrixD& stored_input, MatrixD& output, MatrixD& output_copy){
 
         // Apply activation function to all input elements
         output = input.unaryExpr(Activation());
 
         // Copy output to output_copy
         output_copy = output;
+
+        // Keep the input only if the derivative needs it
+        if constexpr (!from_output){
+            stored_input = input;
+        }
     };
 
     // Private lambda for backward pass with threading
-    static constexpr auto backward_function = [](MatrixD& output_gradient, MatrixD& output, MatrixD& input_gradient){
-        
-        // Calculate input gradient for single layer
-        input_gradient = output.unaryExpr(ActivationPrime())
-            .cwiseProduct(output_gradient);
+    static constexpr auto backward_function = [](MatrixD& output_gradient, MatrixD& stored, MatrixD& input_gradient){
+
+        // Calculate input gradient for single layer, stored is the output or the input
+        if constexpr (from_output){
+            input_gradient = ActivationPrime::from_output(stored.array()).matrix()
+                .cwiseProduct(output_gradient);
+        } else{
+            input_gradient = stored.unaryExpr(ActivationPrime())
+                .cwiseProduct(output_gradient);
+        }
     };
 
 };
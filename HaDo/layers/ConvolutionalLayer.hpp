@@ -2,6 +2,10 @@
 #define CONVOLUTIONAL_LAYER_HPP
 
 #include "HaDo/base/Layer.hpp"
+#include "HaDo/base/ActivationFunctions.hpp"
+#include "HaDo/layers/MaxPoolLayer.hpp"
+#include "HaDo/layers/ConvolutionalMaxPoolLayer.hpp"
+#include "HaDo/util/Im2Col.hpp"
 #include <Eigen/Dense>
 #include <vector>
 #include <memory>
@@ -24,6 +28,11 @@ private:
     using typename Layer<T>::MatrixD;
     
     vector<vector<MatrixD>> filters;             // Filters used for the convolution
+    vector<vector<MatrixD>> accumulatedFilters;  // Filter gradients summed while accumulating
+    vector<MatrixD> preActivation;               // Convolution output before activation, only kept if needed
+
+    // Whether backward evaluates the derivative from the stored output (else the pre-activation)
+    static constexpr bool from_output = derivative_from_output_v<ActivationPrime, T>;
 
     // Assert that Activation and ActivationPrime are functions that take a scalar and return a scalar
     static_assert(
@@ -43,6 +52,21 @@ public:
     int getPadding() const { return padding; }
     vector<vector<MatrixD>> getFilters() const { return filters; }
 
+    /**
+     * @brief Replace the filters of this layer. Dimensions must match the layer.
+     *
+     * @param newFilters outputDepth filters of inputDepth kernelSize x kernelSize matrices
+    */
+    void setFilters(const vector<vector<MatrixD>>& newFilters){
+        if (newFilters.size() != static_cast<size_t>(outputDepth)
+            || newFilters[0].size() != static_cast<size_t>(inputDepth)
+            || newFilters[0][0].rows() != kernelSize
+            || newFilters[0][0].cols() != kernelSize){
+            throw std::invalid_argument("Filters must match dimensions of layer.");
+        }
+        filters = newFilters;
+    }
+
     // Constructor
     ConvolutionalLayer(int inputDepth, int outputDepth, int inputRows, int inputCols,
                        int kernelSize, int stride, int padding)
@@ -89,14 +113,12 @@ public:
 
     // Copy constructor
     ConvolutionalLayer(const ConvolutionalLayer &cl)
-        : Layer<T>(cl.getInputDepth(), cl.getOutputDepth(), cl.getInputRows(), cl.getInputCols(),
-                   cl.getOutputRows(), cl.getOutputCols())
-    {
-        this->kernelSize = cl.getKernelSize();
-        this->stride = cl.getStride();
-        this->padding = cl.getPadding();
-        this->filters = cl.getFilters();
-    }
+        : Layer<T>(cl),
+          kernelSize(cl.kernelSize), stride(cl.stride), padding(cl.padding),
+          inputDepth(cl.inputDepth), outputDepth(cl.outputDepth),
+          inputRows(cl.inputRows), inputCols(cl.inputCols),
+          outputRows(cl.outputRows), outputCols(cl.outputCols),
+          filters(cl.filters), preActivation(cl.preActivation) {}
 
     // Clone returning unique ptr
     virtual std::unique_ptr<Layer<T>> clone() const override
@@ -104,9 +126,103 @@ public:
         return std::make_unique<ConvolutionalLayer>(*this);
     }
 
+    // Cost model, a multiply-add per filter weight and output element, plus the activation
+    [[nodiscard]] std::string name() const override { return "ConvolutionalLayer"; }
+    [[nodiscard]] size_t parameterCount() const override {
+        return static_cast<size_t>(outputDepth) * inputDepth * kernelSize * kernelSize;
+    }
+    [[nodiscard]] double forwardFlops() const override {
+        return 2.0 * parameterCount() * outputRows * outputCols + static_cast<double>(this->outputElements());
+    }
+    [[nodiscard]] double backwardFlops() const override {
+        // Input gradient and filter gradient, each as much as the convolution
+        return 4.0 * parameterCount() * outputRows * outputCols + 2.0 * this->outputElements();
+    }
+
+    // Filters, by output then input channel
+    vector<MatrixD*> parameters() override
+    {
+        vector<MatrixD*> res;
+        for (auto& filter : filters)
+        {
+            for (auto& kernel : filter)
+            {
+                res.push_back(&kernel);
+            }
+        }
+        return res;
+    }
+    vector<MatrixD*> gradients() override
+    {
+        if (accumulatedFilters.size() != filters.size())
+        {
+            accumulatedFilters.assign(filters.size(), vector<MatrixD>(filters[0].size()));
+        }
+        vector<MatrixD*> res;
+        for (auto& filter : accumulatedFilters)
+        {
+            for (auto& kernel : filter)
+            {
+                res.push_back(&kernel);
+            }
+        }
+        return res;
+    }
+
     // Destructor
     ~ConvolutionalLayer() override {}
 
+    /**
+     * @brief Fuse an unpadded MaxPoolLayer after this layer into a ConvolutionalMaxPoolLayer.
+     *
+     * @param next Layer directly after this one
+     * @return Fused layer, or nullptr if there is none
+    */
+    std::unique_ptr<Layer<T>> fuseWithNext(const Layer<T>& next) const override
+    {
+        const auto* pool = dynamic_cast<const MaxPoolLayer<T>*>(&next);
+        if (pool == nullptr || pool->getPadding() != 0)
+        {
+            return nullptr;
+        }
+
+        auto fused = std::make_unique<ConvolutionalMaxPoolLayer<T, Activation, ActivationPrime>>(
+            inputDepth, outputDepth, inputRows, inputCols, kernelSize, stride, padding,
+            pool->getKernelSize(), pool->getStride());
+        fused->setFilters(filters);
+        return fused;
+    }
+
+    /**
+     * @brief Inference kernel, the convolution as one product of the unfolded
+     * input (see im2col) with the filters packed once here.
+    */
+    typename Layer<T>::InferenceKernel compileInference() const override
+    {
+        return [packed = packFilters(filters), kernelSize = kernelSize, stride = stride, padding = padding,
+                rows = outputRows, cols = outputCols]
+            (const vector<MatrixD> &input, vector<MatrixD> &output, vector<MatrixD> &scratch)
+        {
+            scratch.resize(2);
+            im2col(input, kernelSize, stride, padding, rows, cols, scratch[0]);
+            scratch[1].noalias() = scratch[0] * packed;
+            for (size_t od = 0; od < output.size(); ++od)
+            {
+                output[od] = Eigen::Map<const MatrixD>(scratch[1].col(od).data(), rows, cols).unaryExpr(Activation());
+            }
+        };
+    }
+
+    // Free the kept input, output and pre-activation
+    void clearActivations() override
+    {
+        Layer<T>::clearActivations();
+        for (auto &m : preActivation)
+        {
+            m.resize(0, 0);
+        }
+    }
+
     // Initialize filters with random values
     void initializeFilters(int numFilters, int depth, int size)
     {
@@ -122,19 +238,30 @@ public:
     }
 
     virtual vector<MatrixD> forward(vector<MatrixD> &input_tensor) override
+    {
+        vector<MatrixD> output_tensor;
+        forwardInto(input_tensor, output_tensor);
+        return output_tensor;
+    }
+
+    // Forward into output_tensor, each feature map written into its existing storage
+    void forwardInto(vector<MatrixD> &input_tensor, vector<MatrixD> &output_tensor) override
     {
         // Iterate over filters, apply (convolve) each filter matrix within a filter to its respective matrix in the input
         // Sum up convolved matrices to get output matrix for the current vector of filters
         // Apply activation function to each output matrix
         // Output vector will be same length as number of filters
-        this->inp = input_tensor;         // Store the input tensor for potential backward passes or inspection
-        this->out.clear();                // Clear previous outputs
-        this->out.resize(filters.size()); // Resize output vector to hold a feature map for each filter
+        if (this->training)
+        {
+            this->inp = input_tensor;     // Store the input tensor for potential backward passes or inspection
+        }
+        output_tensor.resize(filters.size()); // Resize output vector to hold a feature map for each filter
         // Iterate over each filter
         for (size_t filterIndex = 0; filterIndex < filters.size(); ++filterIndex)
         {
             auto &filter = filters[filterIndex];
-            MatrixD outputFeatureMap = MatrixD::Zero(this->getOutputRows(), this->getOutputCols()); // Initialize output feature map for this filter
+            MatrixD &outputFeatureMap = output_tensor[filterIndex];
+            outputFeatureMap.setZero(this->getOutputRows(), this->getOutputCols()); // Initialize output feature map for this filter
 
             // Each filter has a matrix for each channel in the input tensor
             for (size_t channel = 0; channel < filter.size(); ++channel)
@@ -144,70 +271,96 @@ public:
                 outputFeatureMap += convolve(input_tensor[channel], filter[channel]);
             }
 
+            // Keep the pre-activation only if the derivative cannot use the output
+            if (!from_output && this->training)
+            {
+                this->preActivation.resize(filters.size());
+                this->preActivation[filterIndex] = outputFeatureMap;
+            }
+
             // Apply activation function to the output feature map
             outputFeatureMap = outputFeatureMap.unaryExpr(Activation());
-
-            // Store the activated feature map
-            this->out[filterIndex] = outputFeatureMap;
         }
 
-        return this->out; // Return the vector of output feature maps
+        // Store the activated feature maps for backward
+        if (this->training)
+        {
+            this->out = output_tensor;
+        }
     }
 
+virtual vector<MatrixD> backward(vector<MatrixD> &output_gradient, T learning_rate) override
+{
+    vector<MatrixD> input_gradient;
+    backwardInto(output_gradient, input_gradient, learning_rate);
+    return input_gradient;
+}
+
+// Backward into input_gradient, each channel written into its existing storage
 #pragma GCC push_options
 #pragma GCC optimize("O3")
-virtual vector<MatrixD> backward(vector<MatrixD> &output_gradient, T learning_rate) override
+void backwardInto(vector<MatrixD> &output_gradient, vector<MatrixD> &input_gradient, T learning_rate) override
 {
-    vector<MatrixD> input_gradient(this->inputDepth, MatrixD::Zero(this->inputRows, this->inputCols));
+    vector<MatrixD> padded_input_gradient(this->inputDepth, MatrixD::Zero(this->inputRows + 2 * this->padding, this->inputCols + 2 * this->padding));
     vector<vector<MatrixD>> filter_gradients(this->outputDepth, vector<MatrixD>(this->inputDepth, MatrixD::Zero(this->kernelSize, this->kernelSize)));
 
-    // Compute filter gradients and update filters
+    // Pad the stored input once per channel
+    vector<MatrixD> paddedInput(this->inputDepth);
+    for (int id = 0; id < this->inputDepth; ++id)
+    {
+        paddedInput[id] = MatrixD::Zero(this->inputRows + 2 * this->padding, this->inputCols + 2 * this->padding);
+        paddedInput[id].block(this->padding, this->padding, this->inputRows, this->inputCols) = this->inp[id];
+    }
+
     for (int od = 0; od < this->outputDepth; ++od)
     {
-        for (int id = 0; id < this->inputDepth; ++id)
+        // Gradient w.r.t. the pre-activation convolution output
+        MatrixD delta;
+        if constexpr (from_output)
+        {
+            delta = ActivationPrime::from_output(this->out[od].array()).matrix().cwiseProduct(output_gradient[od]);
+        }
+        else
         {
-            MatrixD paddedInput = MatrixD::Zero(this->inputRows + 2 * this->padding, this->inputCols + 2 * this->padding);
-            paddedInput.block(this->padding, this->padding, this->inputRows, this->inputCols) = this->inp[id];
+            delta = this->preActivation[od].unaryExpr(ActivationPrime()).cwiseProduct(output_gradient[od]);
+        }
 
-            for (int y = 0; y < this->outputRows; ++y)
+        for (int y = 0; y < this->outputRows; ++y)
+        {
+            for (int x = 0; x < this->outputCols; ++x)
             {
-                for (int x = 0; x < this->outputCols; ++x)
+                for (int id = 0; id < this->inputDepth; ++id)
                 {
-                    MatrixD subInput = paddedInput.block(y * this->stride, x * this->stride, this->kernelSize, this->kernelSize);
-                    filter_gradients[od][id] += subInput * output_gradient[od](y, x);
+                    // Filter gradient correlates the input with delta, input gradient scatters delta through the filter
+                    filter_gradients[od][id] += delta(y, x) * paddedInput[id].block(y * this->stride, x * this->stride, this->kernelSize, this->kernelSize);
+                    padded_input_gradient[id].block(y * this->stride, x * this->stride, this->kernelSize, this->kernelSize) += delta(y, x) * this->filters[od][id];
                 }
             }
-
-            // Update the filters
-            this->filters[od][id] -= learning_rate * filter_gradients[od][id];
         }
     }
 
-    // Compute input gradients
-    for (int id = 0; id < this->inputDepth; ++id)
+    // Update the filters
+    for (int od = 0; od < this->outputDepth; ++od)
     {
-        for (int od = 0; od < this->outputDepth; ++od)
+        for (int id = 0; id < this->inputDepth; ++id)
         {
-            MatrixD rotated_filter = this->filters[od][id].reverse();
-
-            MatrixD padded_output_grad = MatrixD::Zero(output_gradient[od].rows() + 2 * this->padding, output_gradient[od].cols() + 2 * this->padding);
-            padded_output_grad.block(this->padding, this->padding, output_gradient[od].rows(), output_gradient[od].cols()) = output_gradient[od];
-
-            for (int y = 0; y <= padded_output_grad.rows() - this->kernelSize; y += this->stride)
+            if (this->accumulate)
             {
-                for (int x = 0; x <= padded_output_grad.cols() - this->kernelSize; x += this->stride)
-                {
-                    MatrixD subGrad = padded_output_grad.block(y, x, this->kernelSize, this->kernelSize);
-                    input_gradient[id](y / this->stride, x / this->stride) += (subGrad.array() * rotated_filter.array()).sum();
-                }
+                this->accumulatedFilters[od][id] += filter_gradients[od][id];
+            }
+            else
+            {
+                this->filters[od][id] -= learning_rate * filter_gradients[od][id];
             }
         }
-
-        // Apply the derivative of the activation function to the input gradient
-        input_gradient[id] = input_gradient[id].unaryExpr(ActivationPrime());
     }
 
-    return input_gradient;
+    // Strip the padding from the input gradient
+    input_gradient.resize(this->inputDepth);
+    for (int id = 0; id < this->inputDepth; ++id)
+    {
+        input_gradient[id] = padded_input_gradient[id].block(this->padding, this->padding, this->inputRows, this->inputCols);
+    }
 }
 #pragma GCC pop_options
 
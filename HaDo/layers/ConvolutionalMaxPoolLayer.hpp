@@ -0,0 +1,527 @@
+#ifndef CONVOLUTIONAL_MAX_POOL_LAYER_HPP
+#define CONVOLUTIONAL_MAX_POOL_LAYER_HPP
+
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/base/ActivationFunctions.hpp"
+#include "HaDo/util/Im2Col.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Fused convolution, activation and max pooling layer.
+ *
+ * @details Equivalent to a ConvolutionalLayer<T, Activation, ActivationPrime>
+ * followed by an unpadded MaxPoolLayer<T>, but each feature map is pooled as
+ * soon as it is computed. Only the pooled output, the position of each maximum
+ * and the value the derivative needs at that position (output or
+ * pre-activation, see derivative_from_output) are kept, so the full resolution
+ * feature maps are never stored.
+ *
+ * @tparam T Data type (float for speed, double accuracy)
+ * @tparam Activation Activation function applied to the convolution output
+ * @tparam ActivationPrime Derivative of activation function
+*/
+template <typename T, typename Activation, typename ActivationPrime>
+class ConvolutionalMaxPoolLayer : public Layer<T>
+{
+private:
+    int kernelSize; // Size of the square convolution kernel
+    int stride;     // Stride of the convolution
+    int padding;    // Zero padding applied to the input
+    int poolSize;   // Size of the square pooling window
+    int poolStride; // Stride of the pooling window
+    int convRows;   // Rows of the (never stored) convolution output
+    int convCols;   // Columns of the (never stored) convolution output
+
+    // Convenience typedefs
+    using typename Layer<T>::MatrixD;
+    typedef Matrix<int, Dynamic, Dynamic> MatrixI;
+
+    // Filters used for the convolution, one matrix per input channel per filter
+    vector<vector<MatrixD>> filters;
+
+    // Filter gradients summed while accumulating
+    vector<vector<MatrixD>> accumulatedFilters;
+
+    // Zero padded copy of the last input, needed for filter gradients
+    vector<MatrixD> paddedInput;
+
+    // Convolution output position (row, column) of each pooled maximum
+    vector<MatrixI> argRows;
+    vector<MatrixI> argCols;
+
+    // Activated value at each pooled maximum if the derivative works from the
+    // output, otherwise the pre-activation value there
+    vector<MatrixD> saved;
+
+    // Whether backward evaluates the derivative from the output (else the pre-activation)
+    static constexpr bool from_output = derivative_from_output_v<ActivationPrime, T>;
+
+    // Assert that Activation and ActivationPrime are functions that take a scalar and return a scalar
+    static_assert(
+        std::is_invocable_r_v<T, Activation, T>,
+        "Activation must be a function that takes a scalar and returns a scalar.");
+    static_assert(
+        std::is_invocable_r_v<T, ActivationPrime, T>,
+        "ActivationPrime must be a function that takes a scalar and returns a scalar.");
+
+public:
+
+    /**
+     * @brief Calculate pooled output rows and columns based on input tensor dimensions.
+     *
+     * @param inputRows Rows in input tensor
+     * @param inputCols Columns in input tensor
+     * @param kernelSize Size of convolution kernel
+     * @param stride Convolution stride
+     * @param padding Convolution padding
+     * @param poolSize Size of pooling window
+     * @param poolStride Pooling stride
+    */
+    static constexpr std::pair<int, int>
+        calcOutputDimensions(int inputRows, int inputCols, int kernelSize, int stride, int padding,
+            int poolSize, int poolStride){
+            const int rows = (inputRows - kernelSize + 2 * padding) / stride + 1;
+            const int cols = (inputCols - kernelSize + 2 * padding) / stride + 1;
+            return std::make_pair(
+                (rows - poolSize) / poolStride + 1,
+                (cols - poolSize) / poolStride + 1);
+        }
+
+    // Getters
+    int getKernelSize() const { return kernelSize; }
+    int getStride() const { return stride; }
+    int getPadding() const { return padding; }
+    int getPoolSize() const { return poolSize; }
+    int getPoolStride() const { return poolStride; }
+    vector<vector<MatrixD>> getFilters() const { return filters; }
+
+    /**
+     * @brief Replace the filters of this layer, i.e. to copy them from an
+     * existing ConvolutionalLayer. Dimensions must match the layer.
+     *
+     * @param newFilters outputDepth filters of inputDepth kernelSize x kernelSize matrices
+    */
+    void setFilters(const vector<vector<MatrixD>>& newFilters){
+        if (newFilters.size() != static_cast<size_t>(this->getOutputDepth())
+            || newFilters[0].size() != static_cast<size_t>(this->getInputDepth())
+            || newFilters[0][0].rows() != kernelSize
+            || newFilters[0][0].cols() != kernelSize){
+            throw std::invalid_argument("Filters must match dimensions of layer.");
+        }
+        filters = newFilters;
+    }
+
+    /**
+     * @brief Construct a new fused Convolutional Max Pool Layer object
+     *
+     * @param inputDepth Depth of input tensor
+     * @param outputDepth Number of filters (depth of output tensor)
+     * @param inputRows Rows in input tensor
+     * @param inputCols Columns in input tensor
+     * @param kernelSize Size of convolution kernel
+     * @param stride Convolution stride
+     * @param padding Convolution padding
+     * @param poolSize Size of pooling window
+     * @param poolStride Pooling stride
+    */
+    ConvolutionalMaxPoolLayer(int inputDepth, int outputDepth, int inputRows, int inputCols,
+                              int kernelSize, int stride, int padding, int poolSize, int poolStride)
+        : Layer<T>(inputDepth, outputDepth, inputRows, inputCols,
+                   calcOutputDimensions(inputRows, inputCols, kernelSize, stride, padding, poolSize, poolStride).first,
+                   calcOutputDimensions(inputRows, inputCols, kernelSize, stride, padding, poolSize, poolStride).second),
+          kernelSize(kernelSize), stride(stride), padding(padding),
+          poolSize(poolSize), poolStride(poolStride)
+    {
+        // Assert strides are positive
+        if (stride <= 0 || poolStride <= 0)
+        {
+            std::cerr << "Stride must be positive and non-zero." << endl;
+            assert(stride > 0 && poolStride > 0);
+        }
+
+        // Assert padding is non-negative
+        if (padding < 0)
+        {
+            std::cerr << "Padding must be non-negative." << endl;
+            assert(padding >= 0);
+        }
+
+        // Assert kernel size is positive and not bigger than input size
+        if (kernelSize <= 0 || kernelSize >= inputRows || kernelSize >= inputCols)
+        {
+            std::cerr << "Kernel size must be positive and smaller than input size." << endl;
+            assert(kernelSize > 0 && kernelSize < inputRows && kernelSize < inputCols);
+        }
+
+        convRows = (inputRows - kernelSize + 2 * padding) / stride + 1;
+        convCols = (inputCols - kernelSize + 2 * padding) / stride + 1;
+
+        // Assert pool size is positive and fits in the convolution output
+        if (poolSize <= 0 || poolSize > convRows || poolSize > convCols)
+        {
+            std::cerr << "Pool size must be positive and no bigger than convolution output." << endl;
+            assert(poolSize > 0 && poolSize <= convRows && poolSize <= convCols);
+        }
+
+        filters.resize(outputDepth);
+        for (auto &filter : filters)
+        {
+            filter.resize(inputDepth);
+            for (auto &matrix : filter)
+            {
+                matrix = MatrixD::Random(kernelSize, kernelSize);
+            }
+        }
+    }
+
+    // Copy constructor
+    ConvolutionalMaxPoolLayer(const ConvolutionalMaxPoolLayer &other)
+        : Layer<T>(other),
+          kernelSize(other.kernelSize), stride(other.stride), padding(other.padding),
+          poolSize(other.poolSize), poolStride(other.poolStride),
+          convRows(other.convRows), convCols(other.convCols),
+          filters(other.filters), paddedInput(other.paddedInput),
+          argRows(other.argRows), argCols(other.argCols),
+          saved(other.saved) {}
+
+    // Clone returning unique ptr
+    std::unique_ptr<Layer<T>> clone() const override
+    {
+        return std::make_unique<ConvolutionalMaxPoolLayer>(*this);
+    }
+
+    // Cost model, the convolution and activation as in ConvolutionalLayer, then the pooling
+    [[nodiscard]] std::string name() const override { return "ConvolutionalMaxPoolLayer"; }
+    [[nodiscard]] size_t parameterCount() const override {
+        return static_cast<size_t>(this->getOutputDepth()) * this->getInputDepth() * kernelSize * kernelSize;
+    }
+    [[nodiscard]] double forwardFlops() const override {
+        const double conv = static_cast<double>(this->getOutputDepth()) * convRows * convCols;
+        return 2.0 * parameterCount() * convRows * convCols + conv
+            + static_cast<double>(this->outputElements()) * poolSize * poolSize;
+    }
+    [[nodiscard]] double backwardFlops() const override {
+        const double conv = static_cast<double>(this->getOutputDepth()) * convRows * convCols;
+        return 4.0 * parameterCount() * convRows * convCols + 2.0 * conv
+            + static_cast<double>(this->outputElements());
+    }
+
+    // Padded input, then the argmax row, column and saved value of each pooled output
+    [[nodiscard]] size_t savedActivationElements() const override {
+        return static_cast<size_t>(this->getInputDepth())
+                * (this->getInputRows() + 2 * padding) * (this->getInputCols() + 2 * padding)
+            + 3 * this->outputElements();
+    }
+
+    // Filters, by output then input channel
+    vector<MatrixD*> parameters() override
+    {
+        vector<MatrixD*> res;
+        for (auto& filter : filters)
+        {
+            for (auto& kernel : filter)
+            {
+                res.push_back(&kernel);
+            }
+        }
+        return res;
+    }
+    vector<MatrixD*> gradients() override
+    {
+        if (accumulatedFilters.size() != filters.size())
+        {
+            accumulatedFilters.assign(filters.size(), vector<MatrixD>(filters[0].size()));
+        }
+        vector<MatrixD*> res;
+        for (auto& filter : accumulatedFilters)
+        {
+            for (auto& kernel : filter)
+            {
+                res.push_back(&kernel);
+            }
+        }
+        return res;
+    }
+
+    // Destructor
+    ~ConvolutionalMaxPoolLayer() override {}
+
+    /**
+     * @brief Inference kernel. Convolves the whole input as one product of the
+     * unfolded input (see im2col) with the filters packed once here, then
+     * activates and pools each feature map.
+    */
+    typename Layer<T>::InferenceKernel compileInference() const override
+    {
+        return [packed = packFilters(filters), kernelSize = kernelSize, stride = stride, padding = padding,
+                convRows = convRows, convCols = convCols, poolSize = poolSize, poolStride = poolStride]
+            (const vector<MatrixD> &input, vector<MatrixD> &output, vector<MatrixD> &scratch)
+        {
+            scratch.resize(2);
+            im2col(input, kernelSize, stride, padding, convRows, convCols, scratch[0]);
+            scratch[1].noalias() = scratch[0] * packed;
+            scratch[1] = scratch[1].unaryExpr(Activation());
+            for (size_t od = 0; od < output.size(); ++od)
+            {
+                const Eigen::Map<const MatrixD> conv(scratch[1].col(od).data(), convRows, convCols);
+                for (int j = 0; j < output[od].cols(); ++j)
+                {
+                    for (int i = 0; i < output[od].rows(); ++i)
+                    {
+                        output[od](i, j) = conv.block(i * poolStride, j * poolStride, poolSize, poolSize).maxCoeff();
+                    }
+                }
+            }
+        };
+    }
+
+    // Free the padded input and what was kept at each pooled maximum
+    void clearActivations() override
+    {
+        Layer<T>::clearActivations();
+        paddedInput.clear();
+        argRows.clear();
+        argCols.clear();
+        saved.clear();
+    }
+
+    /**
+     * @brief Forward pass. Convolves and activates one feature map at a time
+     * into a scratch map, computing each convolution output once even when
+     * pooling windows overlap, then max pools it. Feature maps are computed in
+     * parallel.
+     *
+     * @param input_tensor Input tensor
+     * @return vector<MatrixD> Pooled output tensor
+    */
+    vector<MatrixD> forward(vector<MatrixD> &input_tensor) override
+    {
+        vector<MatrixD> output_tensor;
+        forwardInto(input_tensor, output_tensor);
+        return output_tensor;
+    }
+
+    /**
+     * @brief Forward pass writing into output_tensor, reusing its storage.
+     *
+     * @param input_tensor Input tensor
+     * @param output_tensor Pooled output tensor to overwrite
+    */
+    #pragma GCC push_options
+    #pragma GCC optimize("O3")
+    void forwardInto(vector<MatrixD> &input_tensor, vector<MatrixD> &output_tensor) override
+    {
+        // Assert input tensor dimensions
+        this->assertInputDimensions(input_tensor);
+
+        const int inputDepth = this->getInputDepth();
+        const int outputDepth = this->getOutputDepth();
+        const int outputRows = this->getOutputRows();
+        const int outputCols = this->getOutputCols();
+
+        // Pad the input once, it is reused by every filter and, while training, by backward
+        vector<MatrixD> localPadded;
+        vector<MatrixD> &padded = this->training ? paddedInput : localPadded;
+        padded.resize(inputDepth);
+        for (int channel = 0; channel < inputDepth; ++channel)
+        {
+            if (padding != 0)
+            {
+                padded[channel] = MatrixD::Zero(this->getInputRows() + 2 * padding, this->getInputCols() + 2 * padding);
+                padded[channel].block(padding, padding, this->getInputRows(), this->getInputCols()) = input_tensor[channel];
+            }
+            else
+            {
+                padded[channel] = input_tensor[channel];
+            }
+        }
+
+        // What backward needs at each maximum is only kept while training
+        output_tensor.resize(outputDepth);
+        for (MatrixD &map : output_tensor)
+        {
+            map.resize(outputRows, outputCols);
+        }
+        if (this->training)
+        {
+            argRows.assign(outputDepth, MatrixI(outputRows, outputCols));
+            argCols.assign(outputDepth, MatrixI(outputRows, outputCols));
+            saved.assign(outputDepth, MatrixD(outputRows, outputCols));
+        }
+
+        // Only the convolution outputs some pooling window covers are needed
+        const int usedRows = (outputRows - 1) * poolStride + poolSize;
+        const int usedCols = (outputCols - 1) * poolStride + poolSize;
+        const int prod = usedRows * usedCols * inputDepth * kernelSize * kernelSize;
+
+        #pragma omp parallel for if(outputDepth > _MAX_DEPTH_UNTIL_THREADING && prod >= _MAX_PROD_UNTIL_THREADING)
+        for (int filterIndex = 0; filterIndex < outputDepth; ++filterIndex)
+        {
+            HADO_TRACE_SPAN("ConvolutionalMaxPoolLayer forward channel", "thread");
+            const auto &filter = filters[filterIndex];
+
+            // Pre-activation convolution output, each position computed once
+            MatrixD z(usedRows, usedCols);
+            for (int x = 0; x < usedCols; ++x)
+            {
+                for (int y = 0; y < usedRows; ++y)
+                {
+                    T sum = 0;
+                    for (int channel = 0; channel < inputDepth; ++channel)
+                    {
+                        sum += padded[channel].block(y * stride, x * stride, kernelSize, kernelSize)
+                            .cwiseProduct(filter[channel]).sum();
+                    }
+                    z(y, x) = sum;
+                }
+            }
+            const MatrixD a = z.unaryExpr(Activation());
+
+            // Max pool the activated map, keeping what backward needs at each maximum
+            for (int j = 0; j < outputCols; ++j)
+            {
+                for (int i = 0; i < outputRows; ++i)
+                {
+                    Eigen::Index row, col;
+                    const T best = a.block(i * poolStride, j * poolStride, poolSize, poolSize).maxCoeff(&row, &col);
+                    output_tensor[filterIndex](i, j) = best;
+
+                    if (this->training)
+                    {
+                        const int bestRow = i * poolStride + static_cast<int>(row);
+                        const int bestCol = j * poolStride + static_cast<int>(col);
+                        saved[filterIndex](i, j) = from_output ? best : z(bestRow, bestCol);
+                        argRows[filterIndex](i, j) = bestRow;
+                        argCols[filterIndex](i, j) = bestCol;
+                    }
+                }
+            }
+        }
+    }
+    #pragma GCC pop_options
+
+    /**
+     * @brief Backward pass. Gradient only flows through the convolution outputs
+     * that were selected by the pooling in the last forward pass.
+     *
+     * @param output_gradient Gradient w.r.t. pooled output
+     * @param learning_rate Learning rate
+     * @return vector<MatrixD> Gradient w.r.t. input
+    */
+    vector<MatrixD> backward(vector<MatrixD> &output_gradient, const T learning_rate) override
+    {
+        vector<MatrixD> input_gradient;
+        backwardInto(output_gradient, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    /**
+     * @brief Backward pass writing into input_gradient, reusing its storage.
+     *
+     * @param output_gradient Gradient w.r.t. pooled output
+     * @param input_gradient Gradient w.r.t. input to overwrite
+     * @param learning_rate Learning rate
+    */
+    #pragma GCC push_options
+    #pragma GCC optimize("O3")
+    void backwardInto(vector<MatrixD> &output_gradient, vector<MatrixD> &input_gradient, const T learning_rate) override
+    {
+        // Dimension check
+        this->assertOutputDimensions(output_gradient);
+
+        const int inputDepth = this->getInputDepth();
+        const int outputDepth = this->getOutputDepth();
+
+        vector<MatrixD> padded_gradient(inputDepth, MatrixD::Zero(paddedInput[0].rows(), paddedInput[0].cols()));
+        vector<vector<MatrixD>> filter_gradients(outputDepth, vector<MatrixD>(inputDepth, MatrixD::Zero(kernelSize, kernelSize)));
+        vector<MatrixD> delta(outputDepth);
+        const int prod = this->getOutputRows() * this->getOutputCols() * inputDepth * kernelSize * kernelSize;
+
+        // Filter gradients, each feature map on its own
+        #pragma omp parallel for if(outputDepth > _MAX_DEPTH_UNTIL_THREADING && prod >= _MAX_PROD_UNTIL_THREADING)
+        for (int od = 0; od < outputDepth; ++od)
+        {
+            HADO_TRACE_SPAN("ConvolutionalMaxPoolLayer backward channel", "thread");
+
+            // Gradient w.r.t. the selected pre-activation convolution outputs
+            if constexpr (from_output)
+            {
+                delta[od] = ActivationPrime::from_output(saved[od].array()).matrix().cwiseProduct(output_gradient[od]);
+            }
+            else
+            {
+                delta[od] = saved[od].unaryExpr(ActivationPrime()).cwiseProduct(output_gradient[od]);
+            }
+
+            for (int i = 0; i < this->getOutputRows(); ++i)
+            {
+                for (int j = 0; j < this->getOutputCols(); ++j)
+                {
+                    const int y = argRows[od](i, j) * stride;
+                    const int x = argCols[od](i, j) * stride;
+
+                    for (int id = 0; id < inputDepth; ++id)
+                    {
+                        filter_gradients[od][id] += delta[od](i, j) * paddedInput[id].block(y, x, kernelSize, kernelSize);
+                    }
+                }
+            }
+        }
+
+        // Input gradient, each input channel gathering from every feature map
+        #pragma omp parallel for if(inputDepth > _MAX_DEPTH_UNTIL_THREADING && prod >= _MAX_PROD_UNTIL_THREADING)
+        for (int id = 0; id < inputDepth; ++id)
+        {
+            for (int od = 0; od < outputDepth; ++od)
+            {
+                for (int i = 0; i < this->getOutputRows(); ++i)
+                {
+                    for (int j = 0; j < this->getOutputCols(); ++j)
+                    {
+                        const int y = argRows[od](i, j) * stride;
+                        const int x = argCols[od](i, j) * stride;
+                        padded_gradient[id].block(y, x, kernelSize, kernelSize) += delta[od](i, j) * filters[od][id];
+                    }
+                }
+            }
+        }
+
+        // Update the filters
+        for (int od = 0; od < outputDepth; ++od)
+        {
+            for (int id = 0; id < inputDepth; ++id)
+            {
+                if (this->accumulate)
+                {
+                    accumulatedFilters[od][id] += filter_gradients[od][id];
+                }
+                else
+                {
+                    filters[od][id] -= learning_rate * filter_gradients[od][id];
+                }
+            }
+        }
+
+        // Strip the padding from the gradient
+        input_gradient.resize(inputDepth);
+        for (int id = 0; id < inputDepth; ++id)
+        {
+            input_gradient[id] = padded_gradient[id].block(padding, padding, this->getInputRows(), this->getInputCols());
+        }
+    }
+    #pragma GCC pop_options
+};
+
+}
+
+#endif // CONVOLUTIONAL_MAX_POOL_LAYER_HPP
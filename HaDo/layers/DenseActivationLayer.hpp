@@ -0,0 +1,262 @@
+#ifndef DENSE_ACTIVATION_LAYER_HPP
+#define DENSE_ACTIVATION_LAYER_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/base/ActivationFunctions.hpp"
+#include "HaDo/layers/DenseLayer.hpp"
+#include <memory>
+#include <iostream>
+
+using Eigen::Matrix;
+using std::vector;
+using Eigen::Dynamic;
+using std::unique_ptr;
+
+namespace hado {
+
+/**
+ * @brief Dense layer with the bias add and activation fused in, equivalent to
+ * a DenseLayer followed by an ActivationLayer. Pipelines build it from such a
+ * pair automatically (see LayerVector::fuse).
+ *
+ * @details The activation is applied as the affine result is written, so no
+ * intermediate tensor is passed between layers. Backward keeps the output or
+ * the pre-activation, whichever ActivationPrime needs (see derivative_from_output).
+ *
+ * @tparam Activation Activation function
+ * @tparam ActivationPrime Derivative of activation function
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template<typename Activation, typename ActivationPrime, typename T=float>
+class DenseActivationLayer : public Layer<T> {
+private:
+
+    // Convenience typedef
+    using typename Layer<T>::MatrixD;
+
+    // Weights and bias tensors
+    MatrixD weights;
+    MatrixD bias;
+
+    // Gradients summed over backward calls while accumulating
+    MatrixD accumulated_weights;
+    MatrixD accumulated_bias;
+
+    // Activation output if the derivative works from it, otherwise the pre-activation
+    MatrixD saved;
+
+    // Whether backward evaluates the derivative from the output (else the pre-activation)
+    static constexpr bool from_output = derivative_from_output_v<ActivationPrime, T>;
+
+    // Assert that Activation and ActivationPrime are functions that take a scalar and return a scalar
+    static_assert(
+        std::is_invocable_r_v<T, Activation, T>,
+        "Activation must be a functor that takes a scalar and returns a scalar."
+    );
+    static_assert(
+        std::is_invocable_r_v<T, ActivationPrime, T>,
+        "ActivationPrime must be a functor that takes a scalar and returns a scalar."
+    );
+
+public:
+
+    // Getters
+    MatrixD getWeights() const { return weights; }
+    MatrixD getBias() const { return bias; }
+
+    /**
+     * @brief Construct a new Dense Activation Layer object with random weights and bias.
+     *
+     * @param I rows/nodes in input tensor
+     * @param O rows/nodes in output tensor
+    */
+    DenseActivationLayer(const int I, const int O)
+        : Layer<T>(1, 1, I, 1, O, 1),
+          weights(MatrixD::Random(O, I)), bias(MatrixD::Random(O, 1))
+    {
+        this->inp = vector<MatrixD>(1);
+    }
+
+    /**
+     * @brief Construct from an existing dense layer, taking its weights and bias.
+     *
+     * @param dense Dense layer to fuse the activation into
+    */
+    explicit DenseActivationLayer(const DenseLayer<T>& dense)
+        : Layer<T>(1, 1, dense.getInputRows(), 1, dense.getOutputRows(), 1),
+          weights(dense.getWeights()), bias(dense.getBias())
+    {
+        this->inp = vector<MatrixD>(1);
+    }
+
+    // Copy constructor
+    DenseActivationLayer(const DenseActivationLayer& other)
+        : Layer<T>(other), weights(other.weights), bias(other.bias), saved(other.saved) {}
+
+    // Clone returning unique ptr
+    std::unique_ptr<Layer<T>> clone() const override {
+        return std::make_unique<DenseActivationLayer<Activation, ActivationPrime, T>>(*this);
+    }
+
+    // Cost model, a dense layer plus the activation of its O outputs
+    [[nodiscard]] std::string name() const override { return "DenseActivationLayer"; }
+    [[nodiscard]] size_t parameterCount() const override {
+        return static_cast<size_t>(weights.size() + bias.size());
+    }
+    [[nodiscard]] double forwardFlops() const override {
+        return 2.0 * weights.size() + 2.0 * bias.size();
+    }
+    [[nodiscard]] double backwardFlops() const override {
+        return 3.0 * weights.size() + 2.0 * bias.size();
+    }
+
+    // Weights then bias
+    vector<MatrixD*> parameters() override { return {&weights, &bias}; }
+    vector<MatrixD*> gradients() override { return {&accumulated_weights, &accumulated_bias}; }
+
+    // Destructor
+    ~DenseActivationLayer() override = default;
+
+    /**
+     * @brief Forward pass, Activation(weights * input + bias). Input tensor must
+     * be a size 1 vector of dimensions I x 1.
+     *
+     * @param input_tensor Input tensor (one dimensional, must have right size)
+     * @return vector<MatrixD> Output tensor
+    */
+    vector<MatrixD> forward(vector<MatrixD>& input_tensor) override {
+        vector<MatrixD> output;
+        forwardInto(input_tensor, output);
+        return output;
+    }
+
+    /**
+     * @brief Forward pass writing into output_tensor, reusing its storage. Keeps
+     * the input and the tensor backward needs only while training.
+     *
+     * @param input_tensor Input tensor (one dimensional, must have right size)
+     * @param output_tensor Output tensor to overwrite
+    */
+    #pragma GCC push_options
+    #pragma GCC optimize("O2")
+    void forwardInto(vector<MatrixD>& input_tensor, vector<MatrixD>& output_tensor) override {
+
+        // Validity check
+        this->assertInputDimensions(input_tensor);
+
+        output_tensor.resize(1);
+        if (from_output || !this->training){
+            output_tensor[0].noalias() = weights * input_tensor[0];
+            output_tensor[0] = (output_tensor[0].colwise() + bias.col(0)).unaryExpr(Activation());
+            if (this->training){
+                saved = output_tensor[0];
+            }
+        } else{
+            saved.noalias() = weights * input_tensor[0];
+            saved.colwise() += bias.col(0);
+            output_tensor[0] = saved.unaryExpr(Activation());
+        }
+
+        if (this->training){
+            this->inp[0] = input_tensor[0];
+        }
+    }
+    #pragma GCC pop_options
+
+    // Inference kernel with a copy of the weights and bias
+    typename Layer<T>::InferenceKernel compileInference() const override {
+        return [weights = weights, bias = bias](const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>&){
+            output[0].noalias() = weights * input[0];
+            output[0] = (output[0].colwise() + bias.col(0)).unaryExpr(Activation());
+        };
+    }
+
+    // The kernel is a matrix product, so a batch of columns is one GEMM
+    [[nodiscard]] bool batchesColumns() const override {
+        return true;
+    }
+
+    // Same for training, columns are separate samples
+    [[nodiscard]] bool trainsColumns() const override {
+        return true;
+    }
+
+    // Input and the output (or pre-activation) are kept for backward
+    [[nodiscard]] size_t savedActivationElements() const override {
+        return this->inputElements() + this->outputElements();
+    }
+
+    // The columns of the shared weights that nonzero inputs reach, and the shared bias
+    void pullShared(const vector<MatrixD>& input_tensor) override {
+        this->assertInputDimensions(input_tensor);
+        SharedParameters<T>::loadAffine(*this->shared[0], *this->shared[1], weights, bias, input_tensor[0]);
+    }
+
+    // Backward already updated the shared parameters
+    void pushShared(const T) override {}
+
+    // Free the kept input and output (or pre-activation)
+    void clearActivations() override {
+        Layer<T>::clearActivations();
+        saved.resize(0, 0);
+    }
+
+    /**
+     * @brief Backward pass. Output gradient tensor must be a size 1 vector<MatrixD>
+     * matching O rows.
+     *
+     * @param output_gradient Output gradient tensor (one dimensional, must have right size)
+     * @param learning_rate Learning rate for gradient descent (0 < learning_rate < 1)
+     * @return vector<MatrixD> Input gradient tensor
+    */
+    vector<MatrixD> backward(vector<MatrixD>& output_gradient, const T learning_rate) override {
+        vector<MatrixD> input_gradient;
+        backwardInto(output_gradient, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    /**
+     * @brief Backward pass writing the input gradient into input_gradient,
+     * reusing its storage.
+     *
+     * @param output_gradient Output gradient tensor (one dimensional, must have right size)
+     * @param input_gradient Input gradient tensor to overwrite
+     * @param learning_rate Learning rate for gradient descent (0 < learning_rate < 1)
+    */
+    #pragma GCC push_options
+    #pragma GCC optimize("O2")
+    void backwardInto(vector<MatrixD>& output_gradient, vector<MatrixD>& input_gradient, const T learning_rate) override {
+
+        // Validity check
+        this->assertOutputDimensions(output_gradient);
+
+        // Gradient w.r.t. the pre-activation
+        MatrixD delta;
+        if constexpr (from_output){
+            delta = ActivationPrime::from_output(saved.array()).matrix().cwiseProduct(output_gradient[0]);
+        } else{
+            delta = saved.unaryExpr(ActivationPrime()).cwiseProduct(output_gradient[0]);
+        }
+
+        input_gradient.resize(1);
+        input_gradient[0].noalias() = weights.transpose() * delta;
+
+        // Update the shared, own weights and bias, or keep the gradients for later
+        if (!this->shared.empty()){
+            SharedParameters<T>::subtractAffine(*this->shared[0], *this->shared[1], delta, this->inp[0], learning_rate);
+        } else if (this->accumulate){
+            accumulated_weights.noalias() += delta * this->inp[0].transpose();
+            accumulated_bias += delta.rowwise().sum();
+        } else{
+            weights.noalias() -= learning_rate * delta * this->inp[0].transpose();
+            bias -= learning_rate * delta.rowwise().sum();
+        }
+    }
+    #pragma GCC pop_options
+};
+
+}
+
+#endif // DENSE_ACTIVATION_LAYER_HPP
@@ -36,6 +36,10 @@ private:
     MatrixD weights;
     MatrixD bias;
 
+    // Gradients summed over backward calls while accumulating
+    MatrixD accumulated_weights;
+    MatrixD accumulated_bias;
+
 public:
 
     // Getters
@@ -68,6 +72,7 @@ public:
             this->out = other.out;
             this->I = other.getInputRows();
             this->O = other.getOutputRows();
+            this->training = other.training;
         }
 
     // Clone returning unique ptr
@@ -75,6 +80,23 @@ public:
         return std::make_unique<DenseLayer<T>>(*this);
     }
 
+    // Cost model, I x O weights and O biases
+    [[nodiscard]] std::string name() const override { return "DenseLayer"; }
+    [[nodiscard]] size_t parameterCount() const override {
+        return static_cast<size_t>(weights.size() + bias.size());
+    }
+    [[nodiscard]] double forwardFlops() const override {
+        return 2.0 * weights.size() + bias.size();
+    }
+    [[nodiscard]] double backwardFlops() const override {
+        // Input gradient and weight gradient (outer product)
+        return 3.0 * weights.size();
+    }
+
+    // Weights then bias
+    vector<MatrixD*> parameters() override { return {&weights, &bias}; }
+    vector<MatrixD*> gradients() override { return {&accumulated_weights, &accumulated_bias}; }
+
 
     // Destructor
     ~DenseLayer() override = default;
@@ -87,20 +109,66 @@ public:
      * @return vector<MatrixD> Output tensor
     */
     vector<MatrixD> forward(vector<MatrixD>& input_tensor) override {
+        vector<MatrixD> output;
+        forwardInto(input_tensor, output);
+        return output;
+    }
+
+    /**
+     * @brief Forward pass writing into output_tensor, reusing its storage when it
+     * already has the output dimensions. The input is only kept while training.
+     * 
+     * @param input_tensor Input tensor (one dimensional, must have right size)
+     * @param output_tensor Output tensor to overwrite
+    */
+    void forwardInto(vector<MatrixD>& input_tensor, vector<MatrixD>& output_tensor) override {
 
         // Validity check
         this->assertInputDimensions(input_tensor);
 
-        // Move input tensor into layer attribute inp
-        this->inp = input_tensor;
-
         // Calculate output tensor
-        auto res = (weights * (this->inp[0]) + bias);
+        output_tensor.resize(1);
+        output_tensor[0].noalias() = weights * input_tensor[0];
+        output_tensor[0].colwise() += bias.col(0);
+
+        // Keep input tensor in layer attribute inp for backward
+        if (this->training) {
+            this->inp = input_tensor;
+        }
+    }
+
+    // Inference kernel with a copy of the weights and bias
+    typename Layer<T>::InferenceKernel compileInference() const override {
+        return [weights = weights, bias = bias](const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>&){
+            output[0].noalias() = weights * input[0];
+            output[0].colwise() += bias.col(0);
+        };
+    }
 
-        // Return output tensor
-        return {res}; 
+    // The kernel is a matrix product, so a batch of columns is one GEMM
+    [[nodiscard]] bool batchesColumns() const override {
+        return true;
     }
 
+    // Matrix products and a bias per row, so columns train as separate samples
+    [[nodiscard]] bool trainsColumns() const override {
+        return true;
+    }
+
+    // Only the input is needed for backward
+    [[nodiscard]] size_t savedActivationElements() const override {
+        return this->inputElements();
+    }
+
+    // The columns of the shared weights that nonzero inputs reach, and the shared bias
+    void pullShared(const vector<MatrixD>& input_tensor) override {
+        this->assertInputDimensions(input_tensor);
+        SharedParameters<T>::loadAffine(*this->shared[0], *this->shared[1], weights, bias, input_tensor[0]);
+    }
+
+    // Backward already updated the shared parameters
+    void pushShared(const T) override {}
+
     /**
      * @brief Backward pass of the dense layer. Output gradient tensor (input param) must be a size 1
      * vector<MatrixD> matching O rows.
@@ -110,21 +178,47 @@ public:
      * @return vector<MatrixD> Input gradient tensor
     */
     vector<MatrixD> backward(vector<MatrixD>& output_gradient, const T learning_rate) override {
+        vector<MatrixD> input_gradient;
+        backwardInto(output_gradient, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    /**
+     * @brief Backward pass writing the input gradient into input_gradient,
+     * reusing its storage when it already has the input dimensions.
+     * 
+     * @param output_gradient Output gradient tensor (one dimensional, must have right size)
+     * @param input_gradient Input gradient tensor to overwrite
+     * @param learning_rate Learning rate for gradient descent (0 < learning_rate < 1)
+    */
+    void backwardInto(vector<MatrixD>& output_gradient, vector<MatrixD>& input_gradient, const T learning_rate) override {
 
         // Validity check
         this->assertOutputDimensions(output_gradient);
 
-        // Calculate weight gradient, bias gradient, and input gradient
-        auto weight_gradient = (output_gradient[0]) * (this->inp[0]).transpose();
-        auto bias_gradient = output_gradient[0];
-        auto input_gradient = this->weights.transpose() * (output_gradient[0]);
+        // Input gradient, evaluated now so it uses the weights from before the update
+        input_gradient.resize(1);
+        input_gradient[0].noalias() = this->weights.transpose() * (output_gradient[0]);
 
-        // Update weights and bias
-        this->weights -= learning_rate * weight_gradient;
-        this->bias -= learning_rate * bias_gradient;
+        // Shared parameters are updated only in the columns the input reaches
+        if (!this->shared.empty()) {
+            SharedParameters<T>::subtractAffine(*this->shared[0], *this->shared[1], output_gradient[0],
+                                                this->inp[0], learning_rate);
+            return;
+        }
 
-        // Return input gradient
-        return {input_gradient};
+        // Calculate weight gradient and bias gradient
+        MatrixD weight_gradient = (output_gradient[0]) * (this->inp[0]).transpose();
+        MatrixD bias_gradient = output_gradient[0].rowwise().sum();
+
+        // Update weights and bias, or keep the gradients for later
+        if (this->accumulate) {
+            accumulated_weights += weight_gradient;
+            accumulated_bias += bias_gradient;
+        } else {
+            this->weights -= learning_rate * weight_gradient;
+            this->bias -= learning_rate * bias_gradient;
+        }
     }
 };
 
@@ -4,6 +4,19 @@
 
 namespace hado {
 
+/**
+ * @brief Flattening layer class, reshapes a D x R x C tensor into a 1 x DRC row,
+ * channel after channel in column-major order.
+ * 
+ * @details Flattening is a pure layout change, so nothing is stored for backward.
+ * At depth 1 the channel buffer is moved through and only its shape changes, in
+ * both directions. Deeper tensors keep each channel in its own buffer, so they
+ * are gathered into (and scattered from) the row with a single copy.
+ * 
+ * At depth 1 forward and backward move from their argument, which is left empty.
+ * 
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
 template <typename T = float>
 class FlatteningLayer : public Layer<T>
 {
@@ -19,51 +32,110 @@ public:
         return std::make_unique<FlatteningLayer>(*this);
     }
 
-    #pragma GCC push_options
-    #pragma GCC optimize("O2")
+    // Cost model, only copies
+    [[nodiscard]] std::string name() const override { return "FlatteningLayer"; }
+    [[nodiscard]] double forwardFlops() const override { return 0; }
+    [[nodiscard]] double backwardFlops() const override { return 0; }
+
+    // Inference kernel, copies each channel into its slice of the row
+    typename Layer<T>::InferenceKernel compileInference() const override
+    {
+        const Eigen::Index channel = static_cast<Eigen::Index>(this->getInputRows()) * this->getInputCols();
+        return [channel](const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>&)
+        {
+            for (size_t i = 0; i < input.size(); ++i)
+            {
+                Eigen::Map<MatrixD>(output[0].data() + i * channel, channel, 1)
+                    = Eigen::Map<const MatrixD>(input[i].data(), channel, 1);
+            }
+        };
+    }
+
+    // Nothing is kept for backward
+    [[nodiscard]] size_t savedActivationElements() const override
+    {
+        return 0;
+    }
+
     vector<MatrixD> forward(
         vector<MatrixD> &input_tensor) override
+    {
+        vector<MatrixD> output;
+        forwardInto(input_tensor, output);
+        return output;
+    }
+
+    // Forward into output, whose storage is reused for deeper tensors
+    #pragma GCC push_options
+    #pragma GCC optimize("O2")
+    void forwardInto(
+        vector<MatrixD> &input_tensor, vector<MatrixD> &output) override
     {
         this->assertInputDimensions(input_tensor);
 
-        // Flatten the input tensor
-        MatrixD flattened(this->getInputCols() * this->getInputRows() * this->getInputDepth(), 1);
-        size_t currentRow = 0;
-        for (size_t i = 0; i < input_tensor.size(); ++i)
+        const int depth = this->getInputDepth();
+        const int channel = this->getInputRows() * this->getInputCols();
+
+        output.resize(1);
+        if (depth == 1)
         {
-            Eigen::Map<MatrixD>(
-                flattened.data() + currentRow, this->getInputRows() * this->getInputCols(), 1)
-                    = Eigen::Map<const MatrixD>(input_tensor[i].data(), this->getInputRows() * this->getInputCols(), 1);
-            currentRow += this->getInputRows() * this->getInputCols();
+            // Same buffer, a resize to the same number of elements keeps the data
+            output[0] = std::move(input_tensor[0]);
+            output[0].resize(1, channel);
+            input_tensor.clear();
+        }
+        else
+        {
+            // Gather each channel into its slice of the row
+            output[0].resize(1, depth * channel);
+            for (int i = 0; i < depth; ++i)
+            {
+                Eigen::Map<MatrixD>(output[0].data() + i * channel, channel, 1)
+                    = Eigen::Map<const MatrixD>(input_tensor[i].data(), channel, 1);
+            }
         }
-        this->out.clear();
-        this->out.push_back(flattened.transpose());
-        return this->out;
     }
     #pragma GCC pop_options
 
+    vector<MatrixD> backward(
+        vector<MatrixD> &output_gradient, const T learning_rate) override
+    {
+        vector<MatrixD> input_gradient;
+        backwardInto(output_gradient, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    // Backward into input_gradient, whose storage is reused for deeper tensors
     #pragma GCC diagnostic ignored "-Wunused-parameter"
     #pragma GCC push_options
     #pragma GCC optimize("O2")
-    vector<MatrixD> backward(
-        vector<MatrixD> &output_gradient, const T learning_rate) override
+    void backwardInto(
+        vector<MatrixD> &output_gradient, vector<MatrixD> &input_gradient, const T learning_rate) override
     {
         // For a flattening layer, the backward propagation simply involves reshaping
         // the gradient to match the input tensor's shape. The learning rate is not used
+        this->assertOutputDimensions(output_gradient);
 
-        vector<MatrixD> input_gradient(this->getInputDepth());
-        for (size_t i = 0; i < static_cast<size_t>(this->getInputDepth()); ++i)
-        {
-            input_gradient[i]
-                = Eigen::Map<MatrixD>(
-                    output_gradient[0].data() + i * this->getInputRows() * this->getInputCols()
-                    , this->getInputRows(), this->getInputCols()
-                    );
+        const int depth = this->getInputDepth();
+        const int rows = this->getInputRows();
+        const int cols = this->getInputCols();
 
-            input_gradient[i].transposeInPlace();
+        input_gradient.resize(depth);
+        if (depth == 1)
+        {
+            input_gradient[0] = std::move(output_gradient[0]);
+            input_gradient[0].resize(rows, cols);
+            output_gradient.clear();
+        }
+        else
+        {
+            // Scatter each slice of the row back into its channel
+            for (int i = 0; i < depth; ++i)
+            {
+                input_gradient[i] = Eigen::Map<const MatrixD>(
+                    output_gradient[0].data() + i * rows * cols, rows, cols);
+            }
         }
-
-        return input_gradient;
     }
     #pragma GCC pop_options
 };
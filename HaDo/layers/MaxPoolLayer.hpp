@@ -2,6 +2,7 @@
 #define MAX_POOL_LAYER_HPP
 
 #include "HaDo/base/Layer.hpp"
+#include "HaDo/util/TraceWriter.hpp"
 #include <Eigen/Dense>
 #include <vector>
 #include <memory>
@@ -110,9 +111,44 @@ public:
         return std::make_unique<MaxPoolLayer>(*this);
     }
 
+    // Cost model, one comparison per window element, one scatter per output backward
+    [[nodiscard]] std::string name() const override { return "MaxPoolLayer"; }
+    [[nodiscard]] double forwardFlops() const override {
+        return static_cast<double>(this->outputElements()) * kernelSize * kernelSize;
+    }
+    [[nodiscard]] double backwardFlops() const override {
+        return static_cast<double>(this->outputElements());
+    }
+
     // Destructor
     ~MaxPoolLayer() override {}
 
+    /**
+     * @brief Inference kernel, pools straight from the input (or a padded copy
+     * in scratch) into the output.
+    */
+    typename Layer<T>::InferenceKernel compileInference() const override {
+        return [padding = padding, stride = stride, kernelSize = kernelSize]
+            (const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>& scratch){
+            scratch.resize(1);
+            for (size_t channel = 0; channel < input.size(); channel++){
+                const MatrixD* source = &input[channel];
+                if (padding != 0){
+                    scratch[0].setZero(source->rows() + 2 * padding, source->cols() + 2 * padding);
+                    scratch[0].block(padding, padding, source->rows(), source->cols()) = *source;
+                    source = &scratch[0];
+                }
+
+                MatrixD& pooled = output[channel];
+                for (int j = 0; j < pooled.cols(); j++){
+                    for (int i = 0; i < pooled.rows(); i++){
+                        pooled(i, j) = source->block(i * stride, j * stride, kernelSize, kernelSize).maxCoeff();
+                    }
+                }
+            }
+        };
+    }
+
     /**
      * @brief Forward pass of the max pooling layer.
      * 
@@ -120,18 +156,35 @@ public:
      * @return vector<MatrixD> Output tensor
     */
     virtual vector<MatrixD> forward(vector<MatrixD> &input_tensor) override {
+        vector<MatrixD> output_tensor;
+        forwardInto(input_tensor, output_tensor);
+        return output_tensor;
+    }
+
+    /**
+     * @brief Forward pass writing into output_tensor, reusing its storage.
+     * 
+     * @param input_tensor Input tensor
+     * @param output_tensor Output tensor to overwrite
+    */
+    void forwardInto(vector<MatrixD> &input_tensor, vector<MatrixD> &output_tensor) override {
 
         // Assert input tensor dimensions
         this->assertInputDimensions(input_tensor);
 
-        // Place input tensor in layer attribute
-        this->inp = input_tensor;
+        // Place input tensor in layer attribute, only needed by backward
+        if (this->training){
+            this->inp = input_tensor;
+        }
 
         // Get depth
         const int depth = this->getInputDepth();
 
-        // Initialize output tensor
-        vector<MatrixD> output_tensor(depth);
+        // Initialize output tensor and stored copy, kept only while training
+        output_tensor.resize(depth);
+        if (this->training){
+            this->out.resize(depth);
+        }
 
         // Iterate over input tensor
         #ifdef _OPENMP
@@ -140,12 +193,13 @@ public:
                 omp_set_num_threads(depth);
                 #pragma omp parallel for
                 for (int channel = 0; channel < depth; channel++){
+                    HADO_TRACE_SPAN("MaxPoolLayer forward channel", "thread");
 
                     // Initialize output matrix
                     MatrixD output(this->getOutputRows(), this->getOutputCols());
 
                     // Perform max pool on single matrix
-                    set_max_pool(input_tensor[channel], output, output_tensor[channel], this->out[channel], padding, stride, kernelSize);
+                    set_max_pool(input_tensor[channel], output, output_tensor[channel], this->training ? &this->out[channel] : nullptr, padding, stride, kernelSize);
                 }
             } else{
 
@@ -156,7 +210,7 @@ public:
                     MatrixD output(this->getOutputRows(), this->getOutputCols());
 
                     // Perform max pool on single matrix
-                    set_max_pool(input_tensor[channel], output, output_tensor[channel], this->out[channel], padding, stride, kernelSize);
+                    set_max_pool(input_tensor[channel], output, output_tensor[channel], this->training ? &this->out[channel] : nullptr, padding, stride, kernelSize);
                 }
             }
         #else
@@ -167,11 +221,9 @@ public:
                 MatrixD output(this->getOutputRows(), this->getOutputCols());
 
                 // Perform max pool on single matrix
-                set_max_pool(input_tensor[channel], output, output_tensor[channel], this->out[channel], padding, stride, kernelSize);
+                set_max_pool(input_tensor[channel], output, output_tensor[channel], this->training ? &this->out[channel] : nullptr, padding, stride, kernelSize);
             }
         #endif
-
-        return output_tensor;
     }
 
     /**
@@ -182,6 +234,20 @@ public:
      * @return vector<MatrixD> Input gradient tensor
     */
     virtual vector<MatrixD> backward(vector<MatrixD> &output_gradient, const T learning_rate) override {
+        vector<MatrixD> input_gradient;
+        backwardInto(output_gradient, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    /**
+     * @brief Backward pass writing into input_gradient, reusing its storage.
+     * 
+     * @param output_gradient Output gradient tensor
+     * @param input_gradient Input gradient tensor to overwrite
+     * @param learning_rate Learning rate (no effect here)
+    */
+    #pragma GCC diagnostic ignored "-Wunused-parameter"
+    void backwardInto(vector<MatrixD> &output_gradient, vector<MatrixD> &input_gradient, const T learning_rate) override {
         
         // Dimension check
         this->assertOutputDimensions(output_gradient);
@@ -190,7 +256,7 @@ public:
         const int depth = this->getOutputDepth();
 
         // Initialize input gradient tensor
-        vector<MatrixD> input_gradient(depth);
+        input_gradient.resize(depth);
 
         #ifdef _OPENMP
             #include <omp.h>
@@ -198,6 +264,7 @@ public:
                 omp_set_num_threads(depth);
                 #pragma omp parallel for
                 for (int channel = 0; channel < depth; channel++){
+                    HADO_TRACE_SPAN("MaxPoolLayer backward channel", "thread");
 
                     // For each channel, calculate input gradient matrix and set
                     backwards_max_pool(
@@ -228,8 +295,6 @@ public:
                     padding, stride, kernelSize);
             }
         #endif
-
-        return input_gradient;
     }
 
 private:
@@ -240,7 +305,7 @@ private:
      * @param input Input matrix from user
      * @param output Output matrix as a placeholder
      * @param output_location Where to store the output for return matrix
-     * @param output_copy_location Output copy (in Layer::out)
+     * @param output_copy_location Output copy (in Layer::out), nullptr to keep none
      * @param padding Padding
      * @param stride Stride
      * @param kernelSize Kernel size
@@ -249,7 +314,7 @@ private:
         const MatrixD &input, 
         MatrixD &output, 
         MatrixD &output_location,
-        MatrixD &output_copy_location,
+        MatrixD *output_copy_location,
         const int padding,
         const int stride,
         const int kernelSize){
@@ -282,7 +347,9 @@ private:
 
             // Copy over results
             output_location = output;
-            output_copy_location = output;
+            if (output_copy_location != nullptr){
+                *output_copy_location = output;
+            }
         }
     
     /**
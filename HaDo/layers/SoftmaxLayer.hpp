@@ -18,6 +18,9 @@ namespace hado {
 /**
  * @brief Softmax layer class.
  * 
+ * @details Forward subtracts the maximum input before exponentiating, backward
+ * is O(R) in the number of rows.
+ * 
  * @tparam T Data type (float for speed, double accuracy) (optional)
 */
 template<typename T=float>
@@ -52,6 +55,11 @@ public:
         return std::make_unique<SoftmaxLayer<T>>(*this);
     }
 
+    // Cost model, max, shift, exp, sum and divide forward, dot product and scale backward
+    [[nodiscard]] std::string name() const override { return "SoftmaxLayer"; }
+    [[nodiscard]] double forwardFlops() const override { return 5.0 * rows; }
+    [[nodiscard]] double backwardFlops() const override { return 4.0 * rows; }
+
     // Destructor
     ~SoftmaxLayer() {}
 
@@ -62,23 +70,53 @@ public:
      * @return vector<MatrixD> Output tensor
     */
     virtual vector<MatrixD> forward(vector<MatrixD> &input_tensor) override {
+        vector<MatrixD> output_tensor;
+        forwardInto(input_tensor, output_tensor);
+        return output_tensor;
+    }
+
+    /**
+     * @brief Forward pass writing into output_tensor, reusing its storage.
+     * 
+     * @param input_tensor Input tensor
+     * @param output_tensor Output tensor to overwrite
+    */
+    void forwardInto(vector<MatrixD> &input_tensor, vector<MatrixD> &output_tensor) override {
 
         // Assert that input tensor has the correct dimensions
         this->assertInputDimensions(input_tensor);
 
-        // Create output tensor location
-        vector<MatrixD> output_tensor;
-
-        // Calculate the exponential componentwise of the vector (tensor is vector here)
-        MatrixD exp = input_tensor[0].array().exp();
+        // Calculate the exponential componentwise of the vector (tensor is vector here),
+        // shifted by the maximum so the largest term is exp(0) and nothing overflows
+        output_tensor.resize(1);
+        output_tensor[0] = (input_tensor[0].array() - input_tensor[0].maxCoeff()).exp();
 
         // Normalize the exponential vector
-        output_tensor.push_back(exp / exp.sum());
+        output_tensor[0] /= output_tensor[0].sum();
 
-        // Store output tensor
-        this->out = output_tensor;
+        // Store output tensor for backward
+        if (this->training) {
+            this->out = output_tensor;
+        }
+    }
 
-        return output_tensor;
+    // Inference kernel, the same shifted softmax as forward
+    typename Layer<T>::InferenceKernel compileInference() const override {
+        return [](const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>&){
+            // Per column, so a batch of samples side by side works too
+            output[0] = (input[0].array().rowwise() - input[0].array().colwise().maxCoeff()).exp();
+            const Matrix<T, 1, Dynamic> sums = output[0].colwise().sum();
+            output[0].array().rowwise() /= sums.array();
+        };
+    }
+
+    [[nodiscard]] bool batchesColumns() const override {
+        return true;
+    }
+
+    // Only the output is needed for backward
+    [[nodiscard]] size_t savedActivationElements() const override {
+        return this->outputElements();
     }
 
     /**
@@ -88,16 +126,27 @@ public:
      * @return vector<MatrixD> Gradient tensor of derivatives of loss w.r.t. input
     */
     virtual vector<MatrixD> backward(vector<MatrixD> &grad_tensor, const T learning_rate) override {
+        vector<MatrixD> input_gradient;
+        backwardInto(grad_tensor, input_gradient, learning_rate);
+        return input_gradient;
+    }
+
+    /**
+     * @brief Backward pass writing into input_gradient, reusing its storage.
+     * 
+     * @param grad_tensor Gradient tensor of derivatives of loss w.r.t. output
+     * @param input_gradient Gradient tensor w.r.t. input to overwrite
+    */
+    void backwardInto(vector<MatrixD> &grad_tensor, vector<MatrixD> &input_gradient, const T) override {
 
         // Assert that gradient tensor has the correct dimensions
         this->assertOutputDimensions(grad_tensor);
 
-        // Get the vector of outputs from softmax and replicate to form matrix
-        MatrixD tiled = this->out[0].replicate(1, rows);
-
-        // Calculate product of gradient vector and Jacobian of softmax output,
-        // Which is the derivative of softmax w.r.t the input
-        return {(tiled.cwiseProduct(MatrixD::Identity(rows, rows) - tiled.transpose())) * grad_tensor[0]};
+        // Product of the softmax Jacobian diag(s) - s s^T with the gradient,
+        // s * (g - <s, g>), without forming the R x R Jacobian
+        const MatrixD& s = this->out[0];
+        input_gradient.resize(1);
+        input_gradient[0] = s.cwiseProduct((grad_tensor[0].array() - s.col(0).dot(grad_tensor[0].col(0))).matrix());
     }
 };
 
@@ -0,0 +1,276 @@
+#ifndef DATA_PARALLEL_HPP
+#define DATA_PARALLEL_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/base/EndLayer.hpp"
+#include "LayerVector.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <exception>
+#include <stdexcept>
+#include <iostream>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Synchronous data parallel executor. Runs K replicas of a LayerVector
+ * on their own threads, each on a slice of every minibatch, then sums their
+ * gradients and makes one update of the shared parameters.
+ *
+ * @details Replica 0 is the given LayerVector and holds the parameters. The
+ * other replicas are clones that copy those parameters at the start of each
+ * step. Every replica accumulates gradients (see Layer::setGradientAccumulation).
+ * The gradients are summed into replica 0 in log2(K) rounds of pairwise adds,
+ * and in each round the pairs run on separate threads and each thread reads
+ * only its own two replicas. The update is the mean gradient of the minibatch,
+ * so a step is the same as Pipeline::trainBatch up to summation order and,
+ * for end layers drawing random samples (sampled softmax), up to the draws.
+ * Each end layer clone is reseeded (see EndLayer::reseed), so replicas draw
+ * independently of each other.
+ *
+ * Replicas run as an OpenMP parallel loop. Without OpenMP they run one after
+ * the other, with the same results. Layer loops that use OpenMP inside a
+ * replica run on the replica's thread. Parameters of the end layer (sampled and
+ * hierarchical softmax) are reduced and updated together with the layers.
+ *
+ * The executor works on the layers and end layer it is given, which must
+ * outlive it and not change shape while it exists. They accumulate gradients
+ * only during a step, so they can be trained otherwise between steps, and the
+ * executor kept for many epochs (see Pipeline::trainDataParallel).
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class DataParallel {
+private:
+
+    // Convenience typedef
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+
+    // One replica, its parameters and accumulators, and its error for the step
+    struct Replica {
+        LayerVector<T>* layers;
+        EndLayer<T>* endlayer;
+        vector<MatrixD*> parameters;
+        vector<MatrixD*> gradients;
+        T error = 0;
+    };
+
+    LayerVector<T>& layers;
+    EndLayer<T>* endlayer;
+
+    // Clones for replicas 1 to K - 1
+    vector<unique_ptr<LayerVector<T>>> layer_clones;
+    vector<unique_ptr<EndLayer<T>>> end_clones;
+
+    vector<Replica> replicas;
+
+    /**
+     * @brief Run replica r on its slice of the minibatch, after copying in the
+     * shared parameters.
+    */
+    void runReplica(const int r, vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                    const vector<size_t>& indices, const size_t begin, const size_t end) {
+        HADO_TRACE_SPAN("replica " + std::to_string(r), "replica");
+        Replica& replica = replicas[r];
+        if (r != 0) {
+            for (size_t p = 0; p < replica.parameters.size(); p++) {
+                *replica.parameters[p] = *replicas[0].parameters[p];
+            }
+        }
+
+        replica.error = 0;
+        for (size_t i = begin; i < end; i++) {
+            const size_t sample = indices[i];
+            auto x = replica.layers->forward(inputs[sample]);
+            replica.error += replica.endlayer->forward(x, true_results[sample]);
+            auto grad = replica.endlayer->backward(x, true_results[sample], 0);
+            replica.layers->backward(grad, 0);
+        }
+    }
+
+    // Parameters and accumulators of the layers followed by those of the end layer
+    static vector<MatrixD*> allParameters(LayerVector<T>& layers, EndLayer<T>& endlayer) {
+        vector<MatrixD*> res = layers.parameters();
+        for (MatrixD* param : endlayer.parameters()) {
+            res.push_back(param);
+        }
+        return res;
+    }
+    static vector<MatrixD*> allGradients(LayerVector<T>& layers, EndLayer<T>& endlayer) {
+        vector<MatrixD*> res = layers.gradients();
+        for (MatrixD* grad : endlayer.gradients()) {
+            res.push_back(grad);
+        }
+        return res;
+    }
+
+    // Switch accumulation of replica 0, zeroing its accumulators
+    void accumulateShared(const bool enabled) {
+        layers.setGradientAccumulation(enabled);
+        endlayer->setGradientAccumulation(enabled);
+    }
+
+    // Sum the gradients of every replica into replica 0, zeroing the others
+    void reduce() {
+        HADO_TRACE_SPAN("reduce", "replica");
+        const int K = static_cast<int>(replicas.size());
+        for (int stride = 1; stride < K; stride *= 2) {
+            #ifdef _OPENMP
+                #pragma omp parallel for num_threads(K) schedule(static, 1)
+            #endif
+            for (int r = 0; r < K - stride; r += 2 * stride) {
+                Replica& into = replicas[r];
+                Replica& from = replicas[r + stride];
+                for (size_t p = 0; p < into.gradients.size(); p++) {
+                    *into.gradients[p] += *from.gradients[p];
+                    from.gradients[p]->setZero();
+                }
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief Construct the executor, cloning the layers and end layer for
+     * replicas 1 to K - 1.
+     *
+     * @param layers Layers to train, replica 0
+     * @param endlayer End layer computing the error
+     * @param replicas Number of replicas (threads)
+     * @param seed Seed the end layer clones are reseeded from (optional)
+    */
+    DataParallel(LayerVector<T>& layers, EndLayer<T>* endlayer, const int replicas,
+                 const unsigned seed = std::random_device{}())
+        : layers(layers), endlayer(endlayer) {
+        if (endlayer == nullptr) {
+            throw std::invalid_argument("Training needs an end layer.");
+        }
+        if (replicas < 1) {
+            std::cerr << "Need at least 1 replica, got " << replicas << std::endl;
+            throw std::invalid_argument("Invalid number of replicas.");
+        }
+
+        this->replicas.push_back({&layers, endlayer, allParameters(layers, *endlayer), allGradients(layers, *endlayer)});
+        std::seed_seq sequence{seed};
+        vector<unsigned> seeds(replicas);
+        sequence.generate(seeds.begin(), seeds.end());
+        for (int r = 1; r < replicas; r++) {
+            layer_clones.push_back(layers.clone());
+            end_clones.push_back(endlayer->clone());
+            end_clones.back()->reseed(seeds[r]);
+            LayerVector<T>& clone = *layer_clones.back();
+            EndLayer<T>& end_clone = *end_clones.back();
+            clone.setGradientAccumulation(true);
+            end_clone.setGradientAccumulation(true);
+            this->replicas.push_back({&clone, &end_clone, allParameters(clone, end_clone), allGradients(clone, end_clone)});
+        }
+    }
+
+    DataParallel(const DataParallel&) = delete;
+    DataParallel& operator=(const DataParallel&) = delete;
+
+    [[nodiscard]] int getReplicaCount() const { return static_cast<int>(replicas.size()); }
+
+    /**
+     * @brief One training step on a minibatch, split evenly across the replicas.
+     *
+     * @param inputs Input tensor of each sample of the data set
+     * @param true_results Expected result of each sample of the data set
+     * @param indices Samples of the minibatch, as indices into inputs
+     * @param learning_rate Learning rate
+     * @return T Sum of the errors of the minibatch
+    */
+    T trainBatch(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                 const vector<size_t>& indices, const T learning_rate) {
+        if (indices.empty()) {
+            return 0;
+        }
+        HADO_TRACE_SPAN("data parallel step", "train");
+
+        const int K = static_cast<int>(replicas.size());
+        const size_t B = indices.size();
+        vector<std::exception_ptr> errors(K);
+        accumulateShared(true);
+
+        #ifdef _OPENMP
+            #pragma omp parallel for num_threads(K) schedule(static, 1)
+        #endif
+        for (int r = 0; r < K; r++) {
+            try {
+                runReplica(r, inputs, true_results, indices, r * B / K, (r + 1) * B / K);
+            } catch (...) {
+                errors[r] = std::current_exception();
+            }
+        }
+
+        for (int r = 0; r < K; r++) {
+            if (errors[r]) {
+                // Drop the gradients of the failed step
+                for (int other = 1; other < K; other++) {
+                    replicas[other].layers->setGradientAccumulation(true);
+                    replicas[other].endlayer->setGradientAccumulation(true);
+                }
+                accumulateShared(false);
+                std::rethrow_exception(errors[r]);
+            }
+        }
+
+        reduce();
+        const T scale = T(1) / static_cast<T>(B);
+        layers.applyGradients(learning_rate, scale);
+        endlayer->applyGradients(learning_rate, scale);
+        accumulateShared(false);
+
+        T total = 0;
+        for (const Replica& replica : replicas) {
+            total += replica.error;
+        }
+        return total;
+    }
+
+    /**
+     * @brief One pass over the samples in the given order, one step per minibatch.
+     *
+     * @param inputs Input tensor of each sample of the data set
+     * @param true_results Expected result of each sample of the data set
+     * @param order Samples to train on, in order
+     * @param batch_size Samples per step, the last step may have fewer
+     * @param learning_rate Learning rate
+     * @return T Sum of the errors of all samples
+    */
+    T train(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+            const vector<size_t>& order, const int batch_size, const T learning_rate) {
+        if (inputs.size() != true_results.size()) {
+            throw std::invalid_argument("Need one true result per input.");
+        }
+        if (batch_size < 1) {
+            std::cerr << "Batch size must be at least 1." << std::endl;
+            throw std::invalid_argument("Invalid batch size.");
+        }
+
+        T total = 0;
+        vector<size_t> batch;
+        batch.reserve(batch_size);
+        for (size_t start = 0; start < order.size(); start += batch_size) {
+            const size_t end = std::min(order.size(), start + static_cast<size_t>(batch_size));
+            batch.assign(order.begin() + start, order.begin() + end);
+            total += trainBatch(inputs, true_results, batch, learning_rate);
+        }
+        return total;
+    }
+};
+
+}
+
+#endif // DATA_PARALLEL_HPP
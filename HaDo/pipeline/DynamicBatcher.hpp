@@ -0,0 +1,307 @@
+#ifndef DYNAMIC_BATCHER_HPP
+#define DYNAMIC_BATCHER_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "InferencePlan.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include <memory>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <coroutine>
+#include <stop_token>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Coalesces concurrent single-sample predictions into batches.
+ *
+ * @details Callers of predict() block while a worker thread gathers their
+ * requests. A batch is run as soon as it holds max_batch requests, or once its
+ * oldest request has waited max_latency, through InferencePlan::predictBatch,
+ * so a plan of dense layers does one matrix product per layer for the whole
+ * batch instead of one matrix-vector product per request. Results are handed
+ * back to each caller.
+ *
+ * If a batch fails (e.g. one input has the wrong dimensions), its requests
+ * are rerun one by one so only the bad ones get the error.
+ *
+ * predictAsync() is the same for coroutines: awaiting it suspends the caller
+ * instead of blocking its thread, and the worker resumes it once its batch
+ * has run.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class DynamicBatcher {
+private:
+
+    // Convenience typedefs
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+    typedef std::chrono::steady_clock Clock;
+
+    // One pending prediction, owned by the waiting caller or coroutine
+    struct Request {
+        const vector<MatrixD>* input;
+        vector<MatrixD> result;
+        std::exception_ptr error;
+        Clock::time_point arrival;
+        std::stop_token stop;
+        std::coroutine_handle<> continuation;
+        bool done = false;
+    };
+
+    // Plan shared with other users
+    std::shared_ptr<const InferencePlan<T>> plan;
+
+    // Batching limits
+    int max_batch;
+    std::chrono::microseconds max_latency;
+
+    // Queue of requests and the conditions the worker and callers wait on
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::condition_variable finished;
+    std::deque<Request*> queue;
+    bool stopping = false;
+
+    // Counters, under the mutex
+    size_t batch_count = 0;
+    size_t request_count = 0;
+
+    // Workspace of the worker
+    typename InferencePlan<T>::Workspace workspace;
+
+    std::thread worker;
+
+    // Run one batch without the lock held
+    void runBatch(const vector<Request*>& batch) {
+        HADO_TRACE_SPAN("batch of " + std::to_string(batch.size()), "batch");
+        vector<vector<MatrixD>> inputs;
+        inputs.reserve(batch.size());
+        for (Request* request : batch) {
+            inputs.push_back(*request->input);
+        }
+
+        try {
+            vector<vector<MatrixD>> results = plan->predictBatch(inputs, workspace);
+            for (size_t i = 0; i < batch.size(); i++) {
+                batch[i]->result = std::move(results[i]);
+            }
+        } catch (...) {
+            for (Request* request : batch) {
+                try {
+                    request->result = plan->predict(*request->input, workspace);
+                } catch (...) {
+                    request->error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    // Worker loop, drains the queue before stopping
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            arrived.wait(lock, [&]{ return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+
+            // Wait for a full batch, at most until the oldest request is due
+            const Clock::time_point deadline = queue.front()->arrival + max_latency;
+            arrived.wait_until(lock, deadline, [&]{
+                return stopping || queue.size() >= static_cast<size_t>(max_batch);
+            });
+
+            // Requests cancelled while queued are answered without running
+            vector<Request*> taken, batch;
+            while (!queue.empty() && batch.size() < static_cast<size_t>(max_batch)) {
+                Request* request = queue.front();
+                queue.pop_front();
+                taken.push_back(request);
+                if (request->stop.stop_requested()) {
+                    request->error = std::make_exception_ptr(std::runtime_error("Prediction cancelled."));
+                } else {
+                    batch.push_back(request);
+                }
+            }
+
+            lock.unlock();
+            if (!batch.empty()) {
+                runBatch(batch);
+            }
+            lock.lock();
+
+            // A blocked caller may return as soon as done is set, so take the
+            // continuations first
+            vector<std::coroutine_handle<>> continuations;
+            for (Request* request : taken) {
+                if (request->continuation) {
+                    continuations.push_back(request->continuation);
+                }
+                request->done = true;
+            }
+            if (!batch.empty()) {
+                batch_count++;
+                request_count += batch.size();
+            }
+            finished.notify_all();
+
+            lock.unlock();
+            for (auto continuation : continuations) {
+                continuation.resume();
+            }
+            lock.lock();
+        }
+    }
+
+    // Queue a request, false (with the error set) if the batcher is stopping
+    bool enqueue(Request& request) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            request.error = std::make_exception_ptr(std::runtime_error("DynamicBatcher is stopping."));
+            return false;
+        }
+        request.arrival = Clock::now();
+        queue.push_back(&request);
+        arrived.notify_one();
+        return true;
+    }
+
+public:
+
+    /**
+     * @brief Awaitable prediction from predictAsync(). Keeps its own copy of
+     * the input while suspended.
+    */
+    class PredictAwaitable {
+    private:
+        DynamicBatcher* batcher;
+        vector<MatrixD> input;
+        Request request;
+
+    public:
+        PredictAwaitable(DynamicBatcher* batcher, vector<MatrixD> input, std::stop_token stop)
+            : batcher(batcher), input(std::move(input)) {
+            request.stop = std::move(stop);
+        }
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+        // Suspend until the batch has run, or not at all if the batcher is stopping
+        bool await_suspend(std::coroutine_handle<> handle) {
+            request.input = &input;
+            request.continuation = handle;
+            return batcher->enqueue(request);
+        }
+
+        vector<MatrixD> await_resume() {
+            if (request.error) {
+                std::rethrow_exception(request.error);
+            }
+            return std::move(request.result);
+        }
+    };
+
+    /**
+     * @brief Construct a batcher over a shared plan and start its worker.
+     *
+     * @param plan Frozen plan, shared and never modified
+     * @param max_batch Largest batch run at once (optional)
+     * @param max_latency Longest a request waits for others to join its batch (optional)
+    */
+    explicit DynamicBatcher(std::shared_ptr<const InferencePlan<T>> plan, const int max_batch = 32,
+                            const std::chrono::microseconds max_latency = std::chrono::microseconds(1000))
+        : plan(std::move(plan)), max_batch(max_batch), max_latency(max_latency)
+    {
+        if (!this->plan) {
+            throw std::invalid_argument("DynamicBatcher needs a plan.");
+        }
+        if (max_batch <= 0 || max_latency.count() < 0) {
+            throw std::invalid_argument("Batch size must be positive and latency not negative.");
+        }
+        workspace = this->plan->makeWorkspace();
+        worker = std::thread([this]{ run(); });
+    }
+
+    // Not copyable, the worker refers to this
+    DynamicBatcher(const DynamicBatcher&) = delete;
+    DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+    // Finishes the requests already queued, then stops the worker
+    ~DynamicBatcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            arrived.notify_all();
+        }
+        worker.join();
+    }
+
+    // Getters
+    [[nodiscard]] int getMaxBatch() const { return max_batch; }
+    [[nodiscard]] std::chrono::microseconds getMaxLatency() const { return max_latency; }
+    [[nodiscard]] std::shared_ptr<const InferencePlan<T>> getPlan() const { return plan; }
+
+    // Batches run so far, and the requests in them
+    [[nodiscard]] size_t getBatchCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return batch_count;
+    }
+    [[nodiscard]] size_t getRequestCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return request_count;
+    }
+
+    /**
+     * @brief Predict one input as part of a batch. Safe to call from several
+     * threads at once, blocks until the batch has run.
+     *
+     * @param input Input tensor
+     * @param stop Cancels the prediction if stop is requested before its batch runs (optional)
+     * @return vector<MatrixD> Result
+    */
+    vector<MatrixD> predict(const vector<MatrixD>& input, std::stop_token stop = {}) {
+        Request request;
+        request.input = &input;
+        request.stop = std::move(stop);
+
+        if (enqueue(request)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]{ return request.done; });
+        }
+        if (request.error) {
+            std::rethrow_exception(request.error);
+        }
+        return std::move(request.result);
+    }
+
+    /**
+     * @brief Predict one input from a coroutine, as part of a batch.
+     * co_await the result: the coroutine is suspended without blocking its
+     * thread and resumed on the batcher's worker once the batch has run, so
+     * it should hand longer work back to its own executor. A cancelled
+     * prediction throws std::runtime_error from co_await.
+     *
+     * @param input Input tensor, copied
+     * @param stop Cancels the prediction if stop is requested before its batch runs (optional)
+     * @return PredictAwaitable Awaitable giving the result
+    */
+    PredictAwaitable predictAsync(vector<MatrixD> input, std::stop_token stop = {}) {
+        return PredictAwaitable(this, std::move(input), std::move(stop));
+    }
+};
+
+}
+
+#endif // DYNAMIC_BATCHER_HPP
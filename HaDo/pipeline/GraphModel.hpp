@@ -0,0 +1,455 @@
+#ifndef GRAPH_MODEL_HPP
+#define GRAPH_MODEL_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/base/EndLayer.hpp"
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+using std::unique_ptr;
+
+namespace hado {
+
+/**
+ * @brief Model over a directed acyclic graph of layers, for residual
+ * connections and parallel branches that a LayerVector cannot express.
+ *
+ * @details Nodes are inputs, layers (one input each), and merge nodes that
+ * add tensors of the same dimensions or concatenate them along depth. Nodes
+ * are added after their inputs, so the order of addition is topological, and
+ * each node gets a level one past its deepest input. Forward runs the nodes of
+ * a level concurrently with OpenMP, and backward runs the levels in reverse,
+ * summing the gradients of nodes whose output feeds several others.
+ *
+ * Any node can be an output, optionally with an end layer for training.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class GraphModel {
+private:
+
+    // Convenience typedef
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+
+    // Assert that T is either float, double, or long double at compiler time
+    static_assert(
+        std::is_same_v<T, float>
+        || std::is_same_v<T, double>
+        || std::is_same_v<T, long double>,
+        "T must be either float, double, or long double."
+    );
+
+    enum class NodeType { Input, Layer, Add, Concat };
+
+    // Node of the graph and the dimensions of its output
+    struct Node {
+        NodeType type;
+        unique_ptr<Layer<T>> layer;
+        vector<int> inputs;
+        int depth;
+        int rows;
+        int cols;
+        int level;
+    };
+
+    vector<Node> nodes;
+
+    // Input and output nodes in the order they were added, and the end layer of each output
+    vector<int> inputs;
+    vector<int> outputs;
+    vector<unique_ptr<EndLayer<T>>> endlayers;
+
+    // Nodes of each level, and how many nodes read each node's output
+    vector<vector<int>> levels;
+    vector<int> consumers;
+
+    // Output of each node from the last forward pass
+    vector<vector<MatrixD>> values;
+
+    // Check a node index refers to an existing node
+    void assertNode(const int node) const {
+        if (node < 0 || node >= static_cast<int>(nodes.size())) {
+            std::cerr << "Node " << node << " does not exist, the graph has " << nodes.size() << " nodes" << endl;
+            throw std::invalid_argument("Node does not exist.");
+        }
+    }
+
+    // Add a node reading from existing nodes, returning its index
+    int addNode(const NodeType type, unique_ptr<Layer<T>> layer, const vector<int>& from,
+                const int depth, const int rows, const int cols) {
+        int level = 0;
+        for (const int input : from) {
+            level = std::max(level, nodes[input].level + 1);
+            consumers[input]++;
+        }
+
+        const int index = static_cast<int>(nodes.size());
+        nodes.push_back({type, std::move(layer), from, depth, rows, cols, level});
+        consumers.push_back(0);
+        if (static_cast<int>(levels.size()) <= level) {
+            levels.resize(level + 1);
+        }
+        levels[level].push_back(index);
+        return index;
+    }
+
+    // Output of one node from the outputs of its inputs
+    vector<MatrixD> forwardNode(const int index) {
+        Node& node = nodes[index];
+        switch (node.type) {
+            case NodeType::Layer: {
+                // Layers may consume their input, so only hand it over if nothing else reads it
+                const int input = node.inputs[0];
+                if (consumers[input] == 1 && std::find(outputs.begin(), outputs.end(), input) == outputs.end()) {
+                    return node.layer->forward(values[input]);
+                }
+                vector<MatrixD> copy = values[input];
+                return node.layer->forward(copy);
+            }
+            case NodeType::Add: {
+                vector<MatrixD> sum = values[node.inputs[0]];
+                for (size_t i = 1; i < node.inputs.size(); i++) {
+                    for (int d = 0; d < node.depth; d++) {
+                        sum[d] += values[node.inputs[i]][d];
+                    }
+                }
+                return sum;
+            }
+            case NodeType::Concat: {
+                vector<MatrixD> joined;
+                joined.reserve(node.depth);
+                for (const int input : node.inputs) {
+                    joined.insert(joined.end(), values[input].begin(), values[input].end());
+                }
+                return joined;
+            }
+            default:
+                return values[index];
+        }
+    }
+
+    // Gradients w.r.t. the inputs of one node, from the gradient w.r.t. its output
+    vector<vector<MatrixD>> backwardNode(const int index, vector<MatrixD>& gradient, const T learning_rate) {
+        Node& node = nodes[index];
+        switch (node.type) {
+            case NodeType::Layer:
+                return {node.layer->backward(gradient, learning_rate)};
+            case NodeType::Add:
+                return vector<vector<MatrixD>>(node.inputs.size(), gradient);
+            case NodeType::Concat: {
+                vector<vector<MatrixD>> split;
+                auto it = gradient.begin();
+                for (const int input : node.inputs) {
+                    split.emplace_back(it, it + nodes[input].depth);
+                    it += nodes[input].depth;
+                }
+                return split;
+            }
+            default:
+                return {};
+        }
+    }
+
+    // Run fn on every node of a level, concurrently when there are several
+    template <typename Function>
+    void forEachInLevel(const vector<int>& level, Function fn) {
+        const int count = static_cast<int>(level.size());
+        #ifdef _OPENMP
+            #pragma omp parallel for if(count > 1)
+            for (int i = 0; i < count; i++) {
+                fn(level[i]);
+            }
+        #else
+            for (int i = 0; i < count; i++) {
+                fn(level[i]);
+            }
+        #endif
+    }
+
+public:
+
+    // Default constructor
+    GraphModel() = default;
+
+    // Copy constructor
+    GraphModel(const GraphModel& other)
+        : inputs(other.inputs), outputs(other.outputs), levels(other.levels),
+          consumers(other.consumers), values(other.values)
+    {
+        for (const Node& node : other.nodes) {
+            nodes.push_back({node.type, node.layer ? node.layer->clone() : nullptr, node.inputs,
+                             node.depth, node.rows, node.cols, node.level});
+        }
+        for (const auto& end : other.endlayers) {
+            endlayers.push_back(end ? end->clone() : nullptr);
+        }
+    }
+
+    // Destructor
+    ~GraphModel() = default;
+
+    // Getters
+    [[nodiscard]] int getNodeCount() const { return static_cast<int>(nodes.size()); }
+    [[nodiscard]] int getLevelCount() const { return static_cast<int>(levels.size()); }
+    [[nodiscard]] int getDepth(const int node) const { assertNode(node); return nodes[node].depth; }
+    [[nodiscard]] int getRows(const int node) const { assertNode(node); return nodes[node].rows; }
+    [[nodiscard]] int getCols(const int node) const { assertNode(node); return nodes[node].cols; }
+
+    /**
+     * @brief Add an input to the graph. Inputs are passed to forward in the
+     * order they were added.
+     *
+     * @param depth Depth of the input tensor
+     * @param rows Rows of the input tensor
+     * @param cols Columns of the input tensor
+     * @return int Index of the node
+    */
+    int addInput(const int depth, const int rows, const int cols) {
+        if (depth <= 0 || rows <= 0 || cols <= 0) {
+            throw std::invalid_argument("Input dimensions must be positive.");
+        }
+        const int index = addNode(NodeType::Input, nullptr, {}, depth, rows, cols);
+        inputs.push_back(index);
+        return index;
+    }
+
+    /**
+     * @brief Add a layer reading the output of a node.
+     *
+     * @tparam LayerType type of layer (not base), i.e. DenseLayer
+     * @param layer Layer to add
+     * @param input Node the layer reads from, dimensions must match the layer's input
+     * @return int Index of the node
+    */
+    template <typename LayerType>
+    int addLayer(const LayerType& layer, const int input) {
+        static_assert(std::is_base_of<Layer<T>, LayerType>::value,
+                  "LayerType must derive from Layer<T>");
+        assertNode(input);
+
+        const Node& from = nodes[input];
+        if (from.depth != layer.getInputDepth() || from.rows != layer.getInputRows() || from.cols != layer.getInputCols()) {
+            cout << "Output of node " << input << " is " << from.depth << "x" << from.rows << "x" << from.cols
+                << " but layer expects " << layer.getInputDepth() << "x" << layer.getInputRows()
+                << "x" << layer.getInputCols() << endl;
+            throw std::invalid_argument("Layer dimensions must match previous layer dimensions.");
+        }
+
+        return addNode(NodeType::Layer, std::make_unique<LayerType>(layer), {input},
+                       layer.getOutputDepth(), layer.getOutputRows(), layer.getOutputCols());
+    }
+
+    /**
+     * @brief Add a node summing the outputs of several nodes, e.g. a residual
+     * connection.
+     *
+     * @param from Nodes to add, at least two, all of the same dimensions
+     * @return int Index of the node
+    */
+    int addAdd(const vector<int>& from) {
+        if (from.size() < 2) {
+            throw std::invalid_argument("Add needs at least two inputs.");
+        }
+        for (const int input : from) {
+            assertNode(input);
+            if (nodes[input].depth != nodes[from[0]].depth || nodes[input].rows != nodes[from[0]].rows
+                || nodes[input].cols != nodes[from[0]].cols) {
+                throw std::invalid_argument("Inputs to add must have the same dimensions.");
+            }
+        }
+        const Node& first = nodes[from[0]];
+        return addNode(NodeType::Add, nullptr, from, first.depth, first.rows, first.cols);
+    }
+
+    /**
+     * @brief Add a node concatenating the outputs of several nodes along depth,
+     * e.g. parallel branches.
+     *
+     * @param from Nodes to concatenate in order, at least two, all with the same rows and columns
+     * @return int Index of the node
+    */
+    int addConcat(const vector<int>& from) {
+        if (from.size() < 2) {
+            throw std::invalid_argument("Concat needs at least two inputs.");
+        }
+        int depth = 0;
+        for (const int input : from) {
+            assertNode(input);
+            if (nodes[input].rows != nodes[from[0]].rows || nodes[input].cols != nodes[from[0]].cols) {
+                throw std::invalid_argument("Inputs to concat must have the same rows and columns.");
+            }
+            depth += nodes[input].depth;
+        }
+        return addNode(NodeType::Concat, nullptr, from, depth, nodes[from[0]].rows, nodes[from[0]].cols);
+    }
+
+    /**
+     * @brief Mark a node as an output, without an end layer. It is returned by
+     * forward and gets no gradient from trainGraph.
+     *
+     * @param node Node to output
+    */
+    void addOutput(const int node) {
+        assertNode(node);
+        outputs.push_back(node);
+        endlayers.push_back(nullptr);
+    }
+
+    /**
+     * @brief Mark a node as an output with an end layer for training.
+     *
+     * @tparam EndLayerType type of error function deriving EndLayer
+     * @param node Node to output
+     * @param end Error function, dimensions must match the node
+    */
+    template <typename EndLayerType>
+    void addOutput(const int node, const EndLayerType& end) {
+        assertNode(node);
+        if (nodes[node].depth != end.getDepth() || nodes[node].rows != end.getRows() || nodes[node].cols != end.getCols()) {
+            throw std::invalid_argument("End layer dimensions must match the output node.");
+        }
+        outputs.push_back(node);
+        endlayers.push_back(std::make_unique<EndLayerType>(end));
+    }
+
+    /**
+     * @brief Forward pass through the graph, running independent nodes of a
+     * level concurrently.
+     *
+     * @param input_tensors One tensor per input node, in the order they were added
+     * @return vector<vector<MatrixD>> One tensor per output node
+    */
+    vector<vector<MatrixD>> forward(const vector<vector<MatrixD>>& input_tensors) {
+        if (input_tensors.size() != inputs.size()) {
+            throw std::invalid_argument("Need one tensor per input node.");
+        }
+
+        values.assign(nodes.size(), {});
+        for (size_t i = 0; i < inputs.size(); i++) {
+            const Node& node = nodes[inputs[i]];
+            if (input_tensors[i].size() != static_cast<size_t>(node.depth)
+                || input_tensors[i][0].rows() != node.rows || input_tensors[i][0].cols() != node.cols) {
+                cout << "Input " << i << " must be " << node.depth << "x" << node.rows << "x" << node.cols << endl;
+                throw std::invalid_argument("Input tensor has incorrect dimensions.");
+            }
+            values[inputs[i]] = input_tensors[i];
+        }
+
+        for (const vector<int>& level : levels) {
+            forEachInLevel(level, [&](const int index) {
+                if (nodes[index].type != NodeType::Input) {
+                    values[index] = forwardNode(index);
+                }
+            });
+        }
+
+        vector<vector<MatrixD>> res;
+        res.reserve(outputs.size());
+        for (const int output : outputs) {
+            res.push_back(values[output]);
+        }
+        return res;
+    }
+
+    /**
+     * @brief Backward pass from the gradients w.r.t. the outputs. Gradients of a
+     * node read by several others are summed before going through it.
+     *
+     * @param output_gradients One gradient per output node, empty for none
+     * @param learning_rate Learning rate of model
+     * @return vector<vector<MatrixD>> Gradient w.r.t. each input node, empty if none reaches it
+    */
+    vector<vector<MatrixD>> backward(const vector<vector<MatrixD>>& output_gradients, const T learning_rate) {
+        if (output_gradients.size() != outputs.size()) {
+            throw std::invalid_argument("Need one gradient per output node.");
+        }
+
+        // Gradient w.r.t. the output of each node, summed over everything reading it
+        vector<vector<MatrixD>> gradients(nodes.size());
+        auto accumulate = [&](const int node, vector<MatrixD> gradient) {
+            if (gradients[node].empty()) {
+                gradients[node] = std::move(gradient);
+                return;
+            }
+            for (size_t d = 0; d < gradient.size(); d++) {
+                gradients[node][d] += gradient[d];
+            }
+        };
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (!output_gradients[i].empty()) {
+                accumulate(outputs[i], output_gradients[i]);
+            }
+        }
+
+        for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+
+            // Nodes of a level run concurrently, their gradients are summed after
+            vector<vector<vector<MatrixD>>> results(level->size());
+            vector<int> positions(nodes.size());
+            for (size_t i = 0; i < level->size(); i++) {
+                positions[(*level)[i]] = static_cast<int>(i);
+            }
+            forEachInLevel(*level, [&](const int index) {
+                if (!gradients[index].empty() && nodes[index].type != NodeType::Input) {
+                    results[positions[index]] = backwardNode(index, gradients[index], learning_rate);
+                }
+            });
+
+            for (size_t i = 0; i < level->size(); i++) {
+                const Node& node = nodes[(*level)[i]];
+                for (size_t j = 0; j < results[i].size(); j++) {
+                    accumulate(node.inputs[j], std::move(results[i][j]));
+                }
+            }
+        }
+
+        vector<vector<MatrixD>> res;
+        res.reserve(inputs.size());
+        for (const int input : inputs) {
+            res.push_back(std::move(gradients[input]));
+        }
+        return res;
+    }
+
+    /**
+     * @brief Train the graph with a forward and backward pass.
+     *
+     * @param input_tensors One tensor per input node
+     * @param true_results Expected result of each output node (ignored for outputs without an end layer)
+     * @param learning_rate Learning rate for model
+     * @return T Sum of the errors of the outputs with end layers
+    */
+    T trainGraph(const vector<vector<MatrixD>>& input_tensors, vector<vector<MatrixD>>& true_results,
+                 const T learning_rate) {
+        if (true_results.size() != outputs.size()) {
+            throw std::invalid_argument("Need one true result per output node.");
+        }
+
+        auto res = forward(input_tensors);
+
+        T error = 0;
+        vector<vector<MatrixD>> output_gradients(outputs.size());
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (endlayers[i]) {
+                error += endlayers[i]->forward(res[i], true_results[i]);
+                output_gradients[i] = endlayers[i]->backward(res[i], true_results[i], learning_rate);
+            }
+        }
+
+        backward(output_gradients, learning_rate);
+        return error;
+    }
+};
+
+}
+
+#endif // GRAPH_MODEL_HPP
@@ -0,0 +1,170 @@
+#ifndef HOGWILD_HPP
+#define HOGWILD_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/base/EndLayer.hpp"
+#include "LayerVector.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include <memory>
+#include <string>
+#include <exception>
+#include <stdexcept>
+#include <iostream>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Asynchronous lock-free SGD (Hogwild). Worker threads each train on
+ * their own shard of the samples and update the shared parameters after
+ * every sample without any locking.
+ *
+ * @details The shared parameters are those of the given LayerVector. Each
+ * worker runs a clone of the layers that shares them (see
+ * LayerVector::shareParameters): before each layer's forward it copies in
+ * the shared parameters that forward reads, and backward subtracts
+ * learning_rate times its gradient from the shared parameters directly. Dense
+ * and DenseActivation layers read and update only the weight columns that
+ * nonzero inputs reach, so a sparse input costs O(outputs * nonzeros) in the
+ * first layer rather than a pass over all of its weights. Other layers copy
+ * in all of their parameters and push every nonzero gradient entry. The
+ * clones keep a private copy of the parameters for the Eigen kernels, as
+ * reading the shared weights in place would need atomic loads inside them.
+ *
+ * Races are allowed by design, see SharedParameters: a worker may read a mix
+ * of old and new values, and concurrent updates of one element may lose one
+ * of them. Columns a sample does not reach keep older values in the worker's
+ * copy, which only affects the input gradient of that layer at inputs that
+ * are zero. Like Hogwild, this converges when updates are sparse or small
+ * compared to the weights. Results depend on thread timing.
+ *
+ * Workers run as an OpenMP parallel loop. Without OpenMP the shards run one
+ * after the other, which is plain per-sample SGD. End layers with parameters
+ * (sampled and hierarchical softmax) are rejected, as their clones would
+ * train a private projection.
+ *
+ * The executor works on the layers it is given, which must outlive it and
+ * not change shape while it exists, so it can be kept for many epochs (see
+ * Pipeline::trainHogwild).
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class Hogwild {
+private:
+
+    // Convenience typedef
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+
+    // One worker, its layers sharing the parameters and its error
+    struct Worker {
+        unique_ptr<LayerVector<T>> layers;
+        unique_ptr<EndLayer<T>> endlayer;
+        T error = 0;
+    };
+
+    vector<Worker> workers;
+
+    // Train worker w on the samples order[begin, end)
+    void runWorker(const int w, vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                   const vector<size_t>& order, const size_t begin, const size_t end, const T learning_rate) {
+        HADO_TRACE_SPAN("hogwild worker " + std::to_string(w), "replica");
+        Worker& worker = workers[w];
+        worker.error = 0;
+        for (size_t i = begin; i < end; i++) {
+            const size_t sample = order[i];
+            auto x = worker.layers->forward(inputs[sample]);
+            worker.error += worker.endlayer->forward(x, true_results[sample]);
+            auto grad = worker.endlayer->backward(x, true_results[sample], 0);
+            worker.layers->backward(grad, learning_rate);
+        }
+    }
+
+public:
+
+    /**
+     * @brief Construct the executor.
+     *
+     * @param layers Layers holding the shared parameters
+     * @param endlayer End layer computing the error
+     * @param threads Number of worker threads
+    */
+    Hogwild(LayerVector<T>& layers, EndLayer<T>* endlayer, const int threads) {
+        if (endlayer == nullptr) {
+            throw std::invalid_argument("Training needs an end layer.");
+        }
+        if (endlayer->hasParameters()) {
+            std::cerr << "Hogwild does not train end layers with parameters, use data parallel replicas." << std::endl;
+            throw std::invalid_argument("End layer has parameters.");
+        }
+        if (threads < 1) {
+            std::cerr << "Need at least 1 thread, got " << threads << std::endl;
+            throw std::invalid_argument("Invalid number of threads.");
+        }
+
+        for (int w = 0; w < threads; w++) {
+            Worker worker;
+            worker.layers = layers.clone();
+            worker.endlayer = endlayer->clone();
+            worker.layers->shareParameters(&layers);
+            workers.push_back(std::move(worker));
+        }
+    }
+
+    Hogwild(const Hogwild&) = delete;
+    Hogwild& operator=(const Hogwild&) = delete;
+
+    [[nodiscard]] int getThreadCount() const { return static_cast<int>(workers.size()); }
+
+    /**
+     * @brief One pass over the samples, split into a contiguous shard per worker.
+     *
+     * @param inputs Input tensor of each sample of the data set
+     * @param true_results Expected result of each sample of the data set
+     * @param order Samples to train on, as indices into inputs
+     * @param learning_rate Learning rate
+     * @return T Sum of the errors of all samples
+    */
+    T train(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+            const vector<size_t>& order, const T learning_rate) {
+        if (inputs.size() != true_results.size()) {
+            throw std::invalid_argument("Need one true result per input.");
+        }
+
+        const int K = static_cast<int>(workers.size());
+        const size_t n = order.size();
+        vector<std::exception_ptr> errors(K);
+
+        #ifdef _OPENMP
+            #pragma omp parallel for num_threads(K) schedule(static, 1)
+        #endif
+        for (int w = 0; w < K; w++) {
+            try {
+                runWorker(w, inputs, true_results, order, w * n / K, (w + 1) * n / K, learning_rate);
+            } catch (...) {
+                errors[w] = std::current_exception();
+            }
+        }
+
+        for (int w = 0; w < K; w++) {
+            if (errors[w]) {
+                std::rethrow_exception(errors[w]);
+            }
+        }
+
+        T total = 0;
+        for (const Worker& worker : workers) {
+            total += worker.error;
+        }
+        return total;
+    }
+};
+
+}
+
+#endif // HOGWILD_HPP
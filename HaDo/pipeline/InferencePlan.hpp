@@ -0,0 +1,263 @@
+#ifndef INFERENCE_PLAN_HPP
+#define INFERENCE_PLAN_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/layers/SoftmaxLayer.hpp"
+#include "LayerVector.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Immutable inference plan compiled from a pipeline (see Pipeline::freeze).
+ *
+ * @details Each layer is compiled once into a kernel holding its own copy of
+ * the parameters, packed for that kernel (e.g. convolution filters for im2col).
+ * Shapes are checked once when compiling, so a prediction only checks the
+ * input and then runs the kernels in order, with no virtual calls, copies of
+ * the input or allocations. Buffers live in a Workspace, pre-sized by
+ * makeWorkspace() and reused across calls. The plan is not affected by later
+ * training of the pipeline it came from.
+ *
+ * predict() is const, so threads can share a plan with one workspace each.
+ * A layer without a kernel of its own runs a clone of the layer behind a lock.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class InferencePlan {
+private:
+
+    // Convenience typedefs
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+    typedef typename Layer<T>::InferenceKernel Kernel;
+
+    // Kernel and output dimensions of one step
+    struct Step {
+        std::string name;
+        Kernel kernel;
+        int depth;
+        int rows;
+        int cols;
+        bool batched;
+    };
+
+    // Input dimensions
+    int entry_depth = 0;
+    int entry_rows = 0;
+    int entry_cols = 0;
+
+    // Steps in execution order
+    vector<Step> steps;
+
+    // Add a step for a layer, whose input must match the last output
+    void addLayer(const Layer<T>& layer) {
+        const int depth = steps.empty() ? entry_depth : steps.back().depth;
+        const int rows = steps.empty() ? entry_rows : steps.back().rows;
+        const int cols = steps.empty() ? entry_cols : steps.back().cols;
+        if (layer.getInputDepth() != depth || layer.getInputRows() != rows || layer.getInputCols() != cols) {
+            std::cerr << "Layer " << steps.size() << " expects input " << layer.getInputDepth() << "x"
+                << layer.getInputRows() << "x" << layer.getInputCols() << " but gets "
+                << depth << "x" << rows << "x" << cols << endl;
+            throw std::invalid_argument("Layer dimensions must match previous layer dimensions.");
+        }
+
+        Kernel kernel = layer.compileInference();
+        bool batched = layer.batchesColumns() && depth == 1 && cols == 1
+            && layer.getOutputDepth() == 1 && layer.getOutputCols() == 1;
+        if (!kernel) {
+            batched = false;
+
+            // Fall back to a private clone, forward is not safe to run concurrently
+            std::shared_ptr<Layer<T>> clone = layer.clone();
+            clone->setTraining(false);
+            auto lock = std::make_shared<std::mutex>();
+            kernel = [clone, lock](const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>&) {
+                std::lock_guard<std::mutex> guard(*lock);
+                vector<MatrixD> copy = input;
+                clone->forwardInto(copy, output);
+            };
+        }
+
+        steps.push_back({layer.name(), std::move(kernel), layer.getOutputDepth(), layer.getOutputRows(), layer.getOutputCols(), batched});
+    }
+
+    // Run the kernel of step i into its activation, traced if tracing is on
+    void runStep(const size_t i, const vector<MatrixD>& input, vector<MatrixD>& output, vector<MatrixD>& scratch) const {
+        #ifndef HADO_NO_TRACING
+            if (TraceWriter::global().isEnabled()) {
+                TraceSpan span(steps[i].name, "inference");
+                steps[i].kernel(input, output, scratch);
+                return;
+            }
+        #endif
+        steps[i].kernel(input, output, scratch);
+    }
+
+    // Check an input against the first layer
+    void assertInput(const vector<MatrixD>& input) const {
+        if (input.size() != static_cast<size_t>(entry_depth)
+            || input[0].rows() != entry_rows || input[0].cols() != entry_cols) {
+            std::cerr << "Expected input " << entry_depth << "x" << entry_rows << "x" << entry_cols
+                << ", got " << input.size() << "x" << (input.empty() ? 0 : input[0].rows())
+                << "x" << (input.empty() ? 0 : input[0].cols()) << endl;
+            throw std::invalid_argument("Input tensor has incorrect dimensions.");
+        }
+    }
+
+public:
+
+    /**
+     * @brief Buffers for running a plan, one per thread. Activations hold the
+     * output of each step, scratch is private to each step's kernel.
+    */
+    struct Workspace {
+        vector<vector<MatrixD>> activations;
+        vector<vector<MatrixD>> scratch;
+    };
+
+    /**
+     * @brief Compile the layers of a layer vector.
+     *
+     * @param layers Layers to compile, at least one
+     * @param softmax_output Apply softmax to the result, for a softmax fused into the end layer (optional)
+    */
+    explicit InferencePlan(const LayerVector<T>& layers, const bool softmax_output = false) {
+        if (layers.getLayerCount() == 0) {
+            throw std::invalid_argument("Cannot compile an empty pipeline.");
+        }
+
+        const Layer<T>& first = layers.getLayer(0);
+        entry_depth = first.getInputDepth();
+        entry_rows = first.getInputRows();
+        entry_cols = first.getInputCols();
+
+        for (int i = 0; i < layers.getLayerCount(); i++) {
+            addLayer(layers.getLayer(i));
+        }
+        if (softmax_output) {
+            addLayer(SoftmaxLayer<T>(steps.back().rows));
+        }
+    }
+
+    // Getters
+    [[nodiscard]] int getStepCount() const { return static_cast<int>(steps.size()); }
+    [[nodiscard]] bool isColumnBatched() const {
+        return std::all_of(steps.begin(), steps.end(), [](const Step& step) { return step.batched; });
+    }
+    [[nodiscard]] int getOutputDepth() const { return steps.back().depth; }
+    [[nodiscard]] int getOutputRows() const { return steps.back().rows; }
+    [[nodiscard]] int getOutputCols() const { return steps.back().cols; }
+
+    /**
+     * @brief Allocate a workspace with every activation at its final size.
+    */
+    Workspace makeWorkspace() const {
+        Workspace workspace;
+        workspace.activations.reserve(steps.size());
+        for (const Step& step : steps) {
+            workspace.activations.emplace_back(step.depth, MatrixD(step.rows, step.cols));
+        }
+        workspace.scratch.resize(steps.size());
+        return workspace;
+    }
+
+    /**
+     * @brief Run an input through the plan.
+     *
+     * @param input Input tensor, must match the first layer
+     * @param workspace Workspace from makeWorkspace(), not shared between threads
+     * @return const vector<MatrixD>& Result, stored in the workspace until its next use
+    */
+    #pragma GCC push_options
+    #pragma GCC optimize("O2")
+    const vector<MatrixD>& predict(const vector<MatrixD>& input, Workspace& workspace) const {
+        assertInput(input);
+        if (workspace.activations.size() != steps.size()) {
+            workspace = makeWorkspace();
+        }
+
+        const vector<MatrixD>* current = &input;
+        for (size_t i = 0; i < steps.size(); i++) {
+            runStep(i, *current, workspace.activations[i], workspace.scratch[i]);
+            current = &workspace.activations[i];
+        }
+        return *current;
+    }
+    #pragma GCC pop_options
+
+    /**
+     * @brief Run an input through the plan with a workspace of its own. Prefer
+     * the workspace overload when predicting repeatedly.
+     *
+     * @param input Input tensor, must match the first layer
+     * @return vector<MatrixD> Result
+    */
+    vector<MatrixD> predict(const vector<MatrixD>& input) const {
+        Workspace workspace = makeWorkspace();
+        return predict(input, workspace);
+    }
+
+    /**
+     * @brief Run a batch of inputs through the plan. If every step batches
+     * columns (see isColumnBatched), the samples go through side by side as
+     * the columns of one matrix, so dense layers do one matrix product for the
+     * whole batch. Otherwise the samples run one after the other.
+     *
+     * @param inputs Input tensor of each sample, each must match the first layer
+     * @param workspace Workspace from makeWorkspace(), not shared between threads
+     * @return vector<vector<MatrixD>> Result of each sample
+    */
+    #pragma GCC push_options
+    #pragma GCC optimize("O2")
+    vector<vector<MatrixD>> predictBatch(const vector<vector<MatrixD>>& inputs, Workspace& workspace) const {
+        const int count = static_cast<int>(inputs.size());
+        vector<vector<MatrixD>> results(count);
+        if (count == 0) {
+            return results;
+        }
+        if (!isColumnBatched()) {
+            for (int i = 0; i < count; i++) {
+                results[i] = predict(inputs[i], workspace);
+            }
+            return results;
+        }
+
+        vector<MatrixD> batch(1, MatrixD(entry_rows, count));
+        for (int i = 0; i < count; i++) {
+            assertInput(inputs[i]);
+            batch[0].col(i) = inputs[i][0];
+        }
+        if (workspace.activations.size() != steps.size()) {
+            workspace = makeWorkspace();
+        }
+
+        // Kernels resize the activations to the batch width
+        const vector<MatrixD>* current = &batch;
+        for (size_t i = 0; i < steps.size(); i++) {
+            runStep(i, *current, workspace.activations[i], workspace.scratch[i]);
+            current = &workspace.activations[i];
+        }
+
+        for (int i = 0; i < count; i++) {
+            results[i] = {(*current)[0].col(i)};
+        }
+        return results;
+    }
+    #pragma GCC pop_options
+};
+
+}
+
+#endif // INFERENCE_PLAN_HPP
@@ -0,0 +1,419 @@
+#ifndef INFERENCE_SERVER_HPP
+#define INFERENCE_SERVER_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "InferencePlan.hpp"
+#include "DynamicBatcher.hpp"
+#include <memory>
+#include <list>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Framing of tensors over a stream socket, shared by InferenceServer
+ * and InferenceClient.
+ *
+ * @details A tensor is sent as three uint32 (depth, rows, cols) followed by
+ * depth * rows * cols values of T, matrix by matrix, each in Eigen's column
+ * major order. A request is one tensor. A response is a uint32 status, then
+ * the result tensor if the status is 0, or else a uint32 length and an error
+ * message of that many bytes. Integers are in host byte order, as both ends
+ * are on the same machine.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class TensorStream {
+private:
+
+    // Convenience typedef
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+
+public:
+
+    // Largest tensor and depth accepted, guard against a bad header
+    static constexpr uint64_t MAX_ELEMENTS = uint64_t(1) << 28;
+    static constexpr uint64_t MAX_DEPTH = uint64_t(1) << 16;
+
+    // Read exactly size bytes, false if the stream ended first
+    static bool readAll(const int fd, void* data, size_t size) {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            const ssize_t got = ::read(fd, bytes, size);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                return false;
+            }
+            bytes += got;
+            size -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    // Write exactly size bytes, false if the peer is gone
+    static bool writeAll(const int fd, const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            const ssize_t put = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (put < 0 && errno == EINTR) {
+                continue;
+            }
+            if (put <= 0) {
+                return false;
+            }
+            bytes += put;
+            size -= static_cast<size_t>(put);
+        }
+        return true;
+    }
+
+    static bool writeTensor(const int fd, const vector<MatrixD>& tensor) {
+        const uint32_t header[3] = {
+            static_cast<uint32_t>(tensor.size()),
+            static_cast<uint32_t>(tensor.empty() ? 0 : tensor[0].rows()),
+            static_cast<uint32_t>(tensor.empty() ? 0 : tensor[0].cols())
+        };
+        if (!writeAll(fd, header, sizeof(header))) {
+            return false;
+        }
+        for (const MatrixD& m : tensor) {
+            if (!writeAll(fd, m.data(), sizeof(T) * m.size())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Read a tensor, throws on a header over MAX_DEPTH or MAX_ELEMENTS. Each
+     * dimension counts as at least 1, so a zero one cannot hide a huge other
+     * one (the matrices are allocated even when there are no values).
+    */
+    static bool readTensor(const int fd, vector<MatrixD>& tensor) {
+        uint32_t header[3];
+        if (!readAll(fd, header, sizeof(header))) {
+            return false;
+        }
+        const uint64_t depth = std::max<uint64_t>(header[0], 1);
+        const uint64_t rows = std::max<uint64_t>(header[1], 1);
+        const uint64_t cols = std::max<uint64_t>(header[2], 1);
+        if (depth > MAX_DEPTH || depth * rows * cols > MAX_ELEMENTS) {
+            throw std::length_error("Tensor too large.");
+        }
+        tensor.assign(header[0], MatrixD(header[1], header[2]));
+        for (MatrixD& m : tensor) {
+            if (!readAll(fd, m.data(), sizeof(T) * m.size())) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Inference server on a Unix domain socket, batching concurrent
+ * requests with a DynamicBatcher.
+ *
+ * @details Each connection is served by its own thread and sends requests one
+ * after the other (see TensorStream for the framing), so concurrent requests
+ * come from concurrent connections. The socket file is created by start() and
+ * removed by stop().
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class InferenceServer {
+private:
+
+    // Convenience typedefs
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+    typedef TensorStream<T> Stream;
+
+    DynamicBatcher<T> batcher;
+    std::string path;
+
+    // Listening socket and accept thread
+    int listen_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread acceptor;
+
+    // Thread and socket of one connection, the socket is -1 once closed
+    struct Connection {
+        std::thread thread;
+        int fd;
+        bool finished = false;
+    };
+
+    // Open connections and finished ones not joined yet, in a list so
+    // entries stay put while their threads run
+    std::mutex connections_mutex;
+    std::list<Connection> connections;
+
+    // Join the threads of finished connections, with connections_mutex held
+    void reap() {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->finished) {
+                it->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Answer the requests of one connection until it closes, then close it
+    void serve(Connection& connection) {
+        const int fd = connection.fd;
+        try {
+            vector<MatrixD> input;
+            while (Stream::readTensor(fd, input)) {
+                uint32_t status = 0;
+                vector<MatrixD> result;
+                std::string message;
+                try {
+                    result = batcher.predict(input);
+                } catch (const std::exception& e) {
+                    status = 1;
+                    message = e.what();
+                }
+
+                bool sent = Stream::writeAll(fd, &status, sizeof(status));
+                if (status == 0) {
+                    sent = sent && Stream::writeTensor(fd, result);
+                } else {
+                    const uint32_t length = static_cast<uint32_t>(message.size());
+                    sent = sent && Stream::writeAll(fd, &length, sizeof(length))
+                        && Stream::writeAll(fd, message.data(), message.size());
+                }
+                if (!sent) {
+                    break;
+                }
+            }
+        } catch (const std::exception&) {
+            // Bad framing, drop the connection
+        }
+
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        ::close(fd);
+        connection.fd = -1;
+        connection.finished = true;
+    }
+
+    void acceptLoop() {
+        while (running) {
+            const int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            if (!running) {
+                ::close(fd);
+                return;
+            }
+            reap();
+            Connection& connection = connections.emplace_back();
+            connection.fd = fd;
+            connection.thread = std::thread([this, &connection]{ serve(connection); });
+        }
+    }
+
+public:
+
+    /**
+     * @brief Construct a server, not listening until start().
+     *
+     * @param plan Frozen plan to serve (see Pipeline::freeze)
+     * @param path Path of the socket file
+     * @param max_batch Largest batch run at once (optional)
+     * @param max_latency Longest a request waits for others to join its batch (optional)
+    */
+    InferenceServer(std::shared_ptr<const InferencePlan<T>> plan, std::string path, const int max_batch = 32,
+                    const std::chrono::microseconds max_latency = std::chrono::microseconds(1000))
+        : batcher(std::move(plan), max_batch, max_latency), path(std::move(path)) {}
+
+    InferenceServer(const InferenceServer&) = delete;
+    InferenceServer& operator=(const InferenceServer&) = delete;
+
+    ~InferenceServer() {
+        stop();
+    }
+
+    // Getters
+    [[nodiscard]] const std::string& getPath() const { return path; }
+    [[nodiscard]] bool isRunning() const { return running; }
+    [[nodiscard]] DynamicBatcher<T>& getBatcher() { return batcher; }
+
+    // Connections still open, joining the threads of finished ones
+    [[nodiscard]] size_t getConnectionCount() {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        reap();
+        return connections.size();
+    }
+
+    /**
+     * @brief Bind the socket, replacing a stale socket file, and start accepting.
+    */
+    void start() {
+        if (running) {
+            return;
+        }
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path too long.");
+        }
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        ::unlink(path.c_str());
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+            || ::listen(listen_fd, SOMAXCONN) < 0) {
+            const std::string error = std::strerror(errno);
+            ::close(listen_fd);
+            listen_fd = -1;
+            throw std::runtime_error("Cannot listen on " + path + ": " + error);
+        }
+
+        running = true;
+        acceptor = std::thread([this]{ acceptLoop(); });
+    }
+
+    /**
+     * @brief Stop accepting, close every connection and remove the socket file.
+    */
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+
+        ::shutdown(listen_fd, SHUT_RDWR);
+        acceptor.join();
+        ::close(listen_fd);
+        listen_fd = -1;
+
+        // Each connection closes its own socket once its thread sees the shutdown
+        std::list<Connection> finishing;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            for (const Connection& connection : connections) {
+                if (connection.fd >= 0) {
+                    ::shutdown(connection.fd, SHUT_RDWR);
+                }
+            }
+            finishing.splice(finishing.end(), connections);
+        }
+        for (Connection& connection : finishing) {
+            connection.thread.join();
+        }
+        ::unlink(path.c_str());
+    }
+};
+
+/**
+ * @brief Client of an InferenceServer, one connection sending one request at
+ * a time. Use one client per thread for concurrent requests.
+ *
+ * @tparam T Data type, must match the server (optional)
+*/
+template <typename T=float>
+class InferenceClient {
+private:
+
+    // Convenience typedefs
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+    typedef TensorStream<T> Stream;
+
+    int fd = -1;
+
+public:
+
+    /**
+     * @brief Connect to a server.
+     *
+     * @param path Path of the server's socket file
+    */
+    explicit InferenceClient(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path too long.");
+        }
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            const std::string error = std::strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            throw std::runtime_error("Cannot connect to " + path + ": " + error);
+        }
+    }
+
+    InferenceClient(const InferenceClient&) = delete;
+    InferenceClient& operator=(const InferenceClient&) = delete;
+
+    ~InferenceClient() {
+        ::close(fd);
+    }
+
+    /**
+     * @brief Send one input and wait for its result.
+     *
+     * @param input Input tensor
+     * @return vector<MatrixD> Result
+    */
+    vector<MatrixD> predict(const vector<MatrixD>& input) {
+        uint32_t status;
+        if (!Stream::writeTensor(fd, input) || !Stream::readAll(fd, &status, sizeof(status))) {
+            throw std::runtime_error("Connection to the inference server lost.");
+        }
+
+        if (status == 0) {
+            vector<MatrixD> result;
+            if (!Stream::readTensor(fd, result)) {
+                throw std::runtime_error("Connection to the inference server lost.");
+            }
+            return result;
+        }
+
+        uint32_t length;
+        std::string message;
+        if (Stream::readAll(fd, &length, sizeof(length))) {
+            message.resize(length);
+            Stream::readAll(fd, message.data(), length);
+        }
+        throw std::invalid_argument("Inference server: " + message);
+    }
+};
+
+}
+
+#endif // INFERENCE_SERVER_HPP
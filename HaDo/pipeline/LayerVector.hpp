@@ -5,7 +5,11 @@
 #include <vector>
 #include "HaDo/base/Layer.hpp"
 #include "HaDo/base/EndLayer.hpp"
+#include "MemoryPlanner.hpp"
+#include "HaDo/util/Profiler.hpp"
+#include "HaDo/util/TraceWriter.hpp"
 #include <memory>
+#include <cmath>
 #include <type_traits>
 
 using Eigen::Matrix;
@@ -48,6 +52,134 @@ private:
     // List of pointers to layers, using type erasure
     vector<unique_ptr<Layer<T>>> layers;
 
+    // Buffer plan for inference and the buffers it assigns activations to,
+    // planned on first use after the layers change
+    MemoryPlan inference_plan;
+    vector<vector<MatrixD>> inference_buffers;
+
+    // Buffer plan for training and the buffers it assigns activations and
+    // gradients to, planned on first use after the layers or segments change
+    MemoryPlan training_plan;
+    vector<vector<MatrixD>> training_buffers;
+
+    // Layers per checkpointed segment, 0 keeps every activation and -1 picks
+    // about sqrt(layers) when training
+    int checkpoint_segment = 0;
+
+    // Segment length used by the last forward, and the input of each
+    // checkpointed segment kept from forward to backward
+    size_t checkpointed_length = 0;
+    vector<vector<MatrixD>> checkpoints;
+
+    // Per-layer timings, off unless enabled
+    Profiler profiler;
+
+    // Whether forward and backward take a batch of samples as columns, see setColumnBatch
+    bool column_batch = false;
+
+    // Layers per segment for the current number of layers, 0 if not checkpointing
+    [[nodiscard]] size_t segmentLength() const {
+        if (checkpoint_segment == 0) {
+            return 0;
+        }
+        const size_t length = checkpoint_segment > 0 ? static_cast<size_t>(checkpoint_segment)
+            : static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(layers.size()))));
+        return length < layers.size() ? length : 0;
+    }
+
+    // Assert input tensor matches container input dimensions
+    void assertEntryDimensions(const vector<MatrixD>& input) const {
+        if (input.size() != (size_t) this->entry_depth 
+            || input[0].rows() != this->entry_rows 
+            || (input[0].cols() != this->entry_cols && !column_batch)) {
+                cout << "Input tensor must have depth " << entry_depth 
+                    << " but got depth " << input.size() << endl;
+
+                cout << "Input tensor must have rows " << entry_rows 
+                    << " but got rows " << input[0].rows() << endl;
+
+                cout << "Input tensor must have cols " << entry_cols 
+                    << " but got cols " << input[0].cols() << endl;
+                throw std::invalid_argument("Input tensor has incorrect dimensions." );
+        }
+    }
+
+    // Drop the memory plans and profile after the layers change
+    void resetPlan() {
+        inference_plan = MemoryPlan();
+        inference_buffers.clear();
+        training_plan = MemoryPlan();
+        training_buffers.clear();
+        profiler.reset();
+    }
+
+    // Plan the training buffers if the layers or segments changed since the last pass
+    void ensureTrainingPlan() {
+        if (training_plan.assignment.empty()) {
+            training_plan = planMemory(true, true);
+            training_buffers.assign(training_plan.buffers.size(), vector<MatrixD>());
+        }
+    }
+
+    // Planned buffer of the activation after layer i - 1 (the input of layer i)
+    vector<MatrixD>& activationBuffer(const size_t i) {
+        return training_buffers[training_plan.assignment[i]];
+    }
+
+    // Planned buffer of the gradient w.r.t. the input of layer i
+    vector<MatrixD>& gradientBuffer(const size_t i) {
+        return training_buffers[training_plan.assignment[layers.size() + 1 + i]];
+    }
+
+    // Run one call of layer i writing output, recorded by the profiler and traced if they are enabled
+    template<typename Call>
+    void profiled(const size_t i, const Profiler::Direction direction, const vector<MatrixD>& output, Call call) {
+        #ifndef HADO_NO_TRACING
+            if (TraceWriter::global().isEnabled()) {
+                TraceSpan span(layers[i]->name() + (direction == Profiler::FORWARD ? " forward" : " backward"), "layer");
+                timed(i, direction, output, call);
+                return;
+            }
+        #endif
+        timed(i, direction, output, call);
+    }
+
+    // Run one call of layer i writing output, recorded by the profiler if it is enabled
+    template<typename Call>
+    void timed(const size_t i, const Profiler::Direction direction, const vector<MatrixD>& output, Call call) {
+        #ifndef HADO_NO_PROFILING
+            if (profiler.isEnabled()) {
+                const Profiler::Clock::time_point start = Profiler::Clock::now();
+                call();
+                size_t bytes = 0;
+                for (const MatrixD& m : output) {
+                    bytes += static_cast<size_t>(m.size()) * sizeof(T);
+                }
+                profiler.record(i, layers[i]->name(), direction, start, bytes);
+                return;
+            }
+        #endif
+        call();
+    }
+
+    // Forward of layer i into output, after copying in the shared parameters it reads if sharing
+    void forwardLayer(const size_t i, vector<MatrixD>& input, vector<MatrixD>& output) {
+        if (layers[i]->isSharingParameters()) {
+            layers[i]->pullShared(input);
+        }
+        profiled(i, Profiler::FORWARD, output, [&]{ layers[i]->forwardInto(input, output); });
+    }
+
+    // Backward of layer i into input_gradient, then the update of the shared parameters if sharing
+    void backwardLayer(const size_t i, vector<MatrixD>& output_gradient, vector<MatrixD>& input_gradient,
+                       const T learning_rate) {
+        profiled(i, Profiler::BACKWARD, input_gradient,
+            [&]{ layers[i]->backwardInto(output_gradient, input_gradient, learning_rate); });
+        if (layers[i]->isSharingParameters()) {
+            layers[i]->pushShared(learning_rate);
+        }
+    }
+
     /**
      * @brief Push a layer onto the empty container
      * 
@@ -72,6 +204,278 @@ public:
     int getFinalDepth() { return final_depth; }
     int getFinalRows() { return final_rows; }
     int getFinalCols() { return final_cols; }
+    int getLayerCount() const { return static_cast<int>(layers.size()); }
+    const Layer<T>& getLayer(const int i) const { return *layers[i]; }
+
+    // Per-layer timings of forward and backward, see Profiler
+    Profiler& getProfiler() { return profiler; }
+    void setProfiling(const bool enabled) { profiler.enable(enabled); }
+    Layer<T>& getLayer(const int i) { return *layers[i]; }
+
+    // Last layer in the container, must not be empty
+    Layer<T>& back() { return *layers.back(); }
+
+    /**
+     * @brief Remove the last layer. The container output becomes the output of
+     * the layer before it, so there must be at least two layers.
+    */
+    void popLayer() {
+        if (layers.size() < 2) {
+            throw std::invalid_argument("Cannot remove the only layer.");
+        }
+        layers.pop_back();
+        resetPlan();
+        final_depth = layers.back()->getOutputDepth();
+        final_rows = layers.back()->getOutputRows();
+        final_cols = layers.back()->getOutputCols();
+    }
+
+    /**
+     * @brief Rewrite adjacent layers into a single fused layer wherever one of
+     * them knows a fused form (see Layer::fuseWithNext), i.e. DenseLayer and
+     * ActivationLayer into DenseActivationLayer. A fused layer is tried again
+     * with its new neighbour, so chains such as convolution, activation and
+     * max pooling collapse fully. The container computes the same function.
+     * 
+     * @return Number of fusions made
+    */
+    int fuse() {
+        int fused = 0;
+        size_t i = 0;
+        while (i + 1 < layers.size()) {
+            auto res = layers[i]->fuseWithNext(*layers[i + 1]);
+            if (res == nullptr) {
+                res = layers[i + 1]->fuseWithPrevious(*layers[i]);
+            }
+
+            if (res == nullptr) {
+                i++;
+                continue;
+            }
+
+            layers[i] = std::move(res);
+            layers.erase(layers.begin() + i + 1);
+            fused++;
+        }
+        if (fused > 0) {
+            resetPlan();
+        }
+        return fused;
+    }
+
+    /**
+     * @brief Checkpoint segments of layers when training. Only the input of
+     * each segment is kept by forward, and backward recomputes the segment's
+     * activations just before going back through it. The last segment keeps
+     * its activations. Costs about one extra forward pass, and with segments
+     * of sqrt(layers) activation memory grows with sqrt(layers).
+     * 
+     * @param segment Layers per segment, 0 to keep every activation, -1 for
+     * about sqrt(layers) (optional)
+    */
+    void setCheckpointing(const int segment = -1) {
+        checkpoint_segment = segment;
+        checkpoints.clear();
+        training_plan = MemoryPlan();
+        training_buffers.clear();
+    }
+
+    // Layers per checkpointed segment, 0 if every activation is kept
+    [[nodiscard]] int getCheckpointSegment() const { return static_cast<int>(segmentLength()); }
+
+    /**
+     * @brief Plan buffers for the tensors of one pass over the layers. Step i
+     * is the forward of layer i, step L the end layer and step 2L - i the
+     * backward of layer i.
+     * 
+     * Inference only keeps the activation between two layers, so a chain fits
+     * in two buffers. Training also keeps what each layer saves for backward
+     * (Layer::savedActivationElements) until its backward step, and the
+     * gradients passed back between layers. With checkpointing, a segment
+     * keeps its input instead, and what its layers save lives from the
+     * recompute before the segment's backward.
+     * 
+     * Tensors are numbered as activations 0 to L (the input then the output
+     * of each layer), L + 1 + i the gradient w.r.t. the input of layer i,
+     * 2L + 1 the gradient from the end layer, then segment inputs and saved
+     * tensors. Inference applies its plan in infer, training in forward and
+     * backward. Saved tensors and segment inputs stay owned by the layers and
+     * the checkpoints, they are planned for the peak estimate only. The plans
+     * applied share buffers between tensors of the same size only, so the
+     * storage of each buffer is kept from one pass to the next.
+     * 
+     * @param training Plan a training pass rather than inference
+     * @param exact_sizes Only share buffers between tensors of the same size (optional)
+     * @return MemoryPlan Buffers, with the planned peak in elements
+    */
+    MemoryPlan planMemory(const bool training, const bool exact_sizes = false) const {
+        const int L = static_cast<int>(layers.size());
+        vector<TensorLifetime> tensors;
+        if (L == 0) {
+            return hado::planMemory(tensors, exact_sizes);
+        }
+
+        // Activations, the input then the output of each layer
+        tensors.push_back({layers[0]->inputElements(), 0, 0});
+        for (int i = 0; i < L; i++) {
+            tensors.push_back({layers[i]->outputElements(), i, i + 1});
+        }
+
+        if (training) {
+            // Gradient w.r.t. the input of layer i, from its backward to the one before
+            for (int i = 0; i < L; i++) {
+                tensors.push_back({layers[i]->inputElements(), 2 * L - i, i > 0 ? 2 * L - i + 1 : 2 * L});
+            }
+
+            // Gradient from the end layer to the backward of the last layer
+            tensors.push_back({layers[L - 1]->outputElements(), L, L + 1});
+
+            const int segment = static_cast<int>(segmentLength());
+            const int last_start = segment > 0 ? ((L - 1) / segment) * segment : 0;
+            for (int start = 0; start < last_start; start += segment) {
+                // Segment input from its forward to the recompute
+                tensors.push_back({layers[start]->inputElements(), start, 2 * L - (start + segment) + 1});
+            }
+
+            for (int i = 0; i < L; i++) {
+                // Saved by layer i from its forward (or recompute) to its backward
+                const int end = i < last_start ? (i / segment + 1) * segment : L;
+                const int first = i < last_start ? 2 * L - end + 1 : i;
+                tensors.push_back({layers[i]->savedActivationElements(), first, 2 * L - i});
+            }
+        }
+
+        return hado::planMemory(tensors, exact_sizes);
+    }
+
+    // Static cost of each layer for one sample, see Layer::cost
+    vector<LayerCost> costs() const {
+        vector<LayerCost> res;
+        res.reserve(layers.size());
+        for (const auto& layer : layers) {
+            res.push_back(layer->cost());
+        }
+        return res;
+    }
+
+    // Parameter tensors of every layer in order, see Layer::parameters
+    vector<MatrixD*> parameters() {
+        vector<MatrixD*> res;
+        for (auto& layer : layers) {
+            for (MatrixD* param : layer->parameters()) {
+                res.push_back(param);
+            }
+        }
+        return res;
+    }
+
+    // Gradient accumulators matching parameters(), see Layer::gradients
+    vector<MatrixD*> gradients() {
+        vector<MatrixD*> res;
+        for (auto& layer : layers) {
+            for (MatrixD* grad : layer->gradients()) {
+                res.push_back(grad);
+            }
+        }
+        return res;
+    }
+
+    /**
+     * @brief Make backward of every layer accumulate parameter gradients
+     * instead of updating, see Layer::setGradientAccumulation.
+     *
+     * @param enabled Whether to accumulate
+    */
+    void setGradientAccumulation(const bool enabled) {
+        for (auto& layer : layers) {
+            layer->setGradientAccumulation(enabled);
+        }
+    }
+
+    /**
+     * @brief Train the parameters of source instead of the own ones, layer by
+     * layer (see Layer::shareParameters). source must be a copy of these
+     * layers that outlives the sharing.
+     *
+     * @param source Layers owning the shared parameters, or nullptr to stop sharing
+    */
+    void shareParameters(LayerVector<T>* source) {
+        if (source != nullptr && source->layers.size() != layers.size()) {
+            throw std::invalid_argument("Shared layers must match these layers.");
+        }
+        for (size_t i = 0; i < layers.size(); i++) {
+            layers[i]->shareParameters(source != nullptr ? source->layers[i].get() : nullptr);
+        }
+    }
+
+    /**
+     * @brief Whether forward and backward can train on a batch of samples side
+     * by side as columns: every layer takes one column samples and trains on
+     * columns (see Layer::trainsColumns).
+    */
+    [[nodiscard]] bool trainsColumns() const {
+        for (const auto& layer : layers) {
+            if (!layer->trainsColumns() || layer->getInputCols() != 1 || layer->getOutputCols() != 1) {
+                return false;
+            }
+        }
+        return !layers.empty();
+    }
+
+    /**
+     * @brief Let forward and backward of every layer take any number of
+     * columns, one sample each. Only for layers that trainsColumns.
+     *
+     * @param enabled Whether to take column batches
+    */
+    void setColumnBatch(const bool enabled) {
+        column_batch = enabled;
+        for (auto& layer : layers) {
+            layer->setColumnBatch(enabled);
+        }
+    }
+
+    /**
+     * @brief Update every layer with its accumulated gradients, see Layer::applyGradients.
+     *
+     * @param learning_rate Learning rate for gradient descent
+     * @param scale Factor on the accumulated gradients (optional)
+    */
+    void applyGradients(const T learning_rate, const T scale = 1) {
+        for (auto& layer : layers) {
+            layer->applyGradients(learning_rate, scale);
+        }
+    }
+
+    /**
+     * @brief Inference only forward pass. Layers run with training off (and
+     * back in their previous mode afterwards), so they keep nothing for
+     * backward. Activations go into the buffers of the inference plan, each
+     * layer writing into their existing storage through Layer::forwardInto.
+     * 
+     * @param input vector<MatrixD> to send forward
+    */
+    vector<MatrixD> infer(vector<MatrixD> input){
+
+        // Dimension check
+        assertEntryDimensions(input);
+
+        if (inference_plan.assignment.empty()) {
+            inference_plan = planMemory(false, true);
+            inference_buffers.assign(inference_plan.buffers.size(), vector<MatrixD>());
+        }
+
+        // The input stays in its own tensor, the rest go through the buffers
+        vector<MatrixD>* current = &input;
+        for (size_t i = 0; i < layers.size(); i++) {
+            vector<MatrixD>& next = inference_buffers[inference_plan.assignment[i + 1]];
+            const TrainingModeGuard<T> inference(*layers[i], false);
+            layers[i]->forwardInto(*current, next);
+            current = &next;
+        }
+
+        return *current;
+    }
 
     // Default constructor
     LayerVector() = default;
@@ -88,6 +492,7 @@ public:
             res->final_rows = final_rows;
             res->final_cols = final_cols;
         }
+        res->checkpoint_segment = checkpoint_segment;
         return res;
     }
 
@@ -127,6 +532,7 @@ public:
 
         // Allocate memory and push onto vector
         layers.push_back(std::make_unique<LayerType>(layer));
+        resetPlan();
 
         // Update attributes
         final_depth = layers.back()->getOutputDepth();
@@ -136,39 +542,50 @@ public:
 
     /**
      * @brief Send an input through the model and get result at end of pipe.
-     * Input dimensions must match container inout dimensions.
+     * Input dimensions must match container inout dimensions. Activations go
+     * into the buffers of the training plan (see planMemory), so their storage
+     * is reused from one pass to the next.
      * 
      * @param input vector<MatrixD> to send forward
     */
     vector<MatrixD> forward(vector<MatrixD> input){
 
         // Dimension check
-        if (input.size() != (size_t) this->entry_depth 
-            || input[0].rows() != this->entry_rows 
-            || input[0].cols() != this->entry_cols) {
-                cout << "Input tensor must have depth " << entry_depth 
-                    << " but got depth " << input.size() << endl;
-
-                cout << "Input tensor must have rows " << entry_rows 
-                    << " but got rows " << input[0].rows() << endl;
-
-                cout << "Input tensor must have cols " << entry_cols 
-                    << " but got cols " << input[0].cols() << endl;
-                throw std::invalid_argument("Input tensor has incorrect dimensions." );
+        assertEntryDimensions(input);
+        ensureTrainingPlan();
+
+        // Checkpointed segments keep only their input, the last segment keeps everything
+        checkpoints.clear();
+        checkpointed_length = segmentLength();
+        const size_t last_start = checkpointed_length > 0
+            ? ((layers.size() - 1) / checkpointed_length) * checkpointed_length : 0;
+
+        // The input stays in its own tensor, the rest go through the buffers
+        vector<MatrixD>* current = &input;
+        for (size_t i = 0; i < last_start; i++) {
+            if (i % checkpointed_length == 0) {
+                checkpoints.push_back(*current);
+            }
+            const TrainingModeGuard<T> inference(*layers[i], false);
+            forwardLayer(i, *current, activationBuffer(i + 1));
+            current = &activationBuffer(i + 1);
+            layers[i]->clearActivations();
         }
 
         // Send the input and propagate forwards to end of model
-        for (auto& layer : layers) {
-            input = layer->forward(input);
+        for (size_t i = last_start; i < layers.size(); i++) {
+            forwardLayer(i, *current, activationBuffer(i + 1));
+            current = &activationBuffer(i + 1);
         }
 
-        // Return the resultant vector
-        return input;
+        // Return a copy of the resultant vector, its buffer is shared with other activations
+        return *current;
     }
     
     /**
      * @brief Given the gradient of error in error function, backwards propagate
      * the gradient through the model to perform stochastic gradient descent.
+     * Gradients between layers go into the buffers of the training plan.
      * 
      * @param output_gradient Gradient of error from result of error function
      * @param learning_rate Learning rate of model
@@ -178,7 +595,7 @@ public:
         // Dimension check
         if (output_gradient.size() != static_cast<size_t>(final_depth)
             || output_gradient[0].rows() != final_rows 
-            || output_gradient[0].cols() != final_cols) {
+            || (output_gradient[0].cols() != final_cols && !column_batch)) {
                 cout << "Output gradient tensor must have depth " << final_depth 
                     << " but got depth " << output_gradient.size() << endl;
 
@@ -190,13 +607,39 @@ public:
                 throw std::invalid_argument("Output gradient tensor has incorrect dimensions." );
             }
 
-        // Backward propagate gradients
-        for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
-            output_gradient = (*it)->backward(output_gradient, learning_rate);
+        ensureTrainingPlan();
+
+        // The end layer gradient stays in its own tensor, the rest go through the buffers
+        vector<MatrixD>* current = &output_gradient;
+
+        // Backward propagate gradients through the last (not checkpointed) segment
+        const size_t last_start = checkpoints.size() * checkpointed_length;
+        for (size_t i = layers.size(); i > last_start; i--) {
+            backwardLayer(i - 1, *current, gradientBuffer(i - 1), learning_rate);
+            current = &gradientBuffer(i - 1);
+        }
+
+        // Recompute each checkpointed segment from its input, then go back through it
+        for (size_t s = checkpoints.size(); s > 0; s--) {
+            const size_t start = (s - 1) * checkpointed_length;
+            const size_t end = start + checkpointed_length;
+
+            vector<MatrixD> x = std::move(checkpoints[s - 1]);
+            for (size_t i = start; i < end; i++) {
+                vector<MatrixD> y;
+                forwardLayer(i, x, y);
+                x = std::move(y);
+            }
+            for (size_t i = end; i > start; i--) {
+                backwardLayer(i - 1, *current, gradientBuffer(i - 1), learning_rate);
+                current = &gradientBuffer(i - 1);
+                layers[i - 1]->clearActivations();
+            }
         }
+        checkpoints.clear();
 
-        // Return top gradient (usually meaningless)
-        return output_gradient;
+        // Return a copy of the top gradient (usually meaningless), its buffer is shared
+        return *current;
     }
 };
 
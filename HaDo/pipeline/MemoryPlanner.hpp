@@ -0,0 +1,114 @@
+#ifndef MEMORY_PLANNER_HPP
+#define MEMORY_PLANNER_HPP
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Size and lifetime of one tensor. The tensor is live from the step
+ * that produces it to the last step that reads it, both inclusive.
+*/
+struct TensorLifetime {
+    size_t elements;
+    int first;
+    int last;
+};
+
+/**
+ * @brief Assignment of tensors to reusable buffers.
+*/
+struct MemoryPlan {
+
+    // Buffer each tensor is assigned to
+    vector<int> assignment;
+
+    // Size of each buffer in elements
+    vector<size_t> buffers;
+
+    // Elements needed if every tensor had its own buffer
+    size_t unplanned = 0;
+
+    // Elements needed by the planned buffers
+    [[nodiscard]] size_t peak() const {
+        return std::accumulate(buffers.begin(), buffers.end(), size_t(0));
+    }
+
+    // Print the planned peak against one buffer per tensor
+    template<typename T>
+    void print(std::ostream& os = std::cout) const {
+        os << "Memory plan: " << assignment.size() << " tensors in " << buffers.size()
+           << " buffers, peak " << peak() * sizeof(T) << " bytes (unplanned "
+           << unplanned * sizeof(T) << " bytes)" << std::endl;
+    }
+};
+
+/**
+ * @brief Greedy buffer assignment over tensor lifetimes. Tensors are placed in
+ * order of first use, each into the smallest free buffer that fits it, else
+ * the largest free buffer grown to fit, else a new buffer. A buffer is free
+ * once the last tensor in it has been read.
+ *
+ * With exact sizes a tensor only goes into a free buffer of its own size. An
+ * Eigen matrix reallocates when resized to another number of elements, so
+ * this is the plan to apply when buffers are matrices kept across passes.
+ *
+ * @param tensors Size and lifetime of each tensor
+ * @param exact_sizes Only reuse buffers of the same size (optional)
+ * @return MemoryPlan Buffer of each tensor and buffer sizes
+*/
+inline MemoryPlan planMemory(const vector<TensorLifetime>& tensors, const bool exact_sizes = false) {
+    MemoryPlan plan;
+    plan.assignment.assign(tensors.size(), -1);
+
+    vector<size_t> order(tensors.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+        return tensors[a].first < tensors[b].first;
+    });
+
+    // Last step each buffer is busy until
+    vector<int> busy_until;
+
+    for (const size_t t : order) {
+        const TensorLifetime& tensor = tensors[t];
+        plan.unplanned += tensor.elements;
+
+        int best_fit = -1, largest = -1;
+        for (size_t b = 0; b < plan.buffers.size(); b++) {
+            if (busy_until[b] >= tensor.first || (exact_sizes && plan.buffers[b] != tensor.elements)) {
+                continue;
+            }
+            if (plan.buffers[b] >= tensor.elements
+                && (best_fit < 0 || plan.buffers[b] < plan.buffers[best_fit])) {
+                best_fit = static_cast<int>(b);
+            }
+            if (largest < 0 || plan.buffers[b] > plan.buffers[largest]) {
+                largest = static_cast<int>(b);
+            }
+        }
+
+        int chosen = best_fit >= 0 ? best_fit : largest;
+        if (chosen < 0) {
+            chosen = static_cast<int>(plan.buffers.size());
+            plan.buffers.push_back(0);
+            busy_until.push_back(0);
+        }
+
+        plan.buffers[chosen] = std::max(plan.buffers[chosen], tensor.elements);
+        busy_until[chosen] = tensor.last;
+        plan.assignment[t] = chosen;
+    }
+
+    return plan;
+}
+
+}
+
+#endif // MEMORY_PLANNER_HPP
@@ -6,8 +6,18 @@
 #include <Eigen/Dense>
 #include "HaDo/base/Layer.hpp"
 #include "HaDo/base/EndLayer.hpp"
+#include "HaDo/layers/SoftmaxLayer.hpp"
+#include "HaDo/errors/CrossEntropyLoss.hpp"
+#include "HaDo/errors/SoftmaxCrossEntropyLoss.hpp"
 #include "LayerVector.hpp"
+#include "InferencePlan.hpp"
+#include "PipelineParallel.hpp"
+#include "DataParallel.hpp"
+#include "Hogwild.hpp"
+#include "HaDo/util/SnapshotPublisher.hpp"
 #include <memory>
+#include <string>
+#include <iomanip>
 
 using std::vector;
 using std::pair;
@@ -20,6 +30,12 @@ namespace hado {
  * @brief Pipeline class for automatic handling of network structure.
  * Single runs and does not handle epoch parameters.
  * 
+ * Before the first training or inference run the layers go through a fusion
+ * pass (see optimize), which changes how they run but not what they compute.
+ * Rewriting a final SoftmaxLayer and CrossEntropyLoss into
+ * SoftmaxCrossEntropyLoss does change the training gradient, so it is opt-in
+ * (see setSoftmaxCrossEntropyFusion).
+ * 
  * @tparam T numeric type: float, double, long double
 */
 template <typename T=float>
@@ -42,6 +58,91 @@ class Pipeline {
     // Error/ error gradient calculation layer
     std::unique_ptr<EndLayer<T>> endlayer;
 
+    // Executors kept across epochs by trainDataParallel and trainHogwild,
+    // holding clones of the layers, so dropped whenever they change
+    std::unique_ptr<DataParallel<T>> data_parallel;
+    std::unique_ptr<Hogwild<T>> hogwild;
+
+    void resetExecutors() {
+        data_parallel.reset();
+        hogwild.reset();
+    }
+
+    // Whether to run the fusion pass, and whether it has run on the current layers
+    bool fusion = true;
+    bool optimized = false;
+
+    // Whether the fusion pass may rewrite a final softmax and cross entropy, see setSoftmaxCrossEntropyFusion
+    bool softmax_fusion = false;
+
+    // A final SoftmaxLayer was fused into the end layer, so results need softmax applied
+    bool softmax_output = false;
+
+    // Put back a SoftmaxLayer fused into the end layer, before the layers are changed
+    void unfuseSoftmax() {
+        resetExecutors();
+        if (softmax_output) {
+            layervector->pushLayer(SoftmaxLayer<T>(layervector->getFinalRows()));
+            softmax_output = false;
+        }
+        optimized = false;
+    }
+
+    /**
+     * @brief Forward and backward of a minibatch as the columns of one matrix,
+     * with gradients accumulating. The end layer takes the samples one at a
+     * time, and its gradients go back side by side.
+     *
+     * @return Sum of the errors of the minibatch
+    */
+    T trainColumns(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                   const vector<size_t>& indices, const T learning_rate) {
+        const Layer<T>& first = layervector->getLayer(0);
+        const int B = static_cast<int>(indices.size());
+
+        // Samples side by side
+        vector<MatrixD> batch(first.getInputDepth(), MatrixD(first.getInputRows(), B));
+        for (int j = 0; j < B; j++) {
+            const vector<MatrixD>& sample = inputs[indices[j]];
+            first.assertInputDimensions(sample);
+            for (size_t d = 0; d < batch.size(); d++) {
+                batch[d].col(j) = sample[d].col(0);
+            }
+        }
+
+        layervector->setColumnBatch(true);
+        auto x = layervector->forward(batch);
+
+        T error = 0;
+        vector<MatrixD> grad(x.size(), MatrixD(x[0].rows(), B));
+        vector<MatrixD> column(x.size());
+        {
+            HADO_TRACE_SPAN("loss", "train");
+            for (int j = 0; j < B; j++) {
+                for (size_t d = 0; d < x.size(); d++) {
+                    column[d] = x[d].col(j);
+                }
+                error += endlayer->forward(column, true_results[indices[j]]);
+                const vector<MatrixD> g = endlayer->backward(column, true_results[indices[j]], learning_rate);
+                for (size_t d = 0; d < x.size(); d++) {
+                    grad[d].col(j) = g[d].col(0);
+                }
+            }
+        }
+
+        layervector->backward(grad, learning_rate);
+        layervector->setColumnBatch(false);
+        return error;
+    }
+
+    // Softmax of the logits when the final SoftmaxLayer was fused away
+    void applySoftmax(vector<MatrixD>& x) const {
+        if (softmax_output) {
+            x[0] = (x[0].array() - x[0].maxCoeff()).exp();
+            x[0] /= x[0].sum();
+        }
+    }
+
 public:
 
     // Default constructor
@@ -51,9 +152,11 @@ public:
     }
 
     // Copy constructor
-    Pipeline(const Pipeline& p) {
+    Pipeline(const Pipeline& p)
+        : fusion(p.fusion), optimized(p.optimized), softmax_fusion(p.softmax_fusion),
+          softmax_output(p.softmax_output) {
         layervector = p.layervector->clone();
-        endlayer = p.endlayer->clone();
+        endlayer = p.endlayer ? p.endlayer->clone() : nullptr;
     }
 
     // Clone returning unique ptr
@@ -79,6 +182,7 @@ public:
             throw std::invalid_argument("End layer must be pushed last.");
         }
 
+        unfuseSoftmax();
         layervector->template pushLayer<LayerType>(layer);
     }
 
@@ -92,6 +196,8 @@ public:
     template <typename EndLayerType>
     void pushEndLayer(const EndLayerType end) {
 
+        unfuseSoftmax();
+
         // Must match dimensions
         if ((*layervector).getFinalDepth() != end.getDepth() 
             || (*layervector).getFinalRows() != end.getRows() 
@@ -111,6 +217,195 @@ public:
         this->endlayer = std::make_unique<EndLayerType>(end);
     }
 
+    /**
+     * @brief End layer of the pipeline, after fusion if it has run. End layers
+     * owning the output projection (sampled and hierarchical softmax) hold
+     * trained weights here.
+    */
+    EndLayer<T>& getEndLayer() {
+        if (endlayer == nullptr) {
+            throw std::logic_error("Pipeline has no end layer.");
+        }
+        return *endlayer;
+    }
+
+    // Enable or disable the fusion pass, must be set before the first run to take effect
+    void setFusion(const bool enabled) { fusion = enabled; }
+
+    /**
+     * @brief Let the fusion pass rewrite a final SoftmaxLayer followed by
+     * CrossEntropyLoss into SoftmaxCrossEntropyLoss. Off by default, since it
+     * changes what training computes: unfused, the gradient reaching the last
+     * layer is the softmax Jacobian times s - t (CrossEntropyLoss::backward
+     * passed through SoftmaxLayer::backward), fused it is s - t, the exact
+     * gradient of the loss w.r.t. the logits. Losses and predictions before
+     * training are the same. Must be set before the first run to take effect.
+     * 
+     * @param enabled Whether to rewrite
+    */
+    void setSoftmaxCrossEntropyFusion(const bool enabled) { softmax_fusion = enabled; }
+
+    // Checkpoint segments of layers when training (see LayerVector::setCheckpointing)
+    void setCheckpointing(const int segment = -1) {
+        resetExecutors();
+        layervector->setCheckpointing(segment);
+    }
+
+    // Record per-layer timings of training (see Profiler), after fusion
+    void setProfiling(const bool enabled) {
+        optimize();
+        layervector->setProfiling(enabled);
+    }
+    Profiler& getProfiler() { return layervector->getProfiler(); }
+
+    // Number of layers, after fusion if it has run
+    [[nodiscard]] int getLayerCount() const { return layervector->getLayerCount(); }
+
+    /**
+     * @brief Buffer plan for the activations of a pass, after fusion
+     * (see LayerVector::planMemory). Print it with MemoryPlan::print<T>().
+     * 
+     * @param training Plan a training pass rather than inference
+    */
+    MemoryPlan planMemory(const bool training) {
+        optimize();
+        return layervector->planMemory(training);
+    }
+
+    /**
+     * @brief Static cost of each layer for one sample, after fusion (see
+     * Layer::cost). The end layer is not included.
+     * 
+     * @return vector<LayerCost> Cost of each layer in order
+    */
+    vector<LayerCost> costs() {
+        optimize();
+        return layervector->costs();
+    }
+
+    /**
+     * @brief Cost report for one sample: each layer, the totals, and the
+     * planned peak activation memory of inference and training passes.
+     * 
+     * @return json Report, see printCosts for a table of the same numbers
+    */
+    json costReport() {
+        json report;
+        report["layers"] = json::array();
+        LayerCost total;
+        total.name = "Total";
+        for (const LayerCost& cost : costs()) {
+            report["layers"].push_back({
+                {"name", cost.name},
+                {"forward_flops", cost.forward_flops},
+                {"backward_flops", cost.backward_flops},
+                {"parameters", cost.parameters},
+                {"parameter_bytes", cost.parameter_bytes},
+                {"activation_bytes", cost.activation_bytes},
+                {"saved_bytes", cost.saved_bytes},
+                {"intensity", cost.intensity()}
+            });
+            total.forward_flops += cost.forward_flops;
+            total.backward_flops += cost.backward_flops;
+            total.parameters += cost.parameters;
+            total.parameter_bytes += cost.parameter_bytes;
+            total.activation_bytes += cost.activation_bytes;
+            total.saved_bytes += cost.saved_bytes;
+        }
+        report["total"] = {
+            {"forward_flops", total.forward_flops},
+            {"backward_flops", total.backward_flops},
+            {"parameters", total.parameters},
+            {"parameter_bytes", total.parameter_bytes},
+            {"activation_bytes", total.activation_bytes},
+            {"saved_bytes", total.saved_bytes},
+            {"intensity", total.intensity()}
+        };
+        report["peak_inference_bytes"] = planMemory(false).peak() * sizeof(T);
+        report["peak_training_bytes"] = planMemory(true).peak() * sizeof(T);
+        return report;
+    }
+
+    /**
+     * @brief Print a table of the cost of each layer for one sample, with the
+     * totals and the planned peak activation memory.
+     * 
+     * @param os Stream to print to (optional)
+    */
+    void printCosts(std::ostream& os = cout) {
+        const json report = costReport();
+        auto row = [&os](const std::string& name, const json& cost) {
+            os << std::left << std::setw(28) << name << std::right
+               << std::setw(14) << cost["forward_flops"].get<double>()
+               << std::setw(14) << cost["backward_flops"].get<double>()
+               << std::setw(12) << cost["parameters"].get<size_t>()
+               << std::setw(14) << cost["activation_bytes"].get<size_t>()
+               << std::setw(14) << cost["saved_bytes"].get<size_t>()
+               << std::setw(11) << std::setprecision(3) << cost["intensity"].get<double>()
+               << std::setprecision(6) << endl;
+        };
+
+        os << std::left << std::setw(28) << "Layer" << std::right
+           << std::setw(14) << "Fwd FLOPs" << std::setw(14) << "Bwd FLOPs" << std::setw(12) << "Params"
+           << std::setw(14) << "Act bytes" << std::setw(14) << "Saved bytes" << std::setw(11) << "FLOP/B" << endl;
+        for (const json& cost : report["layers"]) {
+            row(cost["name"].get<std::string>(), cost);
+        }
+        row("Total", report["total"]);
+        os << "Peak activation memory: " << report["peak_inference_bytes"].get<size_t>()
+           << " bytes inference, " << report["peak_training_bytes"].get<size_t>() << " bytes training" << endl;
+    }
+
+    /**
+     * @brief Compile the layers, after fusion, into an immutable inference
+     * plan giving the same results as predictPipeline. Later training does
+     * not change the plan, freeze again to pick it up.
+     * 
+     * @return InferencePlan<T> Compiled plan
+    */
+    InferencePlan<T> freeze() {
+        optimize();
+        return InferencePlan<T>(*layervector, softmax_output);
+    }
+
+    /**
+     * @brief Freeze the current weights and publish them to serving threads,
+     * which pick them up on their next SnapshotPublisher::Reader::acquire.
+     * Serving never waits on this or on training.
+     * 
+     * @param publisher Publisher shared with the serving threads
+     * @return uint64_t Version of the published plan
+    */
+    uint64_t publish(SnapshotPublisher<InferencePlan<T>>& publisher) {
+        return publisher.publish(std::make_unique<const InferencePlan<T>>(freeze()));
+    }
+
+    /**
+     * @brief Fusion pass. Rewrites adjacent layers into fused layers (Dense and
+     * activation, convolution and activation, convolution and max pooling, see
+     * LayerVector::fuse), and if enabled (see setSoftmaxCrossEntropyFusion) a
+     * final SoftmaxLayer with CrossEntropyLoss into SoftmaxCrossEntropyLoss.
+     * Runs once, called by the train, test and predict functions. Results are
+     * still softmax probabilities.
+    */
+    void optimize() {
+        if (!fusion || optimized) {
+            return;
+        }
+        resetExecutors();
+        layervector->fuse();
+
+        if (softmax_fusion
+            && layervector->getLayerCount() > 1
+            && dynamic_cast<SoftmaxLayer<T>*>(&layervector->back()) != nullptr
+            && dynamic_cast<CrossEntropyLoss<T>*>(endlayer.get()) != nullptr) {
+            layervector->popLayer();
+            endlayer = std::make_unique<SoftmaxCrossEntropyLoss<T>>(endlayer->getRows());
+            softmax_output = true;
+        }
+        optimized = true;
+    }
+
     /**
      * @brief Train the network with a forward and backward propagation
      * 
@@ -121,14 +416,20 @@ public:
     */
     T trainPipeline(vector<MatrixD>& input, vector<MatrixD>& true_res, const T learning_rate) {
 
+        optimize();
+        HADO_TRACE_SPAN("train step", "train");
+
         // Send through network forward
         auto x = (*layervector).forward(input);
 
-        // Calculate error
-        T error = (*endlayer).forward(x, true_res);
-
-        // Calculate derivative of error
-        auto grad = (*endlayer).backward(x, true_res);
+        // Calculate error and its derivative (end layers with parameters also update them)
+        T error;
+        vector<MatrixD> grad;
+        {
+            HADO_TRACE_SPAN("loss", "train");
+            error = (*endlayer).forward(x, true_res);
+            grad = (*endlayer).backward(x, true_res, learning_rate);
+        }
 
         // Backpropagate
         (*layervector).backward(grad, learning_rate);
@@ -138,7 +439,131 @@ public:
     }
 
     /**
-     * @brief Runs an input through the model (forward only) with correct input and calculates error
+     * @brief Train on a minibatch with a single update of all parameters, those
+     * of the end layer included, by the mean of the sample gradients. When the
+     * layers train on columns (see LayerVector::trainsColumns), e.g. Dense,
+     * DenseActivation and Activation layers, the minibatch runs forward and
+     * backward once as the columns of one matrix. Otherwise the samples run one
+     * at a time.
+     *
+     * @param inputs Input tensor of each sample of the data set
+     * @param true_results Expected result of each sample of the data set
+     * @param indices Samples of the minibatch, as indices into inputs
+     * @param learning_rate Learning rate for model
+     * @return Sum of the errors of the minibatch
+    */
+    T trainBatch(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                 const vector<size_t>& indices, const T learning_rate) {
+
+        if (indices.empty()) {
+            return 0;
+        }
+        optimize();
+        if (indices.size() == 1) {
+            return trainPipeline(inputs[indices[0]], true_results[indices[0]], learning_rate);
+        }
+
+        HADO_TRACE_SPAN("train batch", "train");
+        T error = 0;
+        layervector->setGradientAccumulation(true);
+        endlayer->setGradientAccumulation(true);
+        try {
+            if (layervector->trainsColumns()) {
+                error = trainColumns(inputs, true_results, indices, learning_rate);
+            } else {
+                for (const size_t i : indices) {
+                    error += trainPipeline(inputs[i], true_results[i], learning_rate);
+                }
+            }
+        } catch (...) {
+            layervector->setColumnBatch(false);
+            layervector->setGradientAccumulation(false);
+            endlayer->setGradientAccumulation(false);
+            throw;
+        }
+        const T scale = T(1) / static_cast<T>(indices.size());
+        layervector->applyGradients(learning_rate, scale);
+        endlayer->applyGradients(learning_rate, scale);
+        layervector->setGradientAccumulation(false);
+        endlayer->setGradientAccumulation(false);
+
+        return error;
+    }
+
+    /**
+     * @brief Train on a sequence of samples with the layers split into stages
+     * run by separate threads (see PipelineParallel).
+     * 
+     * @param inputs Input tensor of each sample
+     * @param true_results Expected result of each sample
+     * @param learning_rate Learning rate for model
+     * @param stages Number of stages (threads)
+     * @param max_in_flight Maximum samples in the pipeline at once, 2 * stages if 0 (optional)
+     * @return Sum of the errors of all samples
+    */
+    T trainPipelineParallel(const vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                            const T learning_rate, const int stages, const int max_in_flight = 0) {
+
+        optimize();
+
+        PipelineParallel<T> executor(*layervector, endlayer.get(), stages, max_in_flight);
+        return executor.train(inputs, true_results, learning_rate);
+    }
+
+    /**
+     * @brief Train on the samples in the given order with data parallel
+     * replicas, one update per minibatch (see DataParallel). The replicas are
+     * kept for the next call with as many, until the layers change.
+     * 
+     * @param inputs Input tensor of each sample
+     * @param true_results Expected result of each sample
+     * @param order Samples to train on, as indices into inputs
+     * @param batch_size Samples per update, split across the replicas
+     * @param learning_rate Learning rate for model
+     * @param replicas Number of replicas (threads)
+     * @return Sum of the errors of all samples
+    */
+    T trainDataParallel(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                        const vector<size_t>& order, const int batch_size, const T learning_rate,
+                        const int replicas) {
+
+        optimize();
+
+        if (!data_parallel || data_parallel->getReplicaCount() != replicas) {
+            data_parallel.reset();
+            data_parallel = std::make_unique<DataParallel<T>>(*layervector, endlayer.get(), replicas);
+        }
+        return data_parallel->train(inputs, true_results, order, batch_size, learning_rate);
+    }
+
+    /**
+     * @brief Train on the samples in the given order with lock-free
+     * asynchronous updates from several threads (see Hogwild). The workers are
+     * kept for the next call with as many, until the layers change.
+     * 
+     * @param inputs Input tensor of each sample
+     * @param true_results Expected result of each sample
+     * @param order Samples to train on, as indices into inputs, one shard per thread
+     * @param learning_rate Learning rate for model
+     * @param threads Number of worker threads
+     * @return Sum of the errors of all samples
+    */
+    T trainHogwild(vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+                   const vector<size_t>& order, const T learning_rate, const int threads) {
+
+        optimize();
+
+        if (!hogwild || hogwild->getThreadCount() != threads) {
+            hogwild.reset();
+            hogwild = std::make_unique<Hogwild<T>>(*layervector, endlayer.get(), threads);
+        }
+        return hogwild->train(inputs, true_results, order, learning_rate);
+    }
+
+    /**
+     * @brief Runs an input through the model (forward only) with correct input and calculates error.
+     * The error and result come from the end layer (see EndLayer::testForward and
+     * EndLayer::predict), e.g. the full softmax for sampled softmax.
      * 
      * @param input Input tensor into pipeline
      * @param true_res Expected result from pipeline
@@ -146,27 +571,34 @@ public:
     */
     pair<T, vector<MatrixD>> testPipeline(vector<MatrixD>& input, vector<MatrixD>& true_res) {
 
-        // Send forward through network
-        auto x = (*layervector).forward(input);
+        optimize();
+
+        // Send forward through network, keeping nothing for backward
+        auto x = (*layervector).infer(input);
 
         // Calculate error
-        T error = (*endlayer).forward(x, true_res);
+        T error = (*endlayer).testForward(x, true_res);
 
         // Return error and result
-        return std::make_pair(error, x);
+        applySoftmax(x);
+        return std::make_pair(error, (*endlayer).predict(x));
     }
 
     /**
-     * @brief Runs an input through the model (forward only)
+     * @brief Runs an input through the model (forward only), then through the
+     * end layer's predict if there is one
      * 
      * @param input Input tensor into pipeline
-     * @param true_res Expected result from pipeline
-     * @return Error of forward propagation
+     * @return Result of forward propagation
     */
     vector<MatrixD> predictPipeline(vector<MatrixD>& input) {
 
+        optimize();
+
         // Send forward through network and return result
-        return (*layervector).forward(input);
+        auto x = (*layervector).infer(input);
+        applySoftmax(x);
+        return endlayer ? endlayer->predict(x) : x;
     }
 };
 
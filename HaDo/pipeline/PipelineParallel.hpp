@@ -0,0 +1,365 @@
+#ifndef PIPELINE_PARALLEL_HPP
+#define PIPELINE_PARALLEL_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "HaDo/base/Layer.hpp"
+#include "HaDo/base/EndLayer.hpp"
+#include "LayerVector.hpp"
+#include "HaDo/util/TraceWriter.hpp"
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <stdexcept>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Pipeline parallel executor. Splits the layers of a LayerVector into
+ * contiguous stages, each run by its own thread, and streams samples through
+ * them as micro-batches so every stage works on a different sample at once.
+ *
+ * @details Stages pass tensors through bounded inboxes. A stage with both kinds
+ * of work does backward first (a 1F1B schedule), and at most max_in_flight
+ * samples are between entering the first stage and leaving it again in backward.
+ *
+ * Forward runs with training off and a stage keeps only its input for each
+ * sample in flight, recomputing its activations just before that sample's
+ * backward (as in LayerVector::setCheckpointing). The last stage runs forward,
+ * the end layer and backward in one go.
+ *
+ * Layers update their parameters in backward as usual, so with more than one
+ * sample in flight a sample may reach a stage's backward after other samples
+ * have updated that stage, as in asynchronous pipeline schemes. With
+ * max_in_flight 1 training is the same as training the layers one sample at
+ * a time.
+ *
+ * The executor works on the layers and end layer it is given, which must
+ * outlive it and not be used elsewhere while it runs.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class PipelineParallel {
+private:
+
+    // Convenience typedef
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+
+    // Tensor of one sample passed between stages
+    struct Message {
+        int id;
+        vector<MatrixD> tensor;
+    };
+
+    /**
+     * @brief Inbox of a stage. Forward messages are bounded, backward ones are
+     * bounded by the samples in flight, and backward is served first.
+    */
+    class Inbox {
+    private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<Message> forward_queue;
+        std::deque<Message> backward_queue;
+        size_t capacity;
+        bool closed = false;
+
+    public:
+        explicit Inbox(const size_t capacity) : capacity(capacity) {}
+
+        void pushForward(Message message) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]{ return closed || forward_queue.size() < capacity; });
+            forward_queue.push_back(std::move(message));
+            changed.notify_all();
+        }
+
+        void pushBackward(Message message) {
+            std::lock_guard<std::mutex> lock(mutex);
+            backward_queue.push_back(std::move(message));
+            changed.notify_all();
+        }
+
+        // Wait for a message, false once closed
+        bool pop(Message& message, bool& backward) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]{ return closed || !forward_queue.empty() || !backward_queue.empty(); });
+            if (closed) {
+                return false;
+            }
+            backward = !backward_queue.empty();
+            std::deque<Message>& queue = backward ? backward_queue : forward_queue;
+            message = std::move(queue.front());
+            queue.pop_front();
+            changed.notify_all();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            changed.notify_all();
+        }
+    };
+
+    // Layers and end layer being run, not owned
+    LayerVector<T>& layers;
+    EndLayer<T>* endlayer;
+
+    // First layer of each stage, and one past the last layer of the last stage
+    vector<int> bounds;
+
+    // Maximum number of samples between entering and leaving the pipeline
+    int max_in_flight;
+
+    // State of one run
+    vector<std::unique_ptr<Inbox>> inboxes;
+    std::mutex progress_mutex;
+    std::condition_variable progress;
+    int in_flight = 0;
+    int completed = 0;
+    std::exception_ptr failure;
+
+    // Run the layers of a stage forward, keeping state for backward only if training
+    vector<MatrixD> forwardStage(const int stage, vector<MatrixD> x, const bool training) {
+        for (int i = bounds[stage]; i < bounds[stage + 1]; i++) {
+            const TrainingModeGuard<T> mode(layers.getLayer(i), training);
+            x = layers.getLayer(i).forward(x);
+        }
+        return x;
+    }
+
+    // Run the layers of a stage backward and drop what they kept
+    vector<MatrixD> backwardStage(const int stage, vector<MatrixD> gradient, const T learning_rate) {
+        for (int i = bounds[stage + 1]; i > bounds[stage]; i--) {
+            gradient = layers.getLayer(i - 1).backward(gradient, learning_rate);
+            layers.getLayer(i - 1).clearActivations();
+        }
+        return gradient;
+    }
+
+    // Record a sample leaving the pipeline
+    void finish() {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        in_flight--;
+        completed++;
+        progress.notify_all();
+    }
+
+    // Pass the gradient of a sample to the stage before, or finish it
+    void sendBackward(const int stage, Message message) {
+        if (stage == 0) {
+            finish();
+        } else {
+            inboxes[stage - 1]->pushBackward(std::move(message));
+        }
+    }
+
+    // Stop every stage after a failure
+    void abort(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            if (!failure) {
+                failure = error;
+            }
+            progress.notify_all();
+        }
+        for (auto& inbox : inboxes) {
+            inbox->close();
+        }
+    }
+
+    /**
+     * @brief Work loop of one stage.
+     *
+     * @param stage Stage index
+     * @param true_results Expected results, empty when only predicting
+     * @param learning_rate Learning rate
+     * @param errors Error of each sample (training)
+     * @param results Result of each sample (predicting)
+    */
+    void runStage(const int stage, vector<vector<MatrixD>>& true_results, const T learning_rate,
+                  vector<T>& errors, vector<vector<MatrixD>>& results) {
+        const bool training = !true_results.empty();
+        const bool last = stage + 1 == static_cast<int>(bounds.size()) - 1;
+        std::unordered_map<int, vector<MatrixD>> stash;
+
+        try {
+            const std::string name = "stage " + std::to_string(stage);
+            Message message;
+            bool backward;
+            while (inboxes[stage]->pop(message, backward)) {
+                HADO_TRACE_SPAN(name + (backward ? " backward" : " forward"), "pipeline");
+                if (backward) {
+                    // Recompute from the kept input, then go back through the stage
+                    auto kept = stash.find(message.id);
+                    std::ignore = forwardStage(stage, std::move(kept->second), true);
+                    stash.erase(kept);
+                    message.tensor = backwardStage(stage, std::move(message.tensor), learning_rate);
+                    sendBackward(stage, std::move(message));
+                } else if (!last) {
+                    if (training) {
+                        stash[message.id] = message.tensor;
+                    }
+                    message.tensor = forwardStage(stage, std::move(message.tensor), false);
+                    inboxes[stage + 1]->pushForward(std::move(message));
+                } else if (!training) {
+                    results[message.id] = forwardStage(stage, std::move(message.tensor), false);
+                    finish();
+                } else {
+                    // Whole step at the last stage
+                    auto res = forwardStage(stage, std::move(message.tensor), true);
+                    errors[message.id] = endlayer->forward(res, true_results[message.id]);
+                    auto gradient = endlayer->backward(res, true_results[message.id], learning_rate);
+                    message.tensor = backwardStage(stage, std::move(gradient), learning_rate);
+                    sendBackward(stage, std::move(message));
+                }
+            }
+        } catch (...) {
+            abort(std::current_exception());
+        }
+    }
+
+    /**
+     * @brief Stream the inputs through the stages and wait for every sample.
+    */
+    void run(const vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results,
+             const T learning_rate, vector<T>& errors, vector<vector<MatrixD>>& results) {
+        const int stages = static_cast<int>(bounds.size()) - 1;
+        inboxes.clear();
+        for (int s = 0; s < stages; s++) {
+            inboxes.push_back(std::make_unique<Inbox>(static_cast<size_t>(max_in_flight)));
+        }
+        in_flight = 0;
+        completed = 0;
+        failure = nullptr;
+
+        vector<std::thread> workers;
+        for (int s = 0; s < stages; s++) {
+            workers.emplace_back([&, s]{ runStage(s, true_results, learning_rate, errors, results); });
+        }
+
+        // Admit samples while fewer than max_in_flight are in the pipeline
+        for (size_t i = 0; i < inputs.size(); i++) {
+            {
+                std::unique_lock<std::mutex> lock(progress_mutex);
+                progress.wait(lock, [&]{ return failure || in_flight < max_in_flight; });
+                if (failure) {
+                    break;
+                }
+                in_flight++;
+            }
+            inboxes[0]->pushForward({static_cast<int>(i), inputs[i]});
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(progress_mutex);
+            progress.wait(lock, [&]{ return failure || completed == static_cast<int>(inputs.size()); });
+        }
+        for (auto& inbox : inboxes) {
+            inbox->close();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        inboxes.clear();
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+public:
+
+    /**
+     * @brief Construct a pipeline parallel executor over existing layers.
+     *
+     * @param layers Layers to run, split evenly into stages
+     * @param endlayer Error function for training, may be null when only predicting
+     * @param stages Number of stages (threads), at most the number of layers
+     * @param max_in_flight Maximum samples in the pipeline, 2 * stages if 0 (optional)
+    */
+    PipelineParallel(LayerVector<T>& layers, EndLayer<T>* endlayer, const int stages, const int max_in_flight = 0)
+        : layers(layers), endlayer(endlayer)
+    {
+        const int count = layers.getLayerCount();
+        if (count == 0 || stages <= 0) {
+            throw std::invalid_argument("Need at least one layer and one stage.");
+        }
+
+        const int used = std::min(stages, count);
+        for (int s = 0; s <= used; s++) {
+            bounds.push_back(s * count / used);
+        }
+        this->max_in_flight = max_in_flight > 0 ? max_in_flight : 2 * used;
+    }
+
+    // Getters
+    [[nodiscard]] int getStageCount() const { return static_cast<int>(bounds.size()) - 1; }
+    [[nodiscard]] int getMaxInFlight() const { return max_in_flight; }
+
+    // First layer of a stage, and one past its last layer
+    [[nodiscard]] std::pair<int, int> getStageRange(const int stage) const { return {bounds[stage], bounds[stage + 1]}; }
+
+    /**
+     * @brief Train on a sequence of samples, one micro-batch per sample.
+     *
+     * @param inputs Input tensor of each sample
+     * @param true_results Expected result of each sample
+     * @param learning_rate Learning rate
+     * @return T Sum of the errors of all samples
+    */
+    T train(const vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& true_results, const T learning_rate) {
+        if (endlayer == nullptr) {
+            throw std::invalid_argument("Training needs an end layer.");
+        }
+        if (inputs.size() != true_results.size()) {
+            throw std::invalid_argument("Need one true result per input.");
+        }
+        if (inputs.empty()) {
+            return 0;
+        }
+
+        vector<T> errors(inputs.size(), 0);
+        vector<vector<MatrixD>> results;
+        run(inputs, true_results, learning_rate, errors, results);
+
+        T total = 0;
+        for (const T error : errors) {
+            total += error;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Run a sequence of samples forward only.
+     *
+     * @param inputs Input tensor of each sample
+     * @return vector<vector<MatrixD>> Result of each sample
+    */
+    vector<vector<MatrixD>> predict(const vector<vector<MatrixD>>& inputs) {
+        vector<vector<MatrixD>> results(inputs.size());
+        if (inputs.empty()) {
+            return results;
+        }
+        vector<vector<MatrixD>> no_results;
+        vector<T> errors;
+        run(inputs, no_results, 0, errors, results);
+        return results;
+    }
+};
+
+}
+
+#endif // PIPELINE_PARALLEL_HPP
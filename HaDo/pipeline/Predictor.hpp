@@ -0,0 +1,174 @@
+#ifndef PREDICTOR_HPP
+#define PREDICTOR_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include "InferencePlan.hpp"
+#include "Pipeline.hpp"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Thread safe predictions from one shared, read-only set of weights.
+ *
+ * @details Wraps a frozen InferencePlan (see Pipeline::freeze) shared between
+ * every thread, and keeps one preallocated workspace per thread, so memory
+ * grows with the activations rather than with copies of the weights.
+ * predict() can be called from any thread, and predictBatch() spreads a
+ * batch over the predictor's threads with OpenMP.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class Predictor {
+private:
+
+    // Convenience typedefs
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+    typedef typename InferencePlan<T>::Workspace Workspace;
+
+    // Plan shared with every thread and with other predictors
+    std::shared_ptr<const InferencePlan<T>> plan;
+
+    // Number of threads for predictBatch
+    int threads;
+
+    // Workspaces for predictBatch, one per thread
+    vector<Workspace> workspaces;
+
+    // Workspaces not in use by predict, taken and returned under the lock
+    std::mutex pool_mutex;
+    vector<std::unique_ptr<Workspace>> pool;
+
+    // Take a free workspace, allocating one if none is free
+    std::unique_ptr<Workspace> acquire() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if (!pool.empty()) {
+                auto workspace = std::move(pool.back());
+                pool.pop_back();
+                return workspace;
+            }
+        }
+        return std::make_unique<Workspace>(plan->makeWorkspace());
+    }
+
+    // Give a workspace back for the next predict
+    void release(std::unique_ptr<Workspace> workspace) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        pool.push_back(std::move(workspace));
+    }
+
+public:
+
+    /**
+     * @brief Construct a predictor over a shared plan.
+     *
+     * @param plan Frozen plan, shared and never modified
+     * @param threads Threads for predictBatch, the hardware concurrency if 0 (optional)
+    */
+    explicit Predictor(std::shared_ptr<const InferencePlan<T>> plan, const int threads = 0)
+        : plan(std::move(plan))
+    {
+        if (!this->plan) {
+            throw std::invalid_argument("Predictor needs a plan.");
+        }
+        this->threads = threads > 0 ? threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        workspaces.reserve(this->threads);
+        for (int i = 0; i < this->threads; i++) {
+            workspaces.push_back(this->plan->makeWorkspace());
+        }
+    }
+
+    /**
+     * @brief Construct a predictor from the current weights of a pipeline.
+     * Later training of the pipeline does not change the predictor.
+     *
+     * @param pipeline Pipeline to freeze
+     * @param threads Threads for predictBatch, the hardware concurrency if 0 (optional)
+    */
+    explicit Predictor(Pipeline<T>& pipeline, const int threads = 0)
+        : Predictor(std::make_shared<const InferencePlan<T>>(pipeline.freeze()), threads) {}
+
+    // Not copyable, share the plan with getPlan() instead
+    Predictor(const Predictor&) = delete;
+    Predictor& operator=(const Predictor&) = delete;
+
+    // Getters
+    [[nodiscard]] int getThreadCount() const { return threads; }
+    [[nodiscard]] std::shared_ptr<const InferencePlan<T>> getPlan() const { return plan; }
+
+    /**
+     * @brief Predict one input. Safe to call from several threads at once.
+     *
+     * @param input Input tensor
+     * @return vector<MatrixD> Result
+    */
+    vector<MatrixD> predict(const vector<MatrixD>& input) {
+        std::unique_ptr<Workspace> workspace = acquire();
+        vector<MatrixD> res;
+        try {
+            res = plan->predict(input, *workspace);
+        } catch (...) {
+            release(std::move(workspace));
+            throw;
+        }
+        release(std::move(workspace));
+        return res;
+    }
+
+    /**
+     * @brief Predict a batch of inputs, spread over the predictor's threads.
+     * Not to be called from several threads at once on the same predictor.
+     *
+     * @param inputs Input tensor of each sample
+     * @return vector<vector<MatrixD>> Result of each sample
+    */
+    vector<vector<MatrixD>> predictBatch(const vector<vector<MatrixD>>& inputs) {
+        const int count = static_cast<int>(inputs.size());
+        vector<vector<MatrixD>> results(count);
+
+        #ifdef _OPENMP
+            std::exception_ptr failure;
+            #pragma omp parallel num_threads(threads) if(count > 1 && threads > 1)
+            {
+                Workspace& workspace = workspaces[omp_get_thread_num()];
+                #pragma omp for schedule(dynamic)
+                for (int i = 0; i < count; i++) {
+                    try {
+                        results[i] = plan->predict(inputs[i], workspace);
+                    } catch (...) {
+                        #pragma omp critical
+                        failure = std::current_exception();
+                    }
+                }
+            }
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+        #else
+            for (int i = 0; i < count; i++) {
+                results[i] = plan->predict(inputs[i], workspaces[0]);
+            }
+        #endif
+
+        return results;
+    }
+};
+
+}
+
+#endif // PREDICTOR_HPP
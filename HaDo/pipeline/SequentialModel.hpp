@@ -9,6 +9,10 @@
 #include "LayerVector.hpp"
 #include "Pipeline.hpp"
 #include <memory>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
 
 using std::vector;
 using std::pair;
@@ -43,6 +47,15 @@ private:
     vector<vector<MatrixD>> test_data;
     vector<vector<MatrixD>> test_results;
 
+    // Generator for shuffling the training data each epoch
+    std::mt19937 rng{std::random_device{}()};
+
+    // Data parallel replicas used by run_epochs, 1 for single threaded
+    int replicas = 1;
+
+    // Hogwild worker threads used by run_epochs, 1 for single threaded
+    int hogwild_threads = 1;
+
 public:
 
     /**
@@ -61,6 +74,9 @@ public:
         training_results = m.training_results;
         test_data = m.test_data;
         test_results = m.test_results;
+        rng = m.rng;
+        replicas = m.replicas;
+        hogwild_threads = m.hogwild_threads;
     }
 
     // Clone returning unique ptr
@@ -131,13 +147,73 @@ public:
     }
 
     /**
-     * @brief Run a number of epochs with a given learning rate.
+     * @brief Seed the generator used to shuffle the training data.
+     * 
+     * @param seed seed value
+    */
+    void set_seed(const unsigned int seed){
+        rng.seed(seed);
+    }
+
+    /**
+     * @brief Train with data parallel replicas on separate threads, each taking
+     * a share of every minibatch (see DataParallel). Used by run_epochs.
+     * 
+     * @param count number of replicas, 1 to train on a single thread
+    */
+    void set_data_parallel(const int count){
+        if (count < 1){
+            std::cerr << "Need at least 1 replica." << endl;
+            throw std::invalid_argument("Invalid number of replicas.");
+        }
+        replicas = count;
+    }
+
+    /**
+     * @brief Train asynchronously, with threads each taking a shard of the
+     * training data and updating the shared weights after every sample without
+     * locks (see Hogwild). Results then depend on thread timing. Used by
+     * run_epochs with a batch size of 1, and not together with set_data_parallel.
+     * Not for end layers with parameters (see Hogwild).
+     * 
+     * @param threads number of worker threads, 1 to train on a single thread
+    */
+    void set_hogwild(const int threads){
+        if (threads < 1){
+            std::cerr << "Need at least 1 thread." << endl;
+            throw std::invalid_argument("Invalid number of threads.");
+        }
+        if (threads > 1 && pipeline->getEndLayer().hasParameters()){
+            std::cerr << "Hogwild does not train end layers with parameters." << endl;
+            throw std::invalid_argument("End layer has parameters.");
+        }
+        hogwild_threads = threads;
+    }
+
+    /**
+     * @brief Run a number of epochs with a given learning rate. With a batch
+     * size above 1 the parameters are updated once per minibatch, by the mean
+     * gradient of its samples (see Pipeline::trainBatch), split across the
+     * replicas if set (see set_data_parallel). With Hogwild threads set
+     * (see set_hogwild), each thread trains on its shard of the epoch's order.
      * 
      * @param epochs number of epochs to run over data
      * @param learning_rate learning rate for model
      * @param to_print number of epochs to print error for. Default 100.
+     * @param batch_size samples per parameter update. Default 1.
+     * @param shuffle visit the training data in a new random order each epoch
+     * (see set_seed). Default false.
     */
-    void run_epochs(const int epochs, const T learning_rate, int to_print=100){
+    void run_epochs(const int epochs, const T learning_rate, int to_print=100,
+                    const int batch_size=1, const bool shuffle=false){
+        if (batch_size < 1){
+            std::cerr << "Batch size must be at least 1." << endl;
+            throw std::invalid_argument("Invalid batch size.");
+        }
+        if (hogwild_threads > 1 && (batch_size > 1 || replicas > 1)){
+            std::cerr << "Hogwild training updates per sample, without data parallel replicas." << endl;
+            throw std::invalid_argument("Hogwild needs a batch size of 1 and no replicas.");
+        }
         if(to_print < 0) to_print = 100;
         cout << "Running " << epochs << " epochs with learning rate ";
         cout << learning_rate << ":" << endl << endl;
@@ -146,17 +222,60 @@ public:
         const int print_factor = (to_print == 0) ? 2147483647 : epochs / to_print;
         const int n = training_data.size();
 
+        // Order of the samples, shuffled in place rather than the data itself
+        vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+
         // Run epochs
         for(int epoch = 1; epoch < epochs+1; epoch++){
+            HADO_TRACE_SPAN("epoch " + std::to_string(epoch), "train");
+
+            if (shuffle){
+                HADO_TRACE_SPAN("shuffle", "data");
+                std::shuffle(order.begin(), order.end(), rng);
+            }
+
             // Sum error for each piece of input data
             T cumulative_error = 0;
-            for(int i = 0; i < n; i++){
-                // Train model
-                cumulative_error += pipeline->trainPipeline(
-                    training_data[i],
-                    training_results[i],
-                    learning_rate
+            if (hogwild_threads > 1){
+                cumulative_error += pipeline->trainHogwild(
+                    training_data,
+                    training_results,
+                    order,
+                    learning_rate,
+                    hogwild_threads
                 );
+            } else if (replicas > 1){
+                cumulative_error += pipeline->trainDataParallel(
+                    training_data,
+                    training_results,
+                    order,
+                    batch_size,
+                    learning_rate,
+                    replicas
+                );
+            } else if (batch_size == 1){
+                for(int i = 0; i < n; i++){
+                    // Train model
+                    cumulative_error += pipeline->trainPipeline(
+                        training_data[order[i]],
+                        training_results[order[i]],
+                        learning_rate
+                    );
+                }
+            } else {
+                vector<size_t> batch;
+                batch.reserve(batch_size);
+                for(int start = 0; start < n; start += batch_size){
+                    // Train model on the next minibatch, the last may be smaller
+                    batch.assign(order.begin() + start, order.begin() + std::min(n, start + batch_size));
+                    cumulative_error += pipeline->trainBatch(
+                        training_data,
+                        training_results,
+                        batch,
+                        learning_rate
+                    );
+                }
             }
 
             // Print error average across singular epoch
@@ -198,6 +317,26 @@ public:
         return (cumulative_error / n);
     }
 
+    /**
+     * @brief Record wall time, calls and bytes of each layer's forward and
+     * backward from now on (see Profiler). Off by default.
+     * 
+     * @param enabled Whether to record
+    */
+    void set_profiling(const bool enabled){
+        pipeline->setProfiling(enabled);
+    }
+
+    /**
+     * @brief Print the per-layer profile recorded since profiling was enabled.
+     * 
+     * @param os Stream to print to. Defaults to cout.
+    */
+    void print_profile(std::ostream& os=cout){
+        os << "Layer profile:" << endl;
+        pipeline->getProfiler().print(os);
+    }
+
 };
 
 
@@ -0,0 +1,104 @@
+#ifndef ALIAS_SAMPLER_HPP
+#define ALIAS_SAMPLER_HPP
+
+#include <vector>
+#include <random>
+#include <iostream>
+#include <stdexcept>
+
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Draws class indices from a fixed discrete distribution in O(1) per
+ * sample with Vose's alias method. Building the table is O(n).
+ *
+ * @tparam T Probability type (float, double, long double) (optional)
+*/
+template<typename T=double>
+class AliasSampler {
+private:
+
+    // Probability of keeping bucket i rather than taking its alias
+    vector<T> keep;
+
+    // Class taken when bucket i is not kept
+    vector<int> alias;
+
+    // Normalised probability of each class
+    vector<T> probabilities;
+
+public:
+
+    /**
+     * @brief Build the alias table. Weights need not be normalised.
+     *
+     * @param weights Non-negative weight of each class, at least one positive
+    */
+    explicit AliasSampler(const vector<T>& weights) {
+        const int n = static_cast<int>(weights.size());
+        T total = 0;
+        for (const T w : weights){
+            if (w < 0){
+                throw std::invalid_argument("Sampling weights must be non-negative.");
+            }
+            total += w;
+        }
+        if (n == 0 || total <= 0){
+            throw std::invalid_argument("Sampling weights must have a positive sum.");
+        }
+
+        keep.resize(n);
+        alias.resize(n);
+        probabilities.resize(n);
+
+        // Scale so the average bucket holds exactly 1
+        vector<T> scaled(n);
+        vector<int> small, large;
+        for (int i = 0; i < n; i++){
+            probabilities[i] = weights[i] / total;
+            scaled[i] = probabilities[i] * n;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+
+        // Fill each small bucket up to 1 with mass from a large one
+        while (!small.empty() && !large.empty()){
+            const int s = small.back(); small.pop_back();
+            const int l = large.back(); large.pop_back();
+
+            keep[s] = scaled[s];
+            alias[s] = l;
+
+            scaled[l] -= 1 - scaled[s];
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+
+        // Whatever is left is full up to rounding
+        for (const int i : large){ keep[i] = 1; alias[i] = i; }
+        for (const int i : small){ keep[i] = 1; alias[i] = i; }
+    }
+
+    // Number of classes
+    [[nodiscard]] int size() const { return static_cast<int>(keep.size()); }
+
+    // Probability of drawing class i
+    [[nodiscard]] T probability(const int i) const { return probabilities[i]; }
+
+    /**
+     * @brief Draw one class index.
+     *
+     * @param rng Uniform random bit generator, i.e. std::mt19937
+    */
+    template<typename RNG>
+    int operator()(RNG& rng) const {
+        std::uniform_int_distribution<int> bucket(0, size() - 1);
+        std::uniform_real_distribution<T> coin(0, 1);
+        const int i = bucket(rng);
+        return coin(rng) < keep[i] ? i : alias[i];
+    }
+};
+
+}
+
+#endif // ALIAS_SAMPLER_HPP
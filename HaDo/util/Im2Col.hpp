@@ -0,0 +1,87 @@
+#ifndef IM2COL_HPP
+#define IM2COL_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Unfold the convolution windows of a tensor so a convolution becomes
+ * one matrix product with the filters packed by packFilters. Row y + x * outputRows
+ * holds the window of output position (y, x), zero where it covers padding.
+ *
+ * @param input Input tensor, one matrix per channel
+ * @param kernelSize Size of the square kernel
+ * @param stride Stride of the convolution
+ * @param padding Zero padding around each channel
+ * @param outputRows Rows of the convolution output
+ * @param outputCols Columns of the convolution output
+ * @param columns Unfolded windows, outputRows * outputCols x channels * kernelSize^2
+*/
+#pragma GCC push_options
+#pragma GCC optimize("O3")
+template<typename T>
+void im2col(const vector<Matrix<T, Dynamic, Dynamic>>& input, const int kernelSize, const int stride,
+            const int padding, const int outputRows, const int outputCols,
+            Matrix<T, Dynamic, Dynamic>& columns)
+{
+    const int channels = static_cast<int>(input.size());
+    const int window = kernelSize * kernelSize;
+    columns.resize(outputRows * outputCols, channels * window);
+
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        const auto& x = input[channel];
+        for (int kx = 0; kx < kernelSize; ++kx)
+        {
+            for (int ky = 0; ky < kernelSize; ++ky)
+            {
+                // Column of this kernel entry, in the order of the filter's own storage
+                auto column = columns.col(channel * window + kx * kernelSize + ky);
+                for (int ox = 0; ox < outputCols; ++ox)
+                {
+                    const int ix = ox * stride + kx - padding;
+                    for (int oy = 0; oy < outputRows; ++oy)
+                    {
+                        const int iy = oy * stride + ky - padding;
+                        column(oy + ox * outputRows) =
+                            (ix >= 0 && ix < x.cols() && iy >= 0 && iy < x.rows()) ? x(iy, ix) : T(0);
+                    }
+                }
+            }
+        }
+    }
+}
+#pragma GCC pop_options
+
+/**
+ * @brief Pack filters for im2col, one column per filter holding each channel's
+ * kernel in storage order.
+ *
+ * @param filters Filters, one kernelSize x kernelSize matrix per input channel
+ * @return Packed filters, channels * kernelSize^2 x filters
+*/
+template<typename T>
+Matrix<T, Dynamic, Dynamic> packFilters(const vector<vector<Matrix<T, Dynamic, Dynamic>>>& filters)
+{
+    const Eigen::Index window = filters[0][0].size();
+    Matrix<T, Dynamic, Dynamic> packed(filters[0].size() * window, filters.size());
+    for (size_t f = 0; f < filters.size(); ++f)
+    {
+        for (size_t channel = 0; channel < filters[f].size(); ++channel)
+        {
+            packed.col(f).segment(channel * window, window) =
+                Eigen::Map<const Matrix<T, Dynamic, 1>>(filters[f][channel].data(), window);
+        }
+    }
+    return packed;
+}
+
+}
+
+#endif // IM2COL_HPP
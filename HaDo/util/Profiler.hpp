@@ -0,0 +1,129 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstddef>
+
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Per-layer counters of a LayerVector, kept separately for forward
+ * (index 0) and backward (index 1).
+*/
+struct LayerProfile {
+    std::string name;
+    size_t calls[2] = {0, 0};
+    double seconds[2] = {0, 0};
+
+    // Bytes of the tensors the calls returned, each a fresh allocation
+    size_t bytes[2] = {0, 0};
+};
+
+/**
+ * @brief Wall time, call counts and bytes returned per layer and direction,
+ * recorded by LayerVector::forward and backward while enabled.
+ *
+ * @details Off by default, and then costs a single branch per layer call.
+ * Defining HADO_NO_PROFILING removes even that, and enable() has no effect.
+ * Recomputed forwards of checkpointed segments count as forward calls. Not
+ * thread safe, like the LayerVector it belongs to.
+*/
+class Profiler {
+private:
+
+    bool enabled = false;
+    vector<LayerProfile> layers;
+
+public:
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Directions of a layer call
+    enum Direction { FORWARD = 0, BACKWARD = 1 };
+
+    // Switch recording on or off, counters are kept
+    void enable(const bool on = true) {
+        #ifndef HADO_NO_PROFILING
+            enabled = on;
+        #else
+            (void) on;
+        #endif
+    }
+
+    [[nodiscard]] bool isEnabled() const { return enabled; }
+
+    // Drop every counter
+    void reset() { layers.clear(); }
+
+    [[nodiscard]] const vector<LayerProfile>& getLayers() const { return layers; }
+
+    /**
+     * @brief Add one layer call.
+     *
+     * @param layer Index of the layer
+     * @param name Name of the layer
+     * @param direction Forward or backward
+     * @param start Time the call started
+     * @param bytes Bytes of the tensor it returned
+    */
+    void record(const size_t layer, const std::string& name, const Direction direction,
+                const Clock::time_point start, const size_t bytes) {
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (layers.size() <= layer) {
+            layers.resize(layer + 1);
+        }
+        LayerProfile& profile = layers[layer];
+        profile.name = name;
+        profile.calls[direction]++;
+        profile.seconds[direction] += seconds;
+        profile.bytes[direction] += bytes;
+    }
+
+    /**
+     * @brief Print a table of the counters of each layer with totals.
+     *
+     * @param os Stream to print to (optional)
+    */
+    void print(std::ostream& os = std::cout) const {
+        double total_seconds[2] = {0, 0};
+        size_t total_bytes[2] = {0, 0};
+        for (const LayerProfile& profile : layers) {
+            for (int d = 0; d < 2; d++) {
+                total_seconds[d] += profile.seconds[d];
+                total_bytes[d] += profile.bytes[d];
+            }
+        }
+        const double total = total_seconds[0] + total_seconds[1];
+
+        os << std::left << std::setw(4) << "#" << std::setw(28) << "Layer" << std::right
+           << std::setw(9) << "Fwd" << std::setw(12) << "Fwd ms" << std::setw(14) << "Fwd bytes"
+           << std::setw(9) << "Bwd" << std::setw(12) << "Bwd ms" << std::setw(14) << "Bwd bytes"
+           << std::setw(8) << "%" << std::endl;
+        os << std::fixed << std::setprecision(3);
+        for (size_t i = 0; i < layers.size(); i++) {
+            const LayerProfile& profile = layers[i];
+            const double share = total > 0 ? 100 * (profile.seconds[0] + profile.seconds[1]) / total : 0;
+            os << std::left << std::setw(4) << i << std::setw(28) << profile.name << std::right
+               << std::setw(9) << profile.calls[0] << std::setw(12) << 1e3 * profile.seconds[0]
+               << std::setw(14) << profile.bytes[0]
+               << std::setw(9) << profile.calls[1] << std::setw(12) << 1e3 * profile.seconds[1]
+               << std::setw(14) << profile.bytes[1]
+               << std::setw(8) << std::setprecision(1) << share << std::setprecision(3) << std::endl;
+        }
+        os << std::left << std::setw(32) << "Total" << std::right
+           << std::setw(9) << "" << std::setw(12) << 1e3 * total_seconds[0] << std::setw(14) << total_bytes[0]
+           << std::setw(9) << "" << std::setw(12) << 1e3 * total_seconds[1] << std::setw(14) << total_bytes[1]
+           << std::endl;
+        os << std::defaultfloat << std::setprecision(6);
+    }
+};
+
+}
+
+#endif // PROFILER_HPP
@@ -0,0 +1,139 @@
+#ifndef SHARED_PARAMETERS_HPP
+#define SHARED_PARAMETERS_HPP
+
+#include <Eigen/Dense>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+using Eigen::Matrix;
+using Eigen::Dynamic;
+
+namespace hado {
+
+/**
+ * @brief Element access to parameters that several threads read and update
+ * at once without locks (see Layer::shareParameters).
+ *
+ * @details Every element is read and written with relaxed std::atomic_ref
+ * loads and stores, not a read-modify-write. So a reader may see a mix of old
+ * and new values, and two threads updating the same element at once may lose
+ * one of the updates, but each element stays a valid value and there is no
+ * undefined behaviour. Scalar types whose atomics are not lock free (long
+ * double on most targets) go through a mutex instead.
+ *
+ * @tparam T Data type (float for speed, double accuracy) (optional)
+*/
+template <typename T=float>
+class SharedParameters {
+private:
+
+    // Convenience typedef
+    typedef Matrix<T, Dynamic, Dynamic> MatrixD;
+
+    // Element updates are lock free for this scalar type
+    static constexpr bool lock_free = std::atomic_ref<T>::is_always_lock_free;
+
+    // Guards every access if they are not lock free
+    static std::mutex& mutex() {
+        static std::mutex m;
+        return m;
+    }
+
+public:
+
+    /**
+     * @brief Copy n shared elements into local storage.
+     *
+     * @param shared Shared elements
+     * @param local Private copy to overwrite
+     * @param n Number of elements
+    */
+    static void load(T* shared, T* local, const Eigen::Index n) {
+        if constexpr (lock_free) {
+            for (Eigen::Index i = 0; i < n; i++) {
+                local[i] = std::atomic_ref<T>(shared[i]).load(std::memory_order_relaxed);
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(mutex());
+            std::copy(shared, shared + n, local);
+        }
+    }
+
+    /**
+     * @brief Subtract scale times n values from the shared elements, skipping
+     * zero values so sparse gradients only touch what they reach.
+     *
+     * @param shared Shared elements
+     * @param values Values to subtract
+     * @param scale Factor on the values, i.e. the learning rate
+     * @param n Number of elements
+    */
+    static void subtract(T* shared, const T* values, const T scale, const Eigen::Index n) {
+        if constexpr (lock_free) {
+            for (Eigen::Index i = 0; i < n; i++) {
+                if (values[i] != 0) {
+                    std::atomic_ref<T> element(shared[i]);
+                    element.store(element.load(std::memory_order_relaxed) - scale * values[i],
+                                  std::memory_order_relaxed);
+                }
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(mutex());
+            for (Eigen::Index i = 0; i < n; i++) {
+                if (values[i] != 0) {
+                    shared[i] -= scale * values[i];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Copy in what an affine map (weights * input + bias) reads for
+     * input: the columns of the weights whose input rows are not all zero,
+     * and the bias. Other columns of the private weights keep older values.
+     *
+     * @param shared_weights Shared O x I weights
+     * @param shared_bias Shared O x 1 bias
+     * @param weights Private weights to update
+     * @param bias Private bias to overwrite
+     * @param input I x B input, one sample per column
+    */
+    static void loadAffine(MatrixD& shared_weights, MatrixD& shared_bias, MatrixD& weights, MatrixD& bias,
+                           const MatrixD& input) {
+        for (Eigen::Index j = 0; j < input.rows(); j++) {
+            if (!input.row(j).isZero(0)) {
+                load(shared_weights.col(j).data(), weights.col(j).data(), weights.rows());
+            }
+        }
+        load(shared_bias.data(), bias.data(), bias.size());
+    }
+
+    /**
+     * @brief Gradient descent step of the shared weights and bias of an affine
+     * map, by the gradient delta * input^T and the row sums of delta. Only the
+     * columns of the weights whose input rows are not all zero are touched.
+     *
+     * @param shared_weights Shared O x I weights
+     * @param shared_bias Shared O x 1 bias
+     * @param delta O x B gradient w.r.t. the affine result
+     * @param input I x B input of forward
+     * @param learning_rate Learning rate
+    */
+    static void subtractAffine(MatrixD& shared_weights, MatrixD& shared_bias, const MatrixD& delta,
+                               const MatrixD& input, const T learning_rate) {
+        MatrixD column;
+        for (Eigen::Index j = 0; j < input.rows(); j++) {
+            if (!input.row(j).isZero(0)) {
+                column.noalias() = delta * input.row(j).transpose();
+                subtract(shared_weights.col(j).data(), column.data(), learning_rate, column.size());
+            }
+        }
+        column = delta.rowwise().sum();
+        subtract(shared_bias.data(), column.data(), learning_rate, column.size());
+    }
+};
+
+}
+
+#endif // SHARED_PARAMETERS_HPP
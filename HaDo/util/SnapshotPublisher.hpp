@@ -0,0 +1,227 @@
+#ifndef SNAPSHOT_PUBLISHER_HPP
+#define SNAPSHOT_PUBLISHER_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Publishes immutable snapshots from one writer to many readers, e.g.
+ * InferencePlan weights from a training thread to serving threads.
+ *
+ * @details Read-copy-update with hazard pointers. The current snapshot is an
+ * atomic pointer, so a reader takes it with an atomic load and marks it in its
+ * hazard slot, and never waits on the writer. publish() swaps in the new
+ * snapshot and frees retired ones that no hazard slot holds. Snapshots still
+ * held are freed by a later publish() or reclaim().
+ *
+ * Each reading thread registers a Reader, which owns one hazard slot and so
+ * holds at most one snapshot at a time.
+ *
+ * @tparam Snapshot Type of snapshot, never modified once published
+*/
+template<typename Snapshot>
+class SnapshotPublisher {
+private:
+
+    // Published snapshot and its version, counted from 1 by publish
+    struct Entry {
+        std::unique_ptr<const Snapshot> snapshot;
+        uint64_t version;
+    };
+
+    // Hazard slot of one reader
+    struct Slot {
+        std::atomic<const Entry*> hazard{nullptr};
+        std::atomic<bool> used{false};
+
+        // Whether a guard of the owning reader is alive, touched by that reader only
+        bool guarded = false;
+    };
+
+    // Current entry
+    std::atomic<const Entry*> current{nullptr};
+
+    // Hazard slots, fixed so readers never allocate
+    std::unique_ptr<Slot[]> slots;
+    size_t max_readers;
+
+    // Replaced snapshots not freed yet, touched by the writer only
+    std::mutex writer_mutex;
+    vector<const Entry*> retired;
+
+    // Free the retired snapshots no reader holds, with writer_mutex held
+    void scan() {
+        vector<const Entry*> held;
+        for (size_t i = 0; i < max_readers; i++) {
+            if (const Entry* p = slots[i].hazard.load(std::memory_order_seq_cst)) {
+                held.push_back(p);
+            }
+        }
+
+        auto freed = std::partition(retired.begin(), retired.end(), [&](const Entry* p) {
+            return std::find(held.begin(), held.end(), p) != held.end();
+        });
+        for (auto it = freed; it != retired.end(); ++it) {
+            delete *it;
+        }
+        retired.erase(freed, retired.end());
+    }
+
+public:
+
+    /**
+     * @brief Access to a snapshot, which stays alive until the guard is
+     * destroyed. Empty if nothing has been published yet.
+    */
+    class Guard {
+    private:
+        const Entry* entry;
+        Slot* slot;
+
+    public:
+        Guard(const Entry* entry, Slot* slot) : entry(entry), slot(slot) {}
+
+        Guard(Guard&& other) noexcept : entry(other.entry), slot(other.slot) {
+            other.slot = nullptr;
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+
+        ~Guard() {
+            if (slot != nullptr) {
+                slot->hazard.store(nullptr, std::memory_order_release);
+                slot->guarded = false;
+            }
+        }
+
+        [[nodiscard]] const Snapshot* get() const { return entry ? entry->snapshot.get() : nullptr; }
+        [[nodiscard]] uint64_t getVersion() const { return entry ? entry->version : 0; }
+        const Snapshot& operator*() const { return *entry->snapshot; }
+        const Snapshot* operator->() const { return entry->snapshot.get(); }
+        explicit operator bool() const { return entry != nullptr; }
+    };
+
+    /**
+     * @brief Reading side for one thread, owning a hazard slot.
+    */
+    class Reader {
+    private:
+        SnapshotPublisher* publisher;
+        Slot* slot = nullptr;
+
+    public:
+        explicit Reader(SnapshotPublisher& publisher) : publisher(&publisher) {
+            for (size_t i = 0; i < publisher.max_readers; i++) {
+                bool expected = false;
+                if (publisher.slots[i].used.compare_exchange_strong(expected, true)) {
+                    slot = &publisher.slots[i];
+                    return;
+                }
+            }
+            throw std::runtime_error("No free reader slot, raise max_readers.");
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        ~Reader() {
+            slot->hazard.store(nullptr, std::memory_order_release);
+            slot->guarded = false;
+            slot->used.store(false, std::memory_order_release);
+        }
+
+        /**
+         * @brief Take the latest snapshot. Lock free, only retries if a new
+         * snapshot is published meanwhile. Throws if a guard of this reader
+         * is still alive, since its one hazard slot would stop protecting it.
+        */
+        Guard acquire() {
+            if (slot->guarded) {
+                throw std::logic_error("Reader already holds a guard, destroy it before acquiring again.");
+            }
+            slot->guarded = true;
+            const Entry* p = publisher->current.load(std::memory_order_acquire);
+            while (true) {
+                slot->hazard.store(p, std::memory_order_seq_cst);
+                const Entry* again = publisher->current.load(std::memory_order_seq_cst);
+                if (again == p) {
+                    break;
+                }
+                p = again;
+            }
+            return Guard(p, slot);
+        }
+    };
+
+    /**
+     * @brief Construct an empty publisher.
+     *
+     * @param max_readers Readers that can be registered at once (optional)
+    */
+    explicit SnapshotPublisher(const size_t max_readers = 64)
+        : slots(std::make_unique<Slot[]>(max_readers)), max_readers(max_readers) {}
+
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+    // Frees every snapshot, no reader may be left
+    ~SnapshotPublisher() {
+        delete current.load();
+        for (const Entry* p : retired) {
+            delete p;
+        }
+    }
+
+    /**
+     * @brief Make a snapshot the current one. Readers holding an older one keep
+     * it until their guard is destroyed.
+     *
+     * @param snapshot New snapshot
+     * @return uint64_t Version of the new snapshot
+    */
+    uint64_t publish(std::unique_ptr<const Snapshot> snapshot) {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        const Entry* latest = current.load(std::memory_order_relaxed);
+        const uint64_t published = latest ? latest->version + 1 : 1;
+
+        const Entry* old = current.exchange(new Entry{std::move(snapshot), published}, std::memory_order_seq_cst);
+        if (old != nullptr) {
+            retired.push_back(old);
+        }
+        scan();
+        return published;
+    }
+
+    // Free retired snapshots no reader holds any more
+    void reclaim() {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        scan();
+    }
+
+    // Version of the current snapshot, 0 before the first publish
+    [[nodiscard]] uint64_t getVersion() const {
+        const Entry* latest = current.load(std::memory_order_acquire);
+        return latest ? latest->version : 0;
+    }
+
+    // Snapshots replaced but not freed yet
+    [[nodiscard]] size_t getRetiredCount() {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        return retired.size();
+    }
+};
+
+}
+
+#endif // SNAPSHOT_PUBLISHER_HPP
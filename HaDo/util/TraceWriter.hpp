@@ -0,0 +1,261 @@
+#ifndef TRACE_WRITER_HPP
+#define TRACE_WRITER_HPP
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <json/json.hpp>
+
+using std::vector;
+
+namespace hado {
+
+/**
+ * @brief Collects timed spans from every thread and writes them as a Chrome
+ * trace event file, which chrome://tracing and Perfetto show as a timeline
+ * with one track per thread.
+ *
+ * @details One process-wide writer, see global(). Recording is off until
+ * start(), and a span then costs one atomic load. Each thread records into
+ * its own buffer, registered with the writer on first use, so threads never
+ * contend while recording, and toJson() merges the buffers. Defining HADO_NO_TRACING
+ * removes HADO_TRACE_SPAN spans entirely. Spans are recorded by layer forward
+ * and backward (LayerVector), inference plan steps, the OpenMP loops of
+ * ActivationLayer and MaxPoolLayer, pipeline parallel stages, dynamic
+ * batches and training steps.
+*/
+class TraceWriter {
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    // One complete ("X") event
+    struct Event {
+        std::string name;
+        const char* category;
+        double start;
+        double duration;
+        int thread;
+    };
+
+    std::atomic<bool> enabled{false};
+
+    // Clock ticks at start(), atomic as spans read it from any thread
+    std::atomic<Clock::rep> origin{Clock::now().time_since_epoch().count()};
+
+    // Events of one thread. The lock is only contended while the writer reads
+    struct ThreadBuffer {
+        std::mutex mutex;
+        vector<Event> events;
+    };
+
+    // Buffers of every thread that recorded, shared with the threads' own lists
+    std::mutex mutex;
+    vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+    // Distinguishes writers in the per-thread lists, addresses may be reused
+    const uint64_t id = nextId();
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> next{0};
+        return next++;
+    }
+
+    // Buffer of the calling thread, registered on its first span
+    ThreadBuffer& buffer() {
+        thread_local vector<std::pair<uint64_t, std::shared_ptr<ThreadBuffer>>> owned;
+        for (const auto& [writer, owned_buffer] : owned) {
+            if (writer == id) {
+                return *owned_buffer;
+            }
+        }
+        auto created = std::make_shared<ThreadBuffer>();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(created);
+        }
+        owned.emplace_back(id, created);
+        return *created;
+    }
+
+    // Small id of the calling thread, numbered in order of first use
+    static int threadId() {
+        static std::atomic<int> next{0};
+        thread_local const int id = next++;
+        return id;
+    }
+
+public:
+
+    // Process-wide writer
+    static TraceWriter& global() {
+        static TraceWriter writer;
+        return writer;
+    }
+
+    // Drop recorded events and start recording, times count from now
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& thread_buffer : buffers) {
+            std::lock_guard<std::mutex> buffer_lock(thread_buffer->mutex);
+            thread_buffer->events.clear();
+        }
+        // Buffers only the writer holds belong to threads that have exited
+        std::erase_if(buffers, [](const auto& thread_buffer){ return thread_buffer.use_count() == 1; });
+        origin.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        enabled.store(true, std::memory_order_release);
+    }
+
+    // Stop recording, keeping the events
+    void stop() {
+        enabled.store(false, std::memory_order_release);
+    }
+
+    [[nodiscard]] bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Microseconds since start()
+    [[nodiscard]] double now() const {
+        const Clock::duration elapsed(Clock::now().time_since_epoch().count() - origin.load(std::memory_order_relaxed));
+        return std::chrono::duration<double, std::micro>(elapsed).count();
+    }
+
+    /**
+     * @brief Record a span of the calling thread.
+     *
+     * @param name Name shown on the span
+     * @param category Category, a string literal
+     * @param start Start in microseconds, from now()
+    */
+    void record(std::string name, const char* category, const double start) {
+        const double end = now();
+        const int thread = threadId();
+        ThreadBuffer& own = buffer();
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.events.push_back({std::move(name), category, start, end - start, thread});
+    }
+
+    [[nodiscard]] size_t getEventCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (const auto& thread_buffer : buffers) {
+            std::lock_guard<std::mutex> buffer_lock(thread_buffer->mutex);
+            count += thread_buffer->events.size();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Trace event JSON of the recorded spans of all threads, with a
+     * name per thread.
+    */
+    nlohmann::json toJson() {
+        std::lock_guard<std::mutex> lock(mutex);
+        nlohmann::json trace;
+        trace["displayTimeUnit"] = "ms";
+        trace["traceEvents"] = nlohmann::json::array();
+
+        int threads = 0;
+        for (const auto& thread_buffer : buffers) {
+            std::lock_guard<std::mutex> buffer_lock(thread_buffer->mutex);
+            for (const Event& event : thread_buffer->events) {
+                trace["traceEvents"].push_back({
+                    {"name", event.name}, {"cat", event.category}, {"ph", "X"},
+                    {"ts", event.start}, {"dur", event.duration}, {"pid", 1}, {"tid", event.thread}
+                });
+                threads = std::max(threads, event.thread + 1);
+            }
+        }
+        for (int t = 0; t < threads; t++) {
+            trace["traceEvents"].push_back({
+                {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", t},
+                {"args", {{"name", "thread " + std::to_string(t)}}}
+            });
+        }
+        return trace;
+    }
+
+    /**
+     * @brief Write the recorded spans to a trace file.
+     *
+     * @param path File to write, e.g. trace.json
+    */
+    void write(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "Cannot open " << path << " for writing." << std::endl;
+            throw std::runtime_error("Cannot write trace file.");
+        }
+        file << toJson().dump();
+    }
+};
+
+/**
+ * @brief Span from construction to destruction, recorded if tracing is on
+ * when it starts.
+*/
+class TraceSpan {
+private:
+    std::string name;
+    const char* category;
+    double start = -1;
+
+public:
+    TraceSpan(const std::string_view name, const char* category) : category(category) {
+        TraceWriter& writer = TraceWriter::global();
+        if (writer.isEnabled()) {
+            this->name = name;
+            start = writer.now();
+        }
+    }
+
+    /**
+     * @brief Span named by calling name(), only if tracing is on, so building
+     * the name costs nothing otherwise. Used by HADO_TRACE_SPAN.
+    */
+    template<typename Name> requires std::is_invocable_v<Name&>
+    TraceSpan(const char* category, Name&& name) : category(category) {
+        TraceWriter& writer = TraceWriter::global();
+        if (writer.isEnabled()) {
+            this->name = name();
+            start = writer.now();
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        if (start >= 0) {
+            TraceWriter::global().record(std::move(name), category, start);
+        }
+    }
+};
+
+}
+
+#define HADO_TRACE_CONCAT_INNER(a, b) a##b
+#define HADO_TRACE_CONCAT(a, b) HADO_TRACE_CONCAT_INNER(a, b)
+
+// Trace the rest of the enclosing scope as a span, name is only evaluated when tracing
+#ifndef HADO_NO_TRACING
+    #define HADO_TRACE_SPAN(name, category) \
+        hado::TraceSpan HADO_TRACE_CONCAT(hado_trace_span_, __LINE__)( \
+            category, [&]() -> std::string { return name; })
+#else
+    #define HADO_TRACE_SPAN(name, category) do {} while (0)
+#endif
+
+#endif // TRACE_WRITER_HPP
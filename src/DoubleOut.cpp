@@ -30,12 +30,9 @@ void doubleOutModel() {
         DenseLayer(4, 2)
     );
 
-    pipeline.pushLayer(
-        SoftmaxLayer(2)
-    );
-    
+    // Softmax is applied by the loss, the network outputs logits
     pipeline.pushEndLayer(
-        CrossEntropyLoss(2)
+        SoftmaxCrossEntropyLoss(2)
     );
 
     // Instantiate model and add training and test data
@@ -5,20 +5,14 @@ using namespace hado;
 void TwoCategoryMNIST(){
     Pipeline<double> pipeline;
 
+    // Convolution -> ReLU -> max pool, fused so the 26x26 feature maps are never stored
     pipeline.pushLayer(
-        ConvolutionalLayer<double, relu<double>, relu_prime<double>>(1, 2, 28, 28, 3, 1, 0)
+        ConvolutionalMaxPoolLayer<double, relu<double>, relu_prime<double>>(1, 2, 28, 28, 3, 1, 0, 2, 2)
     );
 
+    // Convolution (13x13 -> 10x10) -> ReLU -> max pool (10x10 -> 3x3)
     pipeline.pushLayer(
-        MaxPoolLayer<double>(2, 26, 26, 2, 2, 0)
+        ConvolutionalMaxPoolLayer<double, relu<double>, relu_prime<double>>(2, 1, 13, 13, 4, 1, 0, 3, 3)
     );
 
-    pipeline.pushLayer(
-        ConvolutionalLayer<double, relu<double>, relu_prime<double>>(2, 1, 13, 13, 4, 1, 0)
-    );
-    
-    pipeline.pushLayer(
-        MaxPoolLayer<double>(2, 9, 9, 3, 3, 0)
-    );
-
-}
\ No newline at end of file
+}
@@ -0,0 +1,78 @@
+#include <HaDo/DeepNeuralNetwork>
+#include <HaDo/pipeline/InferenceServer.hpp>
+#include <csignal>
+#include <cstdlib>
+#include <pthread.h>
+using std::cout, std::cerr, std::endl, std::string;
+using MatrixD = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic>;
+
+using namespace hado;
+
+/**
+ * Inference server example. Trains a small XOR model and serves it on a Unix
+ * socket until interrupted, batching concurrent requests.
+ *
+ * Usage: inference_server [--socket PATH] [--max-batch N] [--max-latency-us N]
+*/
+int main(int argc, char** argv) {
+    string path = "/tmp/hado.sock";
+    int max_batch = 32;
+    long max_latency = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (i + 1 < argc && arg == "--socket") {
+            path = argv[++i];
+        } else if (i + 1 < argc && arg == "--max-batch") {
+            max_batch = std::atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "--max-latency-us") {
+            max_latency = std::atol(argv[++i]);
+        } else {
+            cerr << "Usage: " << argv[0] << " [--socket PATH] [--max-batch N] [--max-latency-us N]" << endl;
+            return 1;
+        }
+    }
+
+    // Block the stop signals in every thread, main waits for them below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    Pipeline<float> pipeline;
+    pipeline.pushLayer(DenseLayer<>(2, 8));
+    pipeline.pushLayer(ActivationLayer<f_tanh<>, f_tanh_prime<>>(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<>(8, 1));
+    pipeline.pushLayer(ActivationLayer<f_tanh<>, f_tanh_prime<>>(1, 1, 1));
+    pipeline.pushEndLayer(MeanSquaredError<>(1, 1, 1));
+
+    const float xs[4][3] = {{0, 0, 0}, {0, 1, 1}, {1, 0, 1}, {1, 1, 0}};
+    for (int epoch = 0; epoch < 2000; epoch++) {
+        for (const auto& x : xs) {
+            vector<MatrixD> input = {MatrixD(2, 1)};
+            input[0] << x[0], x[1];
+            vector<MatrixD> target = {MatrixD::Constant(1, 1, x[2])};
+            pipeline.trainPipeline(input, target, 0.05f);
+        }
+    }
+
+    try {
+        InferenceServer<float> server(std::make_shared<const InferencePlan<float>>(pipeline.freeze()),
+                                      path, max_batch, std::chrono::microseconds(max_latency));
+        server.start();
+        cout << "Serving on " << path << " (max batch " << max_batch
+             << ", max latency " << max_latency << "us)" << endl;
+
+        int received;
+        sigwait(&signals, &received);
+
+        server.stop();
+        cout << "Served " << server.getBatcher().getRequestCount() << " requests in "
+             << server.getBatcher().getBatchCount() << " batches" << endl;
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -246,6 +246,51 @@ TEST(TANH, TANHP_NEGATIVE) {
     EXPECT_NEAR(result_d, expected_d, TOLERANCE);    
 }
 
+// ---------- PACKET ---------- //
+
+// Runs the functor through Eigen's vectorised unaryExpr path and compares
+// every element against the scalar operator()
+template<typename Functor, typename T>
+void expectPacketMatchesScalar(T tolerance) {
+    constexpr int n = 4001;
+    Eigen::Array<T, Eigen::Dynamic, 1> x = Eigen::Array<T, Eigen::Dynamic, 1>::LinSpaced(n, -20, 20);
+    Eigen::Array<T, Eigen::Dynamic, 1> res = x.unaryExpr(Functor());
+    for (int i = 0; i < n; i++) {
+        EXPECT_NEAR(res(i), Functor()(x(i)), tolerance) << "at x = " << x(i);
+    }
+}
+
+TEST(PACKET, PACKET_ACCESS) {
+    EXPECT_TRUE(Eigen::internal::functor_traits<relu<float>>::PacketAccess);
+    EXPECT_TRUE(Eigen::internal::functor_traits<relu_prime<double>>::PacketAccess);
+    EXPECT_TRUE(Eigen::internal::functor_traits<sigmoid<float>>::PacketAccess);
+    EXPECT_TRUE(Eigen::internal::functor_traits<sigmoid_prime<double>>::PacketAccess);
+    EXPECT_TRUE(Eigen::internal::functor_traits<f_tanh<float>>::PacketAccess);
+    EXPECT_TRUE(Eigen::internal::functor_traits<f_tanh_prime<double>>::PacketAccess);
+    EXPECT_FALSE(Eigen::internal::functor_traits<f_tanh<long double>>::PacketAccess);
+}
+
+TEST(PACKET, RELU_PACKET) {
+    expectPacketMatchesScalar<relu<float>, float>(0);
+    expectPacketMatchesScalar<relu<double>, double>(0);
+    expectPacketMatchesScalar<relu_prime<float>, float>(0);
+    expectPacketMatchesScalar<relu_prime<double>, double>(0);
+}
+
+TEST(PACKET, SIGMOID_PACKET) {
+    expectPacketMatchesScalar<sigmoid<float>, float>(1e-6f);
+    expectPacketMatchesScalar<sigmoid<double>, double>(1e-14);
+    expectPacketMatchesScalar<sigmoid_prime<float>, float>(1e-6f);
+    expectPacketMatchesScalar<sigmoid_prime<double>, double>(1e-14);
+}
+
+TEST(PACKET, TANH_PACKET) {
+    expectPacketMatchesScalar<f_tanh<float>, float>(1e-6f);
+    expectPacketMatchesScalar<f_tanh<double>, double>(1e-14);
+    expectPacketMatchesScalar<f_tanh_prime<float>, float>(1e-6f);
+    expectPacketMatchesScalar<f_tanh_prime<double>, double>(1e-14);
+}
+
 int main(int argc, char **argv) 
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <HaDo/base/ActivationFunctions.hpp>
+#include <limits>
+
+using namespace hado;
+
+// Sweep range and step, covering both saturated tails
+constexpr double SWEEP_LIMIT = 40;
+constexpr double SWEEP_STEP = 1e-4;
+
+// Extra inputs far outside the sweep
+constexpr double EXTREMES[] = {-1e30, -1e6, -1e3, 1e3, 1e6, 1e30};
+
+/**
+ * Checks the documented max_error of an approximation against a reference
+ * over the whole sweep, through both the scalar and the vectorised path.
+*/
+template<typename Functor, typename T, typename Reference>
+void expectBoundedError(Reference reference) {
+    const double bound = Functor::max_error;
+    const int n = static_cast<int>(2 * SWEEP_LIMIT / SWEEP_STEP) + 1;
+
+    Eigen::Array<T, Eigen::Dynamic, 1> x(n);
+    for (int i = 0; i < n; i++) {
+        x(i) = static_cast<T>(-SWEEP_LIMIT + i * SWEEP_STEP);
+    }
+    Eigen::Array<T, Eigen::Dynamic, 1> packet = x.unaryExpr(Functor());
+
+    double worst = 0;
+    for (int i = 0; i < n; i++) {
+        const double expected = reference(static_cast<double>(x(i)));
+        worst = std::max(worst, std::abs(Functor()(x(i)) - expected));
+        worst = std::max(worst, std::abs(packet(i) - expected));
+    }
+    for (double e : EXTREMES) {
+        worst = std::max(worst, std::abs(Functor()(static_cast<T>(e)) - reference(e)));
+    }
+
+    EXPECT_LE(worst, bound);
+}
+
+double tanh_ref(double x) { return std::tanh(x); }
+double tanh_prime_ref(double x) { return 1 - std::tanh(x) * std::tanh(x); }
+double sigmoid_ref(double x) { return 1 / (1 + std::exp(-x)); }
+double sigmoid_prime_ref(double x) { return sigmoid_ref(x) * (1 - sigmoid_ref(x)); }
+
+// ---------- TANH ---------- //
+
+TEST(FAST_TANH, ERROR_BOUND) {
+    expectBoundedError<fast_tanh<float>, float>(tanh_ref);
+    expectBoundedError<fast_tanh<double>, double>(tanh_ref);
+}
+
+TEST(FAST_TANH, PRIME_ERROR_BOUND) {
+    expectBoundedError<fast_tanh_prime<float>, float>(tanh_prime_ref);
+    expectBoundedError<fast_tanh_prime<double>, double>(tanh_prime_ref);
+}
+
+TEST(FAST_TANH, ODD_AND_SATURATED) {
+    fast_tanh<double> f;
+    EXPECT_EQ(f(0.0), 0.0);
+    EXPECT_EQ(f(-1.5), -f(1.5));
+    EXPECT_EQ(f(1e300), f(fast_tanh<double>::clamp));
+    EXPECT_TRUE(std::isnan(f(std::numeric_limits<double>::quiet_NaN())));
+}
+
+// ---------- SIGMOID ---------- //
+
+TEST(FAST_SIGMOID, ERROR_BOUND) {
+    expectBoundedError<fast_sigmoid<float>, float>(sigmoid_ref);
+    expectBoundedError<fast_sigmoid<double>, double>(sigmoid_ref);
+}
+
+TEST(FAST_SIGMOID, PRIME_ERROR_BOUND) {
+    expectBoundedError<fast_sigmoid_prime<float>, float>(sigmoid_prime_ref);
+    expectBoundedError<fast_sigmoid_prime<double>, double>(sigmoid_prime_ref);
+}
+
+TEST(PWL_SIGMOID, ERROR_BOUND) {
+    expectBoundedError<pwl_sigmoid<float>, float>(sigmoid_ref);
+    expectBoundedError<pwl_sigmoid<double>, double>(sigmoid_ref);
+}
+
+TEST(PWL_SIGMOID, PRIME_ERROR_BOUND) {
+    expectBoundedError<pwl_sigmoid_prime<float>, float>(sigmoid_prime_ref);
+    expectBoundedError<pwl_sigmoid_prime<double>, double>(sigmoid_prime_ref);
+}
+
+// ---------- EXP ---------- //
+
+template<typename T>
+void expectBoundedRelativeError(double lo, double hi) {
+    fast_exp<T> f;
+    double worst = 0;
+    for (double x = lo; x <= hi; x += 1e-3) {
+        const double expected = std::exp(static_cast<double>(static_cast<T>(x)));
+        worst = std::max(worst, std::abs(f(static_cast<T>(x)) - expected) / expected);
+    }
+    EXPECT_LE(worst, fast_exp<T>::max_relative_error);
+}
+
+TEST(FAST_EXP, RELATIVE_ERROR_BOUND) {
+    // Range where the result is a normal number
+    expectBoundedRelativeError<float>(-87, 88.7);
+    expectBoundedRelativeError<double>(-708, 709.7);
+}
+
+TEST(FAST_EXP, CLAMPED_OUTSIDE_RANGE) {
+    fast_exp<float> f;
+    EXPECT_TRUE(std::isfinite(f(1000.f)));
+    EXPECT_GE(f(-1000.f), 0.f);
+    EXPECT_LE(f(-1000.f), std::numeric_limits<float>::min() * 2);
+    EXPECT_TRUE(std::isnan(f(std::numeric_limits<float>::quiet_NaN())));
+}
+
+// ---------- EXACT FUNCTORS ---------- //
+
+TEST(EXACT_FUNCTORS, UNAFFECTED_BY_APPROXIMATIONS) {
+    for (double x : {-7., -0.3, 0., 0.8, 5.}) {
+        EXPECT_DOUBLE_EQ(sigmoid<double>()(x), 1 / (1 + std::exp(-x)));
+        EXPECT_DOUBLE_EQ(f_tanh<double>()(x), std::tanh(x));
+    }
+
+    // Approximations are picked per use, as template arguments
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(64, -6, 6);
+    Eigen::ArrayXd res = x.unaryExpr(fast_sigmoid<double>());
+    for (int i = 0; i < x.size(); i++) {
+        EXPECT_NEAR(res(i), fast_sigmoid<double>()(x(i)), 1e-15);
+        EXPECT_NEAR(res(i), sigmoid<double>()(x(i)), fast_sigmoid<double>::max_error);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+TEST(TREE, BALANCED_PATHS) {
+    const HierarchicalSoftmaxLoss<double> loss(4, 1024);
+    for (int c = 0; c < 1024; ++c) {
+        ASSERT_EQ(loss.getPath(c).size(), 10u);
+    }
+}
+
+TEST(TREE, FREQUENT_CLASSES_HAVE_SHORT_PATHS) {
+    const HierarchicalSoftmaxLoss<double> loss(4, 5, {100, 1, 1, 1, 1});
+    ASSERT_EQ(loss.getPath(0).size(), 1u);
+    for (int c = 1; c < 5; ++c) {
+        ASSERT_EQ(loss.getPath(c).size(), 3u);
+    }
+}
+
+TEST(FORWARD_BACKWARD, PROBABILITIES_MATCH_LOSS) {
+    HierarchicalSoftmaxLoss<double> loss(5, 37);
+
+    vector<MatrixD> hidden = {MatrixD::Random(5, 1)};
+    const MatrixD probabilities = loss.predict(hidden)[0];
+
+    ASSERT_NEAR(probabilities.sum(), 1, 1e-12);
+    for (int c = 0; c < 37; ++c) {
+        vector<MatrixD> label = {MatrixD::Constant(1, 1, c)};
+        ASSERT_NEAR(loss.forward(hidden, label), -std::log(probabilities(c, 0)), 1e-10);
+    }
+}
+
+TEST(FORWARD_BACKWARD, GRADIENT_MATCHES_FINITE_DIFFERENCE) {
+    HierarchicalSoftmaxLoss<double> loss(6, 50);
+
+    vector<MatrixD> hidden = {MatrixD::Random(6, 1)};
+    vector<MatrixD> label = {MatrixD::Zero(50, 1)};
+    label[0](17, 0) = 1;
+
+    auto grad = loss.backward(hidden, label);
+
+    const double eps = 1e-6;
+    for (int i = 0; i < 6; ++i) {
+        vector<MatrixD> plus = hidden, minus = hidden;
+        plus[0](i, 0) += eps;
+        minus[0](i, 0) -= eps;
+        const double numeric = (loss.forward(plus, label) - loss.forward(minus, label)) / (2 * eps);
+        EXPECT_NEAR(grad[0](i, 0), numeric, 1e-7);
+    }
+}
+
+TEST(FORWARD_BACKWARD, TRAINING_LEARNS_CLASSES) {
+    // Every inner node needs a linear split of its classes, so keep hidden large enough
+    const int hidden = 64, classes = 100;
+    HierarchicalSoftmaxLoss<double> loss(hidden, classes);
+
+    vector<MatrixD> inputs;
+    for (int c = 0; c < classes; ++c) {
+        inputs.push_back(MatrixD::Random(hidden, 1));
+    }
+
+    for (int epoch = 0; epoch < 100; ++epoch) {
+        for (int c = 0; c < classes; ++c) {
+            vector<MatrixD> res = {inputs[c]};
+            vector<MatrixD> label = {MatrixD::Constant(1, 1, c)};
+            std::ignore = loss.backward(res, label, 0.1);
+        }
+    }
+
+    int correct = 0;
+    for (int c = 0; c < classes; ++c) {
+        int k;
+        loss.predict({inputs[c]})[0].col(0).maxCoeff(&k);
+        correct += (k == c);
+    }
+    EXPECT_GT(correct, classes * 0.8);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
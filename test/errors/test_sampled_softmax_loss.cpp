@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+TEST(FORWARD_BACKWARD, GRADIENT_MATCHES_FINITE_DIFFERENCE) {
+    SampledSoftmaxLoss<double> loss(6, 40, 5, {}, 3);
+
+    vector<MatrixD> hidden = {MatrixD::Random(6, 1)};
+    vector<MatrixD> label = {MatrixD::Constant(1, 1, 11)};
+
+    // Copies share the generator state, so each draws the same negatives
+    const SampledSoftmaxLoss<double> start = loss;
+    std::ignore = loss.forward(hidden, label);
+    auto grad = loss.backward(hidden, label, 0);
+
+    const double eps = 1e-6;
+    for (int i = 0; i < 6; ++i) {
+        vector<MatrixD> plus = hidden, minus = hidden;
+        plus[0](i, 0) += eps;
+        minus[0](i, 0) -= eps;
+        SampledSoftmaxLoss<double> a = start, b = start;
+        const double numeric = (a.forward(plus, label) - b.forward(minus, label)) / (2 * eps);
+        EXPECT_NEAR(grad[0](i, 0), numeric, 1e-7);
+    }
+}
+
+TEST(FORWARD_BACKWARD, BACKWARD_SEES_EDITED_HIDDEN) {
+    SampledSoftmaxLoss<double> loss(6, 40, 5, {}, 3);
+
+    vector<MatrixD> hidden = {MatrixD::Random(6, 1)};
+    vector<MatrixD> label = {MatrixD::Constant(1, 1, 11)};
+
+    // Negatives come from forward, logits from the hidden vector backward is given
+    SampledSoftmaxLoss<double> reference = loss;
+    std::ignore = loss.forward(hidden, label);
+    hidden[0] *= 2;
+    auto grad = loss.backward(hidden, label, 0);
+
+    std::ignore = reference.forward(hidden, label);
+    auto expected = reference.backward(hidden, label, 0);
+    ASSERT_LT((grad[0] - expected[0]).norm(), 1e-12);
+}
+
+TEST(FORWARD_BACKWARD, ALL_CLASSES_SAMPLED_FROM_ONE) {
+    // With a single other class every negative is that class
+    SampledSoftmaxLoss<double> loss(3, 2, 4, {}, 1);
+
+    vector<MatrixD> hidden = {MatrixD::Random(3, 1)};
+    vector<MatrixD> one_hot = {MatrixD::Zero(2, 1)};
+    one_hot[0](0, 0) = 1;
+
+    const double value = loss.forward(hidden, one_hot);
+    ASSERT_TRUE(std::isfinite(value));
+    ASSERT_GT(value, 0);
+}
+
+TEST(FORWARD_BACKWARD, TRAINING_LEARNS_CLASSES) {
+    const int hidden = 8, classes = 200;
+    SampledSoftmaxLoss<double> loss(hidden, classes, 10, {}, 5);
+
+    // One fixed hidden vector per class
+    vector<MatrixD> inputs;
+    for (int c = 0; c < classes; ++c) {
+        inputs.push_back(MatrixD::Random(hidden, 1));
+    }
+
+    for (int epoch = 0; epoch < 200; ++epoch) {
+        for (int c = 0; c < classes; ++c) {
+            vector<MatrixD> res = {inputs[c]};
+            vector<MatrixD> label = {MatrixD::Constant(1, 1, c)};
+            std::ignore = loss.forward(res, label);
+            std::ignore = loss.backward(res, label, 0.1);
+        }
+    }
+
+    int correct = 0;
+    for (int c = 0; c < classes; ++c) {
+        int k;
+        loss.predict({inputs[c]})[0].col(0).maxCoeff(&k);
+        correct += (k == c);
+    }
+    EXPECT_GT(correct, classes * 0.8);
+}
+
+TEST(FORWARD_BACKWARD, TEST_LOSS_IS_FULL_SOFTMAX) {
+    SampledSoftmaxLoss<double> loss(4, 12, 3, {}, 5);
+
+    vector<MatrixD> hidden = {MatrixD::Random(4, 1)};
+    vector<MatrixD> label = {MatrixD::Constant(1, 1, 7)};
+
+    const MatrixD probabilities = loss.predict(hidden)[0];
+    ASSERT_NEAR(probabilities.sum(), 1, 1e-12);
+    ASSERT_NEAR(loss.testForward(hidden, label), -std::log(probabilities(7, 0)), 1e-10);
+}
+
+TEST(PIPELINE, PREDICT_AND_TEST_THROUGH_END_LAYER) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 4));
+    pipeline.pushEndLayer(SampledSoftmaxLoss<double>(4, 12, 3, {}, 5));
+
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    vector<MatrixD> label = {MatrixD::Constant(1, 1, 7)};
+    std::ignore = pipeline.trainPipeline(input, label, 0.1);
+
+    // The trained projection is reachable, and predict and test use its full softmax
+    auto& loss = dynamic_cast<SampledSoftmaxLoss<double>&>(pipeline.getEndLayer());
+    const MatrixD probabilities = pipeline.predictPipeline(input)[0];
+    ASSERT_EQ(probabilities.rows(), 12);
+    ASSERT_NEAR(probabilities.sum(), 1, 1e-12);
+
+    const auto [error, result] = pipeline.testPipeline(input, label);
+    ASSERT_NEAR(error, -std::log(probabilities(7, 0)), 1e-10);
+    ASSERT_LT((result[0] - probabilities).norm(), 1e-12);
+    ASSERT_EQ(loss.getClasses(), 12);
+}
+
+TEST(FORWARD_BACKWARD, INCORRECT_LABELS) {
+    SampledSoftmaxLoss<double> loss(4, 10, 3);
+
+    vector<MatrixD> hidden = {MatrixD::Random(4, 1)};
+    vector<MatrixD> out_of_range = {MatrixD::Constant(1, 1, 10)};
+    vector<MatrixD> wrong_rows = {MatrixD::Zero(4, 1)};
+
+    EXPECT_ANY_THROW({
+        loss.forward(hidden, out_of_range);
+    });
+
+    EXPECT_ANY_THROW({
+        loss.forward(hidden, wrong_rows);
+    });
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
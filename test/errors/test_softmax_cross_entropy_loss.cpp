@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+TEST(CONSTRUCTOR, Check_Too_Few_Classes) {
+    EXPECT_DEATH({
+        SoftmaxCrossEntropyLoss<double> x(1);
+    }, "");
+}
+
+TEST(FORWARD_BACKWARD, MATCHES_SOFTMAX_THEN_CROSS_ENTROPY) {
+    const int R = 6;
+    SoftmaxCrossEntropyLoss<double> fused(R);
+    SoftmaxLayer<double> softmax(R);
+    CrossEntropyLoss<double> cross_entropy(R);
+
+    vector<MatrixD> logits = {MatrixD::Random(R, 1) * 3};
+    vector<MatrixD> target = {MatrixD::Zero(R, 1)};
+    target[0](2, 0) = 1;
+
+    auto probabilities = softmax.forward(logits);
+    const double expected = cross_entropy.forward(probabilities, target);
+
+    ASSERT_NEAR(fused.forward(logits, target), expected, 1e-12);
+    ASSERT_LT((fused.getProbabilities() - probabilities[0]).norm(), 1e-12);
+
+    auto grad = fused.backward(logits, target);
+    ASSERT_LT((grad[0] - (probabilities[0] - target[0])).norm(), 1e-12);
+}
+
+TEST(FORWARD_BACKWARD, CLASS_INDEX_LABELS) {
+    const int R = 5;
+    SoftmaxCrossEntropyLoss<double> loss(R);
+
+    vector<MatrixD> logits = {MatrixD::Random(R, 1)};
+    vector<MatrixD> one_hot = {MatrixD::Zero(R, 1)};
+    one_hot[0](3, 0) = 1;
+    vector<MatrixD> index = {MatrixD::Constant(1, 1, 3)};
+
+    const double from_one_hot = loss.forward(logits, one_hot);
+    auto grad_one_hot = loss.backward(logits, one_hot);
+
+    ASSERT_NEAR(loss.forward(logits, index), from_one_hot, 1e-12);
+    auto grad_index = loss.backward(logits, index);
+    ASSERT_LT((grad_index[0] - grad_one_hot[0]).norm(), 1e-12);
+}
+
+TEST(FORWARD_BACKWARD, GRADIENT_MATCHES_FINITE_DIFFERENCE) {
+    const int R = 4;
+    SoftmaxCrossEntropyLoss<double> loss(R);
+
+    vector<MatrixD> logits = {MatrixD::Random(R, 1)};
+    vector<MatrixD> target = {MatrixD::Constant(1, 1, 1)};
+
+    auto grad = loss.backward(logits, target);
+
+    const double eps = 1e-6;
+    for (int i = 0; i < R; ++i) {
+        vector<MatrixD> plus = logits, minus = logits;
+        plus[0](i, 0) += eps;
+        minus[0](i, 0) -= eps;
+        const double numeric = (loss.forward(plus, target) - loss.forward(minus, target)) / (2 * eps);
+        EXPECT_NEAR(grad[0](i, 0), numeric, 1e-8);
+    }
+}
+
+TEST(FORWARD_BACKWARD, BACKWARD_USES_FORWARD_SOFTMAX_ONCE) {
+    const int R = 4;
+    SoftmaxCrossEntropyLoss<double> loss(R);
+
+    vector<MatrixD> logits = {MatrixD::Random(R, 1)};
+    vector<MatrixD> target = {MatrixD::Constant(1, 1, 2)};
+    std::ignore = loss.forward(logits, target);
+    const MatrixD forward_softmax = loss.getProbabilities();
+
+    // Backward right after forward reuses its softmax
+    auto first = loss.backward(logits, target);
+    ASSERT_EQ(loss.getProbabilities(), forward_softmax);
+
+    // A second backward has no forward to reuse, so it sees the edited logits
+    logits[0](0, 0) += 5;
+    auto second = loss.backward(logits, target);
+
+    SoftmaxCrossEntropyLoss<double> fresh(R);
+    auto expected = fresh.backward(logits, target);
+    ASSERT_LT((second[0] - expected[0]).norm(), 1e-12);
+    ASSERT_GT((second[0] - first[0]).norm(), 0);
+}
+
+TEST(FORWARD_BACKWARD, LARGE_LOGITS) {
+    SoftmaxCrossEntropyLoss<double> loss(3);
+
+    vector<MatrixD> logits = {MatrixD(3, 1)};
+    logits[0] << 1000, 0, -1000;
+    vector<MatrixD> target = {MatrixD::Constant(1, 1, 1)};
+
+    // Loss of the second class is 1000 + log(1 + e^-1000 + e^-2000)
+    ASSERT_NEAR(loss.forward(logits, target), 1000, 1e-9);
+    auto grad = loss.backward(logits, target);
+    ASSERT_TRUE(grad[0].allFinite());
+    ASSERT_NEAR(grad[0](1, 0), -1, 1e-12);
+}
+
+TEST(FORWARD_BACKWARD, INCORRECT_LABELS) {
+    SoftmaxCrossEntropyLoss<double> loss(4);
+
+    vector<MatrixD> logits = {MatrixD::Random(4, 1)};
+    vector<MatrixD> out_of_range = {MatrixD::Constant(1, 1, 4)};
+    vector<MatrixD> wrong_rows = {MatrixD::Zero(3, 1)};
+
+    EXPECT_ANY_THROW({
+        loss.forward(logits, out_of_range);
+    });
+
+    EXPECT_ANY_THROW({
+        loss.backward(logits, wrong_rows);
+    });
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -61,6 +61,13 @@ TEST(CONSTRUCTOR, Clone_Constructor) {
     ASSERT_TRUE(&layer != &(*result));
 }
 
+TEST(CONSTRUCTOR, Clone_Keeps_Inference_Mode) {
+    Activation layer(2, 3, 3);
+    layer.setTraining(false);
+    const auto result = layer.clone();
+    ASSERT_FALSE(result->isTraining());
+}
+
 TEST(FORWARD_BACKWARD, RELU_FORWARD) {
     Activation layer {1, 10, 10};
 
@@ -92,6 +99,118 @@ TEST(FORWARD_BACKWARD, RELU_BACKWARD) {
     }
 }
 
+// Derivative written only in terms of the input, so the layer must keep the input
+struct square_prime {
+    double operator()(double x) const { return 2 * x; }
+};
+
+struct square {
+    double operator()(double x) const { return x * x; }
+};
+
+TEST(FORWARD_BACKWARD, SIGMOID_BACKWARD_FROM_OUTPUT) {
+    static_assert(derivative_from_output_v<sigmoid_prime<double>, double>);
+    ActivationLayer<sigmoid<double>, sigmoid_prime<double>, double> layer {2, 7, 5};
+
+    vector<MatrixD> inp = {MatrixD::Random(7, 5) * 4, MatrixD::Random(7, 5) * 4};
+    vector<MatrixD> rev = {MatrixD::Random(7, 5), MatrixD::Random(7, 5)};
+
+    auto in = layer.forward(inp);
+    auto res = layer.backward(rev, 0);
+
+    for (int d = 0; d < 2; ++d) {
+        for (int i = 0; i < 7; ++i) {
+            for (int j = 0; j < 5; ++j) {
+                ASSERT_NEAR(res[d](i,j),
+                    sigmoid_prime<double>{}(inp[d](i,j)) * rev[d](i,j), 1e-12);
+            }
+        }
+    }
+}
+
+TEST(FORWARD_BACKWARD, TANH_BACKWARD_FROM_OUTPUT) {
+    static_assert(derivative_from_output_v<f_tanh_prime<double>, double>);
+    ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double> layer {1, 6, 9};
+
+    vector<MatrixD> inp = {MatrixD::Random(6, 9) * 3};
+    vector<MatrixD> rev = {MatrixD::Random(6, 9)};
+
+    auto in = layer.forward(inp);
+    auto res = layer.backward(rev, 0);
+
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 9; ++j) {
+            ASSERT_NEAR(res[0](i,j),
+                f_tanh_prime<double>{}(inp[0](i,j)) * rev[0](i,j), 1e-12);
+        }
+    }
+}
+
+TEST(FORWARD_BACKWARD, BACKWARD_FROM_INPUT) {
+    static_assert(!derivative_from_output_v<square_prime, double>);
+    ActivationLayer<square, square_prime, double> layer {1, 4, 4};
+
+    vector<MatrixD> inp = {MatrixD::Random(4, 4)};
+    vector<MatrixD> rev = {MatrixD::Random(4, 4)};
+
+    auto in = layer.forward(inp);
+    auto res = layer.backward(rev, 0);
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            ASSERT_DOUBLE_EQ(res[0](i,j), 2 * inp[0](i,j) * rev[0](i,j));
+        }
+    }
+}
+
+template<typename Layer>
+void expectInPlaceMatches(int D, int R, int C) {
+    Layer reference {D, R, C};
+    Layer layer {D, R, C, true};
+    ASSERT_TRUE(layer.isInPlace());
+
+    vector<MatrixD> inp, rev;
+    for (int d = 0; d < D; ++d) {
+        inp.push_back(MatrixD::Random(R, C) * 3);
+        rev.push_back(MatrixD::Random(R, C));
+    }
+
+    auto expected = reference.forward(inp);
+    auto expected_gradient = reference.backward(rev, 0);
+
+    // The in-place layer hands on the buffer it was given
+    vector<MatrixD> buffer = inp;
+    const double* data = buffer[0].data();
+    auto res = layer.forward(buffer);
+    ASSERT_EQ(res[0].data(), data);
+
+    vector<MatrixD> gradient = rev;
+    auto res_gradient = layer.backward(gradient, 0);
+
+    for (int d = 0; d < D; ++d) {
+        ASSERT_LT((res[d] - expected[d]).norm(), 1e-12);
+        ASSERT_LT((res_gradient[d] - expected_gradient[d]).norm(), 1e-12);
+    }
+}
+
+TEST(IN_PLACE, RELU_MASK) {
+    expectInPlaceMatches<Activation>(3, 8, 9);
+}
+
+TEST(IN_PLACE, SIGMOID) {
+    expectInPlaceMatches<ActivationLayer<sigmoid<double>, sigmoid_prime<double>, double>>(2, 50, 50);
+}
+
+TEST(IN_PLACE, FROM_INPUT) {
+    expectInPlaceMatches<ActivationLayer<square, square_prime, double>>(1, 5, 6);
+}
+
+TEST(IN_PLACE, CLONE_KEEPS_MODE) {
+    const Activation layer(2, 4, 4, true);
+    const auto result = layer.clone();
+    ASSERT_TRUE(dynamic_cast<Activation&>(*result).isInPlace());
+}
+
 TEST(FORWARD_BACKWARD, INCORRECT_DIMS) {
     Activation layer {1, 100, 100};
 
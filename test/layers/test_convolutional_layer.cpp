@@ -163,6 +163,39 @@ TEST(FORWARD_BACKWARD, Forward_Backward_Pass_Tanh) {
     }
 }
 
+TEST(FORWARD_BACKWARD, Input_Gradient_Matches_Finite_Difference) {
+    ConvolutionalLayerSigmoid layer(2, 2, 6, 6, 3, 1, 1);
+
+    vector<MatrixD> input = {MatrixD::Random(6, 6), MatrixD::Random(6, 6)};
+    vector<MatrixD> output_gradient = {MatrixD::Random(6, 6), MatrixD::Random(6, 6)};
+
+    // Loss is <output_gradient, forward(input)>, learning rate 0 keeps filters fixed
+    auto loss = [&](vector<MatrixD>& x) {
+        auto out = layer.forward(x);
+        double sum = 0;
+        for (size_t i = 0; i < out.size(); ++i) {
+            sum += out[i].cwiseProduct(output_gradient[i]).sum();
+        }
+        return sum;
+    };
+
+    std::ignore = layer.forward(input);
+    auto input_gradient = layer.backward(output_gradient, 0);
+
+    const double eps = 1e-6;
+    for (int c = 0; c < 2; ++c) {
+        for (int i = 0; i < 6; ++i) {
+            for (int j = 0; j < 6; ++j) {
+                vector<MatrixD> plus = input, minus = input;
+                plus[c](i, j) += eps;
+                minus[c](i, j) -= eps;
+                const double numeric = (loss(plus) - loss(minus)) / (2 * eps);
+                EXPECT_NEAR(input_gradient[c](i, j), numeric, 1e-6);
+            }
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
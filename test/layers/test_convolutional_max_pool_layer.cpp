@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>;
+
+using ConvolutionalLayerReLU = ConvolutionalLayer<double, relu<double>, relu_prime<double>>;
+using FusedLayerReLU = ConvolutionalMaxPoolLayer<double, relu<double>, relu_prime<double>>;
+using FusedLayerTanh = ConvolutionalMaxPoolLayer<double, f_tanh<double>, f_tanh_prime<double>>;
+
+TEST(CONSTRUCTOR, Output_Dimensions) {
+    const FusedLayerReLU layer(1, 2, 28, 28, 3, 1, 0, 2, 2);
+    ASSERT_EQ(layer.getInputDepth(), 1);
+    ASSERT_EQ(layer.getOutputDepth(), 2);
+    ASSERT_EQ(layer.getOutputRows(), 13);
+    ASSERT_EQ(layer.getOutputCols(), 13);
+    ASSERT_EQ(layer.getPoolSize(), 2);
+    ASSERT_EQ(layer.getPoolStride(), 2);
+}
+
+TEST(CONSTRUCTOR, Clone_Constructor) {
+    const FusedLayerReLU layer(3, 4, 10, 12, 3, 1, 1, 2, 2);
+
+    const auto result = layer.clone();
+    const FusedLayerReLU* cloned_layer = dynamic_cast<const FusedLayerReLU*>(result.get());
+
+    ASSERT_NE(cloned_layer, nullptr);
+    ASSERT_EQ(cloned_layer->getOutputRows(), 5);
+    ASSERT_EQ(cloned_layer->getOutputCols(), 6);
+    ASSERT_TRUE(cloned_layer->getFilters()[3][2].isApprox(layer.getFilters()[3][2]));
+}
+
+TEST(FORWARD_BACKWARD, Matches_Unfused_Forward) {
+    ConvolutionalLayerReLU conv(2, 3, 9, 9, 3, 1, 1);
+    MaxPoolLayer<double> pool(3, 9, 9, 3, 3, 0);
+    FusedLayerReLU fused(2, 3, 9, 9, 3, 1, 1, 3, 3);
+    fused.setFilters(conv.getFilters());
+
+    vector<MatrixD> input = {MatrixD::Random(9, 9), MatrixD::Random(9, 9)};
+
+    auto activated = conv.forward(input);
+    auto expected = pool.forward(activated);
+    auto result = fused.forward(input);
+
+    ASSERT_EQ(result.size(), expected.size());
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_TRUE(result[i].isApprox(expected[i], 1e-12));
+    }
+}
+
+TEST(FORWARD_BACKWARD, Matches_Unfused_Forward_Overlapping_Windows) {
+    ConvolutionalLayerReLU conv(3, 4, 10, 10, 3, 1, 0);
+    MaxPoolLayer<double> pool(4, 8, 8, 3, 1, 0);
+    FusedLayerReLU fused(3, 4, 10, 10, 3, 1, 0, 3, 1);
+    fused.setFilters(conv.getFilters());
+
+    vector<MatrixD> input = {MatrixD::Random(10, 10), MatrixD::Random(10, 10), MatrixD::Random(10, 10)};
+
+    auto activated = conv.forward(input);
+    auto expected = pool.forward(activated);
+    auto result = fused.forward(input);
+
+    ASSERT_EQ(result.size(), expected.size());
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_TRUE(result[i].isApprox(expected[i], 1e-12));
+    }
+}
+
+TEST(FORWARD_BACKWARD, Input_Gradient_Matches_Finite_Difference) {
+    FusedLayerTanh layer(2, 2, 7, 7, 2, 1, 0, 2, 2);
+
+    vector<MatrixD> input = {MatrixD::Random(7, 7), MatrixD::Random(7, 7)};
+    vector<MatrixD> output_gradient = {MatrixD::Random(3, 3), MatrixD::Random(3, 3)};
+
+    // Loss is <output_gradient, forward(input)>, learning rate 0 keeps filters fixed
+    auto loss = [&](vector<MatrixD>& x) {
+        auto out = layer.forward(x);
+        double sum = 0;
+        for (size_t i = 0; i < out.size(); ++i) {
+            sum += out[i].cwiseProduct(output_gradient[i]).sum();
+        }
+        return sum;
+    };
+
+    std::ignore = layer.forward(input);
+    auto input_gradient = layer.backward(output_gradient, 0);
+
+    const double eps = 1e-6;
+    for (int c = 0; c < 2; ++c) {
+        for (int i = 0; i < 7; ++i) {
+            for (int j = 0; j < 7; ++j) {
+                vector<MatrixD> plus = input, minus = input;
+                plus[c](i, j) += eps;
+                minus[c](i, j) -= eps;
+                const double numeric = (loss(plus) - loss(minus)) / (2 * eps);
+                EXPECT_NEAR(input_gradient[c](i, j), numeric, 1e-5);
+            }
+        }
+    }
+}
+
+TEST(FORWARD_BACKWARD, INCORRECT_DIMS) {
+    FusedLayerReLU layer(1, 2, 10, 10, 3, 1, 0, 2, 2);
+
+    vector<MatrixD> input = {MatrixD::Random(9, 10)};
+
+    EXPECT_ANY_THROW({
+        auto out = layer.forward(input);
+    });
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+template<typename Activation, typename ActivationPrime>
+void expectMatchesUnfused() {
+    DenseLayer<double> dense(6, 4);
+    ActivationLayer<Activation, ActivationPrime, double> activation(1, 4, 1);
+    DenseActivationLayer<Activation, ActivationPrime, double> fused(dense);
+
+    for (int step = 0; step < 3; ++step) {
+        vector<MatrixD> inp = {MatrixD::Random(6, 1)};
+        vector<MatrixD> grad = {MatrixD::Random(4, 1)};
+
+        auto hidden = dense.forward(inp);
+        auto expected = activation.forward(hidden);
+        auto res = fused.forward(inp);
+        ASSERT_LT((res[0] - expected[0]).norm(), 1e-12);
+
+        auto hidden_gradient = activation.backward(grad, 0.1);
+        auto expected_gradient = dense.backward(hidden_gradient, 0.1);
+        auto res_gradient = fused.backward(grad, 0.1);
+        ASSERT_LT((res_gradient[0] - expected_gradient[0]).norm(), 1e-12);
+
+        ASSERT_LT((fused.getWeights() - dense.getWeights()).norm(), 1e-12);
+        ASSERT_LT((fused.getBias() - dense.getBias()).norm(), 1e-12);
+    }
+}
+
+TEST(CONSTRUCTOR, Standard_Constructor) {
+    const DenseActivationLayer<relu<double>, relu_prime<double>, double> layer(5, 3);
+    ASSERT_EQ(layer.getInputRows(), 5);
+    ASSERT_EQ(layer.getOutputRows(), 3);
+    ASSERT_EQ(layer.getWeights().rows(), 3);
+    ASSERT_EQ(layer.getWeights().cols(), 5);
+
+    const auto result = layer.clone();
+    ASSERT_EQ(result->getOutputRows(), 3);
+}
+
+TEST(FORWARD_BACKWARD, MATCHES_DENSE_THEN_RELU) {
+    expectMatchesUnfused<relu<double>, relu_prime<double>>();
+}
+
+TEST(FORWARD_BACKWARD, MATCHES_DENSE_THEN_TANH) {
+    expectMatchesUnfused<f_tanh<double>, f_tanh_prime<double>>();
+}
+
+TEST(FORWARD_BACKWARD, INCORRECT_DIMS) {
+    DenseActivationLayer<sigmoid<double>, sigmoid_prime<double>, double> layer(5, 3);
+
+    vector<MatrixD> inp = {MatrixD::Random(4, 1)};
+
+    EXPECT_ANY_THROW({
+        auto out = layer.forward(inp);
+    });
+
+    EXPECT_ANY_THROW({
+        auto out = layer.backward(inp, 0.1);
+    });
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+TEST(CONSTRUCTOR, Standard_Constructor) {
+    const FlatteningLayer<double> layer(3, 4, 5);
+    ASSERT_EQ(layer.getInputDepth(), 3);
+    ASSERT_EQ(layer.getInputRows(), 4);
+    ASSERT_EQ(layer.getInputCols(), 5);
+    ASSERT_EQ(layer.getOutputDepth(), 1);
+    ASSERT_EQ(layer.getOutputRows(), 1);
+    ASSERT_EQ(layer.getOutputCols(), 60);
+}
+
+TEST(FORWARD_BACKWARD, DEPTH_ONE_REUSES_BUFFER) {
+    FlatteningLayer<double> layer(1, 3, 4);
+
+    MatrixD channel = MatrixD::Random(3, 4);
+    vector<MatrixD> inp = {channel};
+    const double* data = inp[0].data();
+
+    auto res = layer.forward(inp);
+    ASSERT_EQ(res[0].data(), data);
+    ASSERT_EQ(res[0].rows(), 1);
+    ASSERT_EQ(res[0].cols(), 12);
+    for (int j = 0; j < 4; ++j) {
+        for (int i = 0; i < 3; ++i) {
+            ASSERT_EQ(res[0](0, j * 3 + i), channel(i, j));
+        }
+    }
+
+    auto grad = layer.backward(res, 0);
+    ASSERT_EQ(grad[0].data(), data);
+    ASSERT_EQ(grad[0], channel);
+}
+
+TEST(FORWARD_BACKWARD, DEPTH_ROUND_TRIP) {
+    FlatteningLayer<double> layer(3, 2, 5);
+
+    vector<MatrixD> inp = {MatrixD::Random(2, 5), MatrixD::Random(2, 5), MatrixD::Random(2, 5)};
+    vector<MatrixD> copy = inp;
+
+    auto res = layer.forward(copy);
+    ASSERT_EQ(res[0].cols(), 30);
+    for (int d = 0; d < 3; ++d) {
+        ASSERT_EQ(res[0](0, d * 10 + 7), inp[d](1, 3));
+    }
+
+    auto grad = layer.backward(res, 0);
+    ASSERT_EQ(grad.size(), 3u);
+    for (int d = 0; d < 3; ++d) {
+        ASSERT_EQ(grad[d], inp[d]);
+    }
+}
+
+TEST(FORWARD_BACKWARD, INCORRECT_DIMS) {
+    FlatteningLayer<double> layer(2, 3, 3);
+
+    vector<MatrixD> inp = {MatrixD::Random(3, 3)};
+    vector<MatrixD> grad = {MatrixD::Random(1, 9)};
+
+    EXPECT_ANY_THROW({
+        auto out = layer.forward(inp);
+    });
+
+    EXPECT_ANY_THROW({
+        auto out = layer.backward(grad, 0);
+    });
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+TEST(CONSTRUCTOR, Standard_Constructor) {
+    const SoftmaxLayer<double> layer(7);
+    ASSERT_EQ(layer.getInputDepth(), 1);
+    ASSERT_EQ(layer.getInputRows(), 7);
+    ASSERT_EQ(layer.getInputCols(), 1);
+    ASSERT_EQ(layer.getOutputDepth(), 1);
+    ASSERT_EQ(layer.getOutputRows(), 7);
+    ASSERT_EQ(layer.getOutputCols(), 1);
+}
+
+TEST(FORWARD_BACKWARD, FORWARD_SUMS_TO_ONE) {
+    SoftmaxLayer<double> layer(10);
+
+    vector<MatrixD> inp = {MatrixD::Random(10, 1)};
+    auto res = layer.forward(inp);
+
+    ASSERT_NEAR(res[0].sum(), 1, 1e-12);
+    const double norm = inp[0].array().exp().sum();
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_NEAR(res[0](i, 0), std::exp(inp[0](i, 0)) / norm, 1e-12);
+    }
+}
+
+TEST(FORWARD_BACKWARD, FORWARD_LARGE_INPUTS) {
+    SoftmaxLayer<double> layer(3);
+
+    // exp(1000) overflows without the max subtraction
+    vector<MatrixD> inp = {MatrixD(3, 1)};
+    inp[0] << 1000, 999, -1000;
+    auto res = layer.forward(inp);
+
+    ASSERT_TRUE(res[0].allFinite());
+    ASSERT_NEAR(res[0](0, 0), 1 / (1 + std::exp(-1.0)), 1e-12);
+    ASSERT_NEAR(res[0](1, 0), 1 / (1 + std::exp(1.0)), 1e-12);
+    ASSERT_EQ(res[0](2, 0), 0);
+}
+
+TEST(FORWARD_BACKWARD, BACKWARD_MATCHES_JACOBIAN) {
+    const int R = 12;
+    SoftmaxLayer<double> layer(R);
+
+    vector<MatrixD> inp = {MatrixD::Random(R, 1)};
+    vector<MatrixD> grad = {MatrixD::Random(R, 1)};
+
+    auto s = layer.forward(inp)[0];
+    auto res = layer.backward(grad, 0);
+
+    // Full Jacobian diag(s) - s s^T
+    MatrixD jacobian = MatrixD(s.col(0).asDiagonal()) - s * s.transpose();
+    MatrixD expected = jacobian * grad[0];
+
+    ASSERT_LT((res[0] - expected).norm(), 1e-12);
+}
+
+TEST(FORWARD_BACKWARD, LARGE_OUTPUT) {
+    const int R = 20000;
+    SoftmaxLayer<double> layer(R);
+
+    vector<MatrixD> inp = {MatrixD::Random(R, 1)};
+    vector<MatrixD> grad = {MatrixD::Ones(R, 1)};
+
+    std::ignore = layer.forward(inp);
+    auto res = layer.backward(grad, 0);
+
+    // Softmax is invariant to adding a constant, so a constant gradient vanishes
+    ASSERT_LT(res[0].cwiseAbs().maxCoeff(), 1e-15);
+}
+
+TEST(FORWARD_BACKWARD, INCORRECT_DIMS) {
+    SoftmaxLayer<double> layer(5);
+
+    vector<MatrixD> inp = {MatrixD::Random(4, 1)};
+
+    EXPECT_ANY_THROW({
+        auto out = layer.forward(inp);
+    });
+
+    EXPECT_ANY_THROW({
+        auto out = layer.backward(inp, 0.1);
+    });
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+// Train copies of a pipeline with and without checkpointing and compare them
+void expectCheckpointingMatches(Pipeline<double>& pipeline, int segment,
+                                vector<MatrixD> input, vector<MatrixD> target) {
+    pipeline.setFusion(false);
+    Pipeline<double> checkpointed(pipeline);
+    checkpointed.setCheckpointing(segment);
+
+    for (int step = 0; step < 5; ++step) {
+        const double expected = pipeline.trainPipeline(input, target, 0.05);
+        const double error = checkpointed.trainPipeline(input, target, 0.05);
+        ASSERT_NEAR(error, expected, 1e-10);
+    }
+
+    auto expected = pipeline.predictPipeline(input);
+    auto res = checkpointed.predictPipeline(input);
+    for (size_t d = 0; d < res.size(); ++d) {
+        ASSERT_LT((res[d] - expected[d]).norm(), 1e-10);
+    }
+}
+
+TEST(CHECKPOINTING, DEEP_DENSE_MATCHES) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 8));
+    for (int i = 0; i < 4; ++i) {
+        pipeline.pushLayer(ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>(1, 8, 1, i % 2 == 0));
+        pipeline.pushLayer(DenseLayer<double>(8, 8));
+    }
+    pipeline.pushLayer(ActivationLayer<sigmoid<double>, sigmoid_prime<double>, double>(1, 8, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 8, 1));
+
+    expectCheckpointingMatches(pipeline, -1, {MatrixD::Random(4, 1)}, {MatrixD::Random(8, 1)});
+}
+
+TEST(CHECKPOINTING, CONVOLUTION_MATCHES) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, relu<double>, relu_prime<double>>(2, 3, 8, 8, 3, 1, 1));
+    pipeline.pushLayer(MaxPoolLayer<double>(3, 8, 8, 2, 2, 0));
+    pipeline.pushLayer(ConvolutionalLayer<double, f_tanh<double>, f_tanh_prime<double>>(3, 2, 4, 4, 3, 1, 1));
+    pipeline.pushLayer(FlatteningLayer<double>(2, 4, 4));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 32));
+
+    expectCheckpointingMatches(pipeline, 1,
+        {MatrixD::Random(8, 8), MatrixD::Random(8, 8)}, {MatrixD::Random(1, 32)});
+}
+
+TEST(CHECKPOINTING, SEGMENTS_AND_PLANNED_PEAK) {
+    LayerVector<double> layers;
+    for (int i = 0; i < 16; ++i) {
+        layers.pushLayer(DenseLayer<double>(32, 32));
+    }
+
+    layers.setCheckpointing(0);
+    ASSERT_EQ(layers.getCheckpointSegment(), 0);
+    const size_t full = layers.planMemory(true).peak();
+
+    layers.setCheckpointing();
+    ASSERT_EQ(layers.getCheckpointSegment(), 4);
+    ASSERT_LT(layers.planMemory(true).peak(), full);
+
+    // The last segment keeps its activations for backward
+    vector<MatrixD> input = {MatrixD::Random(32, 1)};
+    auto res = layers.forward(input);
+    ASSERT_EQ(res[0].rows(), 32);
+    ASSERT_EQ(layers.back().inp[0].size(), 32);
+
+    // A layer's kept activations can be dropped
+    DenseLayer<double> dense(3, 2);
+    vector<MatrixD> x = {MatrixD::Random(3, 1)};
+    std::ignore = dense.forward(x);
+    ASSERT_EQ(dense.inp[0].size(), 3);
+    dense.clearActivations();
+    ASSERT_EQ(dense.inp.size(), 1);
+    ASSERT_EQ(dense.inp[0].size(), 0);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
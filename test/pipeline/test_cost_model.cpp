@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+#include <sstream>
+
+using namespace hado;
+
+TEST(COST_MODEL, DENSE_LAYER) {
+    DenseLayer<float> layer(4, 3);
+    LayerCost cost = layer.cost();
+    ASSERT_EQ(cost.name, "DenseLayer");
+    ASSERT_EQ(cost.parameters, 15u);
+    ASSERT_EQ(cost.parameter_bytes, 15 * sizeof(float));
+    ASSERT_DOUBLE_EQ(cost.forward_flops, 2 * 12 + 3);
+    ASSERT_DOUBLE_EQ(cost.backward_flops, 3 * 12 + 2 * 15);
+    ASSERT_EQ(cost.activation_bytes, 7 * sizeof(float));
+    ASSERT_EQ(cost.saved_bytes, 4 * sizeof(float));
+    ASSERT_DOUBLE_EQ(cost.intensity(), 27.0 / (22 * sizeof(float)));
+}
+
+TEST(COST_MODEL, CONVOLUTION) {
+    ConvolutionalLayer<double, relu<double>, relu_prime<double>> conv(2, 3, 6, 6, 3, 1, 0);
+    LayerCost cost = conv.cost();
+    ASSERT_EQ(cost.parameters, 3u * 2 * 9);
+    ASSERT_DOUBLE_EQ(cost.forward_flops, 2.0 * 54 * 16 + 3 * 16);
+
+    // Fused convolution and pooling costs the convolution plus the pooling
+    MaxPoolLayer<double> pool(3, 4, 4, 2, 2, 0);
+    auto fused = conv.fuseWithNext(pool);
+    ASSERT_NE(fused, nullptr);
+    ASSERT_EQ(fused->parameterCount(), cost.parameters);
+    ASSERT_DOUBLE_EQ(fused->forwardFlops(), cost.forward_flops + pool.forwardFlops());
+}
+
+TEST(COST_MODEL, PIPELINE_REPORT) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, relu<double>, relu_prime<double>>(1, 2, 6, 6, 3, 1, 1));
+    pipeline.pushLayer(FlatteningLayer<double>(2, 6, 6));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 72));
+
+    auto costs = pipeline.costs();
+    ASSERT_EQ(costs.size(), 2u);
+    ASSERT_EQ(costs[1].name, "FlatteningLayer");
+    ASSERT_DOUBLE_EQ(costs[1].forward_flops, 0);
+
+    json report = pipeline.costReport();
+    ASSERT_EQ(report["layers"].size(), 2u);
+    ASSERT_DOUBLE_EQ(report["total"]["forward_flops"].get<double>(), costs[0].forward_flops);
+    ASSERT_EQ(report["total"]["parameters"].get<size_t>(), 18u);
+    ASSERT_EQ(report["peak_inference_bytes"].get<size_t>(), pipeline.planMemory(false).peak() * sizeof(double));
+    ASSERT_GT(report["peak_training_bytes"].get<size_t>(), report["peak_inference_bytes"].get<size_t>());
+
+    std::ostringstream table;
+    pipeline.printCosts(table);
+    ASSERT_NE(table.str().find("ConvolutionalLayer"), std::string::npos);
+    ASSERT_NE(table.str().find("Total"), std::string::npos);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <numeric>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+static Pipeline<double> makePipeline() {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+    return pipeline;
+}
+
+TEST(DATA_PARALLEL, STEP_MATCHES_MINIBATCH) {
+    Pipeline<double> pipeline = makePipeline();
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs, results;
+    for (int i = 0; i < 7; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        results.push_back({MatrixD::Random(2, 1)});
+    }
+    vector<size_t> order(inputs.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    // 3 and 4 replicas, an uneven split and an odd round of the reduction
+    for (const int replicas : {3, 4}) {
+        const double error = pipeline.trainDataParallel(inputs, results, order, 7, 0.1, replicas);
+        const double expected = serial->trainBatch(inputs, results, order, 0.1);
+        ASSERT_NEAR(error, expected, 1e-9);
+    }
+
+    for (auto& input : inputs) {
+        ASSERT_TRUE(pipeline.predictPipeline(input)[0].isApprox(serial->predictPipeline(input)[0]));
+    }
+}
+
+TEST(DATA_PARALLEL, MORE_REPLICAS_THAN_SAMPLES) {
+    Pipeline<double> pipeline = makePipeline();
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs = {{MatrixD::Random(3, 1)}, {MatrixD::Random(3, 1)}};
+    vector<vector<MatrixD>> results = {{MatrixD::Random(2, 1)}, {MatrixD::Random(2, 1)}};
+    pipeline.trainDataParallel(inputs, results, {1, 0}, 2, 0.1, 5);
+    serial->trainBatch(inputs, results, {1, 0}, 0.1);
+    ASSERT_TRUE(pipeline.predictPipeline(inputs[0])[0].isApprox(serial->predictPipeline(inputs[0])[0]));
+
+    ASSERT_THROW(pipeline.trainDataParallel(inputs, results, {0, 1}, 2, 0.1, 0), std::invalid_argument);
+}
+
+TEST(DATA_PARALLEL, REPLICAS_KEPT_ACROSS_EPOCHS) {
+    Pipeline<double> pipeline = makePipeline();
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs, results;
+    for (int i = 0; i < 6; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        results.push_back({MatrixD::Random(2, 1)});
+    }
+    const vector<size_t> order = {0, 1, 2, 3, 4, 5};
+
+    // Plain steps in between still update straight away
+    for (int epoch = 0; epoch < 3; ++epoch) {
+        pipeline.trainDataParallel(inputs, results, order, 3, 0.1, 2);
+        serial->trainBatch(inputs, results, {0, 1, 2}, 0.1);
+        serial->trainBatch(inputs, results, {3, 4, 5}, 0.1);
+        pipeline.trainPipeline(inputs[epoch], results[epoch], 0.1);
+        serial->trainPipeline(inputs[epoch], results[epoch], 0.1);
+    }
+    for (auto& input : inputs) {
+        ASSERT_TRUE(pipeline.predictPipeline(input)[0].isApprox(serial->predictPipeline(input)[0]));
+    }
+}
+
+TEST(DATA_PARALLEL, END_LAYER_PARAMETERS_TRAIN) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 4));
+    pipeline.pushEndLayer(HierarchicalSoftmaxLoss<double>(4, 6));
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs, labels;
+    for (int i = 0; i < 8; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        labels.push_back({MatrixD::Constant(1, 1, i % 6)});
+    }
+    const vector<size_t> order = {0, 1, 2, 3, 4, 5, 6, 7};
+    const MatrixD before = pipeline.predictPipeline(inputs[0])[0];
+
+    pipeline.trainDataParallel(inputs, labels, order, 8, 0.5, 3);
+    serial->trainBatch(inputs, labels, order, 0.5);
+
+    // Same update of the projection the end layer owns as a serial minibatch
+    const MatrixD after = pipeline.predictPipeline(inputs[0])[0];
+    ASSERT_FALSE(after.isApprox(before));
+    ASSERT_TRUE(after.isApprox(serial->predictPipeline(inputs[0])[0]));
+}
+
+TEST(DATA_PARALLEL, REPLICAS_DRAW_DIFFERENT_NEGATIVES) {
+    const int classes = 1000;
+    SampledSoftmaxLoss<double> loss(4, classes, 5, {}, 11);
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(3, 4));
+    const MatrixD before = loss.getWeights();
+
+    // Two replicas train on the same sample, so only their draws differ
+    vector<vector<MatrixD>> inputs = {{MatrixD::Random(3, 1)}};
+    vector<vector<MatrixD>> labels = {{MatrixD::Constant(1, 1, 0)}};
+    DataParallel<double> executor(layers, &loss, 2, 5);
+    executor.trainBatch(inputs, labels, {0, 0}, 0.1);
+
+    // One replica touches the true class and at most 5 negatives
+    int touched = 0;
+    for (int c = 0; c < classes; ++c) {
+        touched += loss.getWeights().col(c) != before.col(c);
+    }
+    ASSERT_GT(touched, 6);
+}
+
+TEST(DATA_PARALLEL, MODEL_LEARNS_XOR) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(2, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 1));
+    pipeline.pushLayer(Tanh(1, 1, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 1));
+
+    SequentialModel<double> model(pipeline);
+    model.set_seed(3);
+    model.set_data_parallel(4);
+    for (int a = 0; a < 2; ++a) {
+        for (int b = 0; b < 2; ++b) {
+            MatrixD input(2, 1);
+            input << a, b;
+            model.add_training_data({input}, {MatrixD::Constant(1, 1, a ^ b)});
+            model.add_test_data({input}, {MatrixD::Constant(1, 1, a ^ b)});
+        }
+    }
+
+    const double before = model.run_tests(0);
+    model.run_epochs(500, 0.2, 0, 2, true);
+    ASSERT_LT(model.run_tests(0), before);
+
+    ASSERT_THROW(model.set_data_parallel(0), std::invalid_argument);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <HaDo/pipeline/DynamicBatcher.hpp>
+#include <thread>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+Pipeline<double> makePipeline() {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 3));
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+    return pipeline;
+}
+
+TEST(DYNAMIC_BATCHER, COALESCES_CONCURRENT_REQUESTS) {
+    Pipeline<double> pipeline = makePipeline();
+    auto plan = std::make_shared<const InferencePlan<double>>(pipeline.freeze());
+    DynamicBatcher<double> batcher(plan, 8, std::chrono::milliseconds(20));
+
+    const int count = 16;
+    vector<vector<MatrixD>> inputs;
+    for (int i = 0; i < count; ++i) {
+        inputs.push_back({MatrixD::Random(4, 1)});
+    }
+
+    vector<MatrixD> results(count);
+    vector<std::thread> threads;
+    for (int i = 0; i < count; ++i) {
+        threads.emplace_back([&, i]{ results[i] = batcher.predict(inputs[i])[0]; });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < count; ++i) {
+        ASSERT_LT((results[i] - pipeline.predictPipeline(inputs[i])[0]).norm(), 1e-12);
+    }
+    ASSERT_EQ(batcher.getRequestCount(), static_cast<size_t>(count));
+    ASSERT_LT(batcher.getBatchCount(), static_cast<size_t>(count));
+
+    // A bad input fails alone
+    vector<MatrixD> wrong = {MatrixD::Random(5, 1)};
+    ASSERT_THROW(batcher.predict(wrong), std::invalid_argument);
+    ASSERT_LT((batcher.predict(inputs[0])[0] - results[0]).norm(), 1e-12);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+TEST(GRAPH_MODEL, CHAIN_MATCHES_LAYER_VECTOR) {
+    DenseLayer<double> first(3, 4), second(4, 2);
+
+    LayerVector<double> layers;
+    layers.pushLayer(first);
+    layers.pushLayer(Tanh(1, 4, 1));
+    layers.pushLayer(second);
+
+    GraphModel<double> graph;
+    int node = graph.addInput(1, 3, 1);
+    node = graph.addLayer(first, node);
+    node = graph.addLayer(Tanh(1, 4, 1), node);
+    node = graph.addLayer(second, node);
+    graph.addOutput(node);
+    ASSERT_EQ(graph.getLevelCount(), 4);
+
+    for (int step = 0; step < 3; ++step) {
+        vector<MatrixD> input = {MatrixD::Random(3, 1)};
+        vector<MatrixD> gradient = {MatrixD::Random(2, 1)};
+
+        auto expected = layers.forward(input);
+        auto res = graph.forward({input});
+        ASSERT_LT((res[0][0] - expected[0]).norm(), 1e-12);
+
+        auto expected_gradient = layers.backward(gradient, 0.1);
+        auto input_gradient = graph.backward({gradient}, 0.1);
+        ASSERT_LT((input_gradient[0][0] - expected_gradient[0]).norm(), 1e-12);
+    }
+}
+
+TEST(GRAPH_MODEL, RESIDUAL_GRADIENT_ACCUMULATES_AT_FAN_OUT) {
+    // y = x + W2 tanh(W1 x), x feeds both the branch and the add
+    GraphModel<double> graph;
+    const int x = graph.addInput(1, 4, 1);
+    int branch = graph.addLayer(DenseLayer<double>(4, 4), x);
+    branch = graph.addLayer(Tanh(1, 4, 1), branch);
+    branch = graph.addLayer(DenseLayer<double>(4, 4), branch);
+    const int y = graph.addAdd({x, branch});
+    graph.addOutput(y, MeanSquaredError<double>(1, 4, 1));
+
+    vector<MatrixD> input = {MatrixD::Random(4, 1)};
+    vector<vector<MatrixD>> target = {{MatrixD::Random(4, 1)}};
+    MeanSquaredError<double> mse(1, 4, 1);
+
+    auto res = graph.forward({input});
+    auto gradient = mse.backward(res[0], target[0]);
+    auto input_gradient = graph.backward({gradient}, 0);
+
+    // Finite difference of the loss w.r.t. each input element
+    const double h = 1e-6;
+    for (int i = 0; i < 4; ++i) {
+        vector<MatrixD> plus = input, minus = input;
+        plus[0](i, 0) += h;
+        minus[0](i, 0) -= h;
+        auto res_plus = graph.forward({plus});
+        auto res_minus = graph.forward({minus});
+        // MeanSquaredError::backward is the gradient of the sum of squares
+        const double numeric = ((res_plus[0][0] - target[0][0]).squaredNorm()
+            - (res_minus[0][0] - target[0][0]).squaredNorm()) / (2 * h);
+        ASSERT_NEAR(input_gradient[0][0](i, 0), numeric, 1e-6);
+    }
+
+    // Training reduces the error
+    const double before = graph.trainGraph({input}, target, 0.05);
+    double after = before;
+    for (int step = 0; step < 50; ++step) {
+        after = graph.trainGraph({input}, target, 0.05);
+    }
+    ASSERT_LT(after, before);
+}
+
+TEST(GRAPH_MODEL, PARALLEL_BRANCHES_CONCAT) {
+    DenseLayer<double> left(3, 5), right(3, 5);
+
+    GraphModel<double> graph;
+    const int x = graph.addInput(1, 3, 1);
+    const int a = graph.addLayer(left, x);
+    const int b = graph.addLayer(right, x);
+    const int joined = graph.addConcat({a, b});
+    graph.addOutput(joined);
+    graph.addOutput(a);
+    ASSERT_EQ(graph.getDepth(joined), 2);
+
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    auto res = graph.forward({input});
+    ASSERT_EQ(res[0].size(), 2);
+    ASSERT_LT((res[0][0] - (left.getWeights() * input[0] + left.getBias())).norm(), 1e-12);
+    ASSERT_LT((res[0][1] - (right.getWeights() * input[0] + right.getBias())).norm(), 1e-12);
+    ASSERT_LT((res[1][0] - res[0][0]).norm(), 1e-12);
+
+    // Gradient through the concat splits by depth and sums at the shared input
+    vector<MatrixD> gradient = {MatrixD::Random(5, 1), MatrixD::Random(5, 1)};
+    auto input_gradient = graph.backward({gradient, {}}, 0);
+    const MatrixD expected = left.getWeights().transpose() * gradient[0] + right.getWeights().transpose() * gradient[1];
+    ASSERT_LT((input_gradient[0][0] - expected).norm(), 1e-12);
+}
+
+TEST(GRAPH_MODEL, DIMENSION_CHECKS) {
+    GraphModel<double> graph;
+    const int x = graph.addInput(1, 3, 1);
+    const int a = graph.addLayer(DenseLayer<double>(3, 2), x);
+    ASSERT_THROW(graph.addLayer(DenseLayer<double>(3, 2), a), std::invalid_argument);
+    ASSERT_THROW(graph.addAdd({x, a}), std::invalid_argument);
+    ASSERT_THROW(graph.addOutput(7), std::invalid_argument);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+#include <numeric>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+TEST(HOGWILD, ONE_THREAD_IS_SEQUENTIAL_SGD) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs, results;
+    for (int i = 0; i < 5; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        results.push_back({MatrixD::Random(2, 1)});
+    }
+    const vector<size_t> order = {3, 0, 4, 1, 2};
+
+    const double error = pipeline.trainHogwild(inputs, results, order, 0.05, 1);
+    double expected = 0;
+    for (const size_t i : order) {
+        expected += serial->trainPipeline(inputs[i], results[i], 0.05);
+    }
+    ASSERT_NEAR(error, expected, 1e-9);
+    for (auto& input : inputs) {
+        ASSERT_TRUE(pipeline.predictPipeline(input)[0].isApprox(serial->predictPipeline(input)[0]));
+    }
+
+    ASSERT_THROW(pipeline.trainHogwild(inputs, results, order, 0.05, 0), std::invalid_argument);
+}
+
+TEST(HOGWILD, GENERIC_LAYERS_MATCH_SEQUENTIAL_SGD) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, relu<double>, relu_prime<double>>(1, 2, 5, 5, 3, 1, 1));
+    pipeline.pushLayer(FlatteningLayer<double>(2, 5, 5));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 50));
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs, results;
+    for (int i = 0; i < 4; ++i) {
+        inputs.push_back({MatrixD::Random(5, 5)});
+        results.push_back({MatrixD::Random(1, 50)});
+    }
+    const vector<size_t> order = {1, 3, 0, 2};
+
+    const double error = pipeline.trainHogwild(inputs, results, order, 0.01, 1);
+    double expected = 0;
+    for (const size_t i : order) {
+        expected += serial->trainPipeline(inputs[i], results[i], 0.01);
+    }
+    ASSERT_NEAR(error, expected, 1e-9);
+    for (auto& input : inputs) {
+        ASSERT_TRUE(pipeline.predictPipeline(input)[0].isApprox(serial->predictPipeline(input)[0]));
+    }
+}
+
+TEST(HOGWILD, SPARSE_INPUT_TOUCHES_REACHED_COLUMNS) {
+    DenseLayer<double> shared(6, 3);
+    DenseLayer<double> worker(shared);
+    worker.shareParameters(&shared);
+    ASSERT_TRUE(worker.isSharingParameters());
+
+    // The shared weights move on while the worker's copy is stale
+    MatrixD moved = MatrixD::Random(3, 6);
+    *shared.parameters()[0] = moved;
+
+    vector<MatrixD> input = {MatrixD::Zero(6, 1)};
+    input[0](1, 0) = 0.5;
+    input[0](4, 0) = -2;
+    worker.pullShared(input);
+    for (int j = 0; j < 6; ++j) {
+        const bool reached = j == 1 || j == 4;
+        ASSERT_EQ(worker.getWeights().col(j) == moved.col(j), reached);
+    }
+
+    // Backward updates only the reached columns of the shared weights
+    const MatrixD own = worker.getWeights();
+    worker.forward(input);
+    vector<MatrixD> grad = {MatrixD::Random(3, 1)};
+    worker.backward(grad, 0.1);
+    ASSERT_EQ(worker.getWeights(), own);
+    for (int j = 0; j < 6; ++j) {
+        const MatrixD expected = moved.col(j) - 0.1 * grad[0] * input[0](j, 0);
+        ASSERT_LT((shared.getWeights().col(j) - expected).norm(), 1e-12);
+    }
+    ASSERT_EQ(shared.getWeights().col(0), moved.col(0));
+
+    worker.shareParameters(nullptr);
+    ASSERT_FALSE(worker.isSharingParameters());
+    DenseLayer<double> other(5, 3);
+    ASSERT_THROW(worker.shareParameters(&other), std::invalid_argument);
+}
+
+TEST(HOGWILD, WORKERS_KEPT_ACROSS_EPOCHS) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 4));
+    pipeline.pushLayer(Tanh(1, 4, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 4, 1));
+    std::unique_ptr<Pipeline<double>> serial = pipeline.clone();
+
+    vector<vector<MatrixD>> inputs, results;
+    for (int i = 0; i < 4; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        results.push_back({MatrixD::Random(4, 1)});
+    }
+    const vector<size_t> order = {2, 0, 3, 1};
+
+    // Workers read the shared weights again, also after plain steps in between
+    for (int epoch = 0; epoch < 3; ++epoch) {
+        pipeline.trainHogwild(inputs, results, order, 0.05, 1);
+        pipeline.trainPipeline(inputs[epoch], results[epoch], 0.05);
+        for (const size_t i : order) {
+            serial->trainPipeline(inputs[i], results[i], 0.05);
+        }
+        serial->trainPipeline(inputs[epoch], results[epoch], 0.05);
+    }
+    for (auto& input : inputs) {
+        ASSERT_TRUE(pipeline.predictPipeline(input)[0].isApprox(serial->predictPipeline(input)[0]));
+    }
+}
+
+TEST(HOGWILD, REJECTS_END_LAYER_WITH_PARAMETERS) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 4));
+    pipeline.pushEndLayer(HierarchicalSoftmaxLoss<double>(4, 6));
+
+    vector<vector<MatrixD>> inputs = {{MatrixD::Random(3, 1)}};
+    vector<vector<MatrixD>> labels = {{MatrixD::Constant(1, 1, 2)}};
+    ASSERT_THROW(pipeline.trainHogwild(inputs, labels, {0}, 0.05, 2), std::invalid_argument);
+
+    SequentialModel<double> model(pipeline);
+    ASSERT_THROW(model.set_hogwild(2), std::invalid_argument);
+    ASSERT_NO_THROW(model.set_hogwild(1));
+}
+
+TEST(HOGWILD, THREADS_REDUCE_ERROR) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(2, 16));
+    pipeline.pushLayer(Tanh(1, 16, 1));
+    pipeline.pushLayer(DenseLayer<double>(16, 1));
+    pipeline.pushLayer(Tanh(1, 1, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 1));
+
+    SequentialModel<double> model(pipeline);
+    model.set_seed(5);
+    model.set_hogwild(4);
+    for (int copy = 0; copy < 4; ++copy) {
+        for (int a = 0; a < 2; ++a) {
+            for (int b = 0; b < 2; ++b) {
+                MatrixD input(2, 1);
+                input << a, b;
+                model.add_training_data({input}, {MatrixD::Constant(1, 1, a ^ b)});
+                if (copy == 0) {
+                    model.add_test_data({input}, {MatrixD::Constant(1, 1, a ^ b)});
+                }
+            }
+        }
+    }
+
+    const double before = model.run_tests(0);
+    model.run_epochs(300, 0.05, 0, 1, true);
+    ASSERT_LT(model.run_tests(0), before);
+
+    ASSERT_THROW(model.run_epochs(1, 0.05, 0, 4), std::invalid_argument);
+    ASSERT_THROW(model.set_hogwild(0), std::invalid_argument);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
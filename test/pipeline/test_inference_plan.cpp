@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+// Compare a frozen plan with predictPipeline on a few inputs
+void expectPlanMatches(Pipeline<double>& pipeline, const vector<MatrixD>& shape) {
+    InferencePlan<double> plan = pipeline.freeze();
+    auto workspace = plan.makeWorkspace();
+
+    for (int run = 0; run < 3; ++run) {
+        vector<MatrixD> input;
+        for (const MatrixD& m : shape) {
+            input.push_back(MatrixD::Random(m.rows(), m.cols()));
+        }
+        vector<MatrixD> copy = input;
+        auto expected = pipeline.predictPipeline(copy);
+
+        const auto& res = plan.predict(input, workspace);
+        ASSERT_EQ(res.size(), expected.size());
+        for (size_t d = 0; d < res.size(); ++d) {
+            ASSERT_LT((res[d] - expected[d]).norm(), 1e-10);
+        }
+    }
+}
+
+TEST(INFERENCE_PLAN, DENSE_SOFTMAX) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 6));
+    pipeline.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(1, 6, 1));
+    pipeline.pushLayer(DenseLayer<double>(6, 3));
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+
+    expectPlanMatches(pipeline, {MatrixD(4, 1)});
+}
+
+TEST(INFERENCE_PLAN, CONVOLUTION_UNFUSED) {
+    Pipeline<double> pipeline;
+    pipeline.setFusion(false);
+    pipeline.pushLayer(ConvolutionalLayer<double, f_tanh<double>, f_tanh_prime<double>>(2, 3, 7, 7, 3, 2, 1));
+    pipeline.pushLayer(MaxPoolLayer<double>(3, 4, 4, 2, 1, 1));
+    pipeline.pushLayer(ActivationLayer<sigmoid<double>, sigmoid_prime<double>, double>(3, 5, 5));
+    pipeline.pushLayer(FlatteningLayer<double>(3, 5, 5));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 75));
+
+    expectPlanMatches(pipeline, {MatrixD(7, 7), MatrixD(7, 7)});
+}
+
+TEST(INFERENCE_PLAN, CONVOLUTION_FUSED) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, identity<double>, identity_prime<double>>(2, 3, 8, 8, 3, 1, 1));
+    pipeline.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(3, 8, 8));
+    pipeline.pushLayer(MaxPoolLayer<double>(3, 8, 8, 2, 2, 0));
+    pipeline.pushLayer(FlatteningLayer<double>(3, 4, 4));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 48));
+
+    expectPlanMatches(pipeline, {MatrixD(8, 8), MatrixD(8, 8)});
+    ASSERT_EQ(pipeline.getLayerCount(), 2);
+}
+
+TEST(INFERENCE_PLAN, IMMUTABLE_AND_REUSES_WORKSPACE) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    vector<MatrixD> target = {MatrixD::Random(2, 1)};
+    const InferencePlan<double> plan = pipeline.freeze();
+    auto workspace = plan.makeWorkspace();
+    const MatrixD before = plan.predict(input, workspace)[0];
+    const double* buffer = workspace.activations.back()[0].data();
+
+    // Training the pipeline does not change the frozen plan
+    pipeline.trainPipeline(input, target, 0.1);
+    const MatrixD after = plan.predict(input, workspace)[0];
+    ASSERT_LT((after - before).norm(), 1e-12);
+    ASSERT_EQ(workspace.activations.back()[0].data(), buffer);
+    ASSERT_GT((pipeline.predictPipeline(input)[0] - before).norm(), 0);
+
+    vector<MatrixD> wrong = {MatrixD::Random(4, 1)};
+    ASSERT_THROW(plan.predict(wrong, workspace), std::invalid_argument);
+}
+
+TEST(INFERENCE_PLAN, COLUMN_BATCH_MATCHES_SINGLE) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 3));
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+    InferencePlan<double> plan = pipeline.freeze();
+    ASSERT_TRUE(plan.isColumnBatched());
+
+    vector<vector<MatrixD>> inputs;
+    for (int i = 0; i < 7; ++i) {
+        inputs.push_back({MatrixD::Random(4, 1)});
+    }
+    auto workspace = plan.makeWorkspace();
+    auto res = plan.predictBatch(inputs, workspace);
+    ASSERT_EQ(res.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ASSERT_LT((res[i][0] - pipeline.predictPipeline(inputs[i])[0]).norm(), 1e-12);
+    }
+
+    // Single predictions still work on the batch-sized workspace
+    ASSERT_LT((plan.predict(inputs[0], workspace)[0] - res[0][0]).norm(), 1e-12);
+
+    // Convolutions do not batch columns, samples run one by one
+    Pipeline<double> conv;
+    conv.pushLayer(ConvolutionalLayer<double, relu<double>, relu_prime<double>>(1, 1, 4, 4, 3, 1, 1));
+    conv.pushLayer(FlatteningLayer<double>(1, 4, 4));
+    conv.pushEndLayer(MeanSquaredError<double>(1, 1, 16));
+    InferencePlan<double> conv_plan = conv.freeze();
+    ASSERT_FALSE(conv_plan.isColumnBatched());
+    vector<vector<MatrixD>> images = {{MatrixD::Random(4, 4)}, {MatrixD::Random(4, 4)}};
+    auto conv_workspace = conv_plan.makeWorkspace();
+    auto conv_res = conv_plan.predictBatch(images, conv_workspace);
+    ASSERT_LT((conv_res[1][0] - conv.predictPipeline(images[1])[0]).norm(), 1e-12);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <HaDo/pipeline/InferenceServer.hpp>
+#include <thread>
+#include <unistd.h>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+Pipeline<double> makePipeline() {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 3));
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+    return pipeline;
+}
+
+TEST(INFERENCE_SERVER, SERVES_OVER_UNIX_SOCKET) {
+    Pipeline<double> pipeline = makePipeline();
+    const std::string path = "/tmp/hado_test_" + std::to_string(::getpid()) + ".sock";
+    InferenceServer<double> server(std::make_shared<const InferencePlan<double>>(pipeline.freeze()),
+                                   path, 4, std::chrono::milliseconds(5));
+    server.start();
+    ASSERT_TRUE(server.isRunning());
+
+    vector<int> mismatches(4, 0);
+    vector<std::thread> clients;
+    for (int t = 0; t < 4; ++t) {
+        clients.emplace_back([&, t]{
+            InferenceClient<double> client(path);
+            for (int i = 0; i < 10; ++i) {
+                vector<MatrixD> input = {MatrixD::Random(4, 1)};
+                if ((client.predict(input)[0] - pipeline.predictPipeline(input)[0]).norm() > 1e-12) {
+                    mismatches[t]++;
+                }
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    for (int count : mismatches) {
+        ASSERT_EQ(count, 0);
+    }
+    ASSERT_EQ(server.getBatcher().getRequestCount(), 40u);
+
+    InferenceClient<double> client(path);
+    vector<MatrixD> wrong = {MatrixD::Random(2, 2)};
+    ASSERT_THROW(client.predict(wrong), std::invalid_argument);
+
+    server.stop();
+    ASSERT_FALSE(server.isRunning());
+    ASSERT_NE(::access(path.c_str(), F_OK), 0);
+}
+
+TEST(INFERENCE_SERVER, CLOSES_FINISHED_CONNECTIONS) {
+    Pipeline<double> pipeline = makePipeline();
+    const std::string path = "/tmp/hado_test_closing_" + std::to_string(::getpid()) + ".sock";
+    InferenceServer<double> server(std::make_shared<const InferencePlan<double>>(pipeline.freeze()), path);
+    server.start();
+
+    for (int i = 0; i < 5; ++i) {
+        InferenceClient<double> client(path);
+        vector<MatrixD> input = {MatrixD::Random(4, 1)};
+        std::ignore = client.predict(input);
+    }
+
+    // Threads notice the clients are gone on their own
+    for (int wait = 0; wait < 5000 && server.getConnectionCount() > 0; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(server.getConnectionCount(), 0u);
+    server.stop();
+}
+
+TEST(TENSOR_STREAM, REJECTS_OVERSIZED_DIMENSIONS) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    // No matrices but huge ones, each dimension is bounded on its own
+    const uint32_t header[3] = {0, 1u << 31, 1u << 31};
+    ASSERT_TRUE(TensorStream<double>::writeAll(fds[0], header, sizeof(header)));
+    vector<MatrixD> tensor;
+    ASSERT_THROW(TensorStream<double>::readTensor(fds[1], tensor), std::length_error);
+
+    const uint32_t deep[3] = {1u << 30, 0, 0};
+    ASSERT_TRUE(TensorStream<double>::writeAll(fds[0], deep, sizeof(deep)));
+    ASSERT_THROW(TensorStream<double>::readTensor(fds[1], tensor), std::length_error);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+TEST(PLAN_MEMORY, REUSES_FREED_BUFFERS) {
+    // Three tensors live one after another fit in one buffer, an overlapping one needs another
+    MemoryPlan plan = planMemory({{10, 0, 1}, {4, 1, 2}, {6, 2, 3}});
+    ASSERT_EQ(plan.buffers.size(), 2);
+    ASSERT_EQ(plan.assignment[0], plan.assignment[2]);
+    ASSERT_NE(plan.assignment[0], plan.assignment[1]);
+    ASSERT_EQ(plan.peak(), 14);
+    ASSERT_EQ(plan.unplanned, 20);
+
+    // With exact sizes a freed buffer is only reused by a tensor of its size
+    MemoryPlan exact = planMemory({{10, 0, 1}, {4, 1, 2}, {6, 2, 3}, {10, 3, 4}}, true);
+    ASSERT_EQ(exact.buffers.size(), 3);
+    ASSERT_EQ(exact.assignment[0], exact.assignment[3]);
+    ASSERT_EQ(exact.peak(), 20);
+}
+
+TEST(PLAN_MEMORY, CHAIN_INFERENCE_USES_TWO_BUFFERS) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(8, 16));
+    layers.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(1, 16, 1));
+    layers.pushLayer(DenseLayer<double>(16, 4));
+    layers.pushLayer(ActivationLayer<sigmoid<double>, sigmoid_prime<double>, double>(1, 4, 1));
+
+    MemoryPlan inference = layers.planMemory(false);
+    ASSERT_EQ(inference.buffers.size(), 2);
+    ASSERT_EQ(inference.peak(), 32);
+    ASSERT_LT(inference.peak(), inference.unplanned);
+
+    MemoryPlan training = layers.planMemory(true);
+    ASSERT_GT(training.peak(), inference.peak());
+    ASSERT_LE(training.peak(), training.unplanned);
+}
+
+TEST(INFER, MATCHES_FORWARD_WITHOUT_KEEPING_STATE) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(6, 5));
+    layers.pushLayer(ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>(1, 5, 1));
+    layers.pushLayer(DenseLayer<double>(5, 3));
+    layers.pushLayer(SoftmaxLayer<double>(3));
+
+    for (int run = 0; run < 3; ++run) {
+        vector<MatrixD> input = {MatrixD::Random(6, 1)};
+        vector<MatrixD> copy = input;
+
+        auto expected = layers.forward(copy);
+        auto res = layers.infer(input);
+        ASSERT_EQ(res.size(), 1);
+        ASSERT_LT((res[0] - expected[0]).norm(), 1e-12);
+    }
+
+    // A layer run for inference keeps no input for backward
+    DenseLayer<double> dense(4, 2);
+    dense.setTraining(false);
+    vector<MatrixD> input = {MatrixD::Random(4, 1)};
+    vector<MatrixD> output;
+    dense.forwardInto(input, output);
+    ASSERT_EQ(output[0].rows(), 2);
+    ASSERT_EQ(dense.inp[0].size(), 0);
+}
+
+TEST(INFER, POOLING_LAYERS_KEEP_NOTHING) {
+    MaxPoolLayer<double> pool(2, 6, 6, 2, 2, 0);
+    pool.setTraining(false);
+    vector<MatrixD> input = {MatrixD::Random(6, 6), MatrixD::Random(6, 6)};
+    std::ignore = pool.forward(input);
+    ASSERT_TRUE(pool.inp.empty());
+    ASSERT_TRUE(pool.out.empty());
+
+    ConvolutionalMaxPoolLayer<double, relu<double>, relu_prime<double>> fused(2, 3, 6, 6, 3, 1, 1, 2, 2);
+    fused.setTraining(false);
+    auto res = fused.forward(input);
+    ASSERT_EQ(res.size(), 3);
+
+    // Backward has nothing to go back through
+    fused.setTraining(true);
+    std::ignore = fused.forward(input);
+    vector<MatrixD> gradient(3, MatrixD::Ones(3, 3));
+    ASSERT_EQ(fused.backward(gradient, 0).size(), 2);
+}
+
+// Layer failing its forward pass, to check modes are restored on the way out
+class ThrowingLayer : public Layer<double> {
+public:
+    ThrowingLayer() : Layer<double>(1, 1, 2, 1, 2, 1) {}
+    std::unique_ptr<Layer<double>> clone() const override { return std::make_unique<ThrowingLayer>(*this); }
+    vector<MatrixD> forward(vector<MatrixD>&) override { throw std::runtime_error("forward failed"); }
+    vector<MatrixD> backward(vector<MatrixD>& output_gradient, double) override { return output_gradient; }
+};
+
+TEST(INFER, RESTORES_TRAINING_MODE) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(2, 2));
+    layers.pushLayer(ThrowingLayer());
+    vector<MatrixD> input = {MatrixD::Random(2, 1)};
+
+    ASSERT_THROW(layers.infer(input), std::runtime_error);
+    ASSERT_TRUE(layers.getLayer(0).isTraining());
+    ASSERT_TRUE(layers.getLayer(1).isTraining());
+
+    // A layer already in inference mode stays there
+    layers.getLayer(0).setTraining(false);
+    ASSERT_THROW(layers.infer(input), std::runtime_error);
+    ASSERT_FALSE(layers.getLayer(0).isTraining());
+}
+
+TEST(INFER, PIPELINE_PREDICT_MATCHES_AFTER_TRAINING) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 5));
+    pipeline.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(1, 5, 1, true));
+    pipeline.pushLayer(DenseLayer<double>(5, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    vector<MatrixD> target = {MatrixD::Random(2, 1)};
+    for (int step = 0; step < 3; ++step) {
+        pipeline.trainPipeline(input, target, 0.05);
+    }
+
+    Pipeline<double> reference(pipeline);
+    reference.setFusion(false);
+
+    // Inference in between does not disturb training
+    auto res = pipeline.predictPipeline(input);
+    const double error = pipeline.trainPipeline(input, target, 0.05);
+    const double expected = reference.trainPipeline(input, target, 0.05);
+    ASSERT_NEAR(error, expected, 1e-10);
+    ASSERT_EQ(res[0].rows(), 2);
+}
+
+// Dense layer recording where its forward and backward write, to check the buffers are reused
+class RecordingDense : public DenseLayer<double> {
+public:
+    const double* output = nullptr;
+    const double* input_gradient = nullptr;
+    RecordingDense(const int in, const int out) : DenseLayer<double>(in, out) {}
+    std::unique_ptr<Layer<double>> clone() const override { return std::make_unique<RecordingDense>(*this); }
+    void forwardInto(vector<::MatrixD>& input_tensor, vector<::MatrixD>& output_tensor) override {
+        DenseLayer<double>::forwardInto(input_tensor, output_tensor);
+        output = output_tensor[0].data();
+    }
+    void backwardInto(vector<::MatrixD>& output_gradient, vector<::MatrixD>& gradient, const double learning_rate) override {
+        DenseLayer<double>::backwardInto(output_gradient, gradient, learning_rate);
+        input_gradient = gradient[0].data();
+    }
+};
+
+// Train layers for a few steps and compare with clones run one by one, each returning new tensors
+void expectTrainingMatchesLayers(LayerVector<double>& layers, const vector<MatrixD>& shape) {
+    vector<unique_ptr<Layer<double>>> reference;
+    for (int i = 0; i < layers.getLayerCount(); ++i) {
+        reference.push_back(layers.getLayer(i).clone());
+    }
+
+    for (int step = 0; step < 3; ++step) {
+        vector<MatrixD> input;
+        for (const MatrixD& m : shape) {
+            input.push_back(MatrixD::Random(m.rows(), m.cols()));
+        }
+        vector<MatrixD> x = input;
+        for (auto& layer : reference) {
+            x = layer->forward(x);
+        }
+        vector<MatrixD> res = layers.forward(input);
+        ASSERT_LT((res[0] - x[0]).norm(), 1e-12);
+
+        vector<MatrixD> gradient = {MatrixD::Random(x[0].rows(), x[0].cols())};
+        vector<MatrixD> g = gradient;
+        for (size_t i = reference.size(); i > 0; --i) {
+            g = reference[i - 1]->backward(g, 0.1);
+        }
+        vector<MatrixD> top = layers.backward(gradient, 0.1);
+        ASSERT_EQ(top.size(), g.size());
+        for (size_t d = 0; d < g.size(); ++d) {
+            ASSERT_LT((top[d] - g[d]).norm(), 1e-12);
+        }
+    }
+}
+
+TEST(TRAINING_PLAN, REUSES_BUFFERS_AND_MATCHES_LAYERS) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(6, 8));
+    layers.pushLayer(ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>(1, 8, 1));
+    layers.pushLayer(RecordingDense(8, 4));
+    layers.pushLayer(SoftmaxLayer<double>(4));
+    layers.pushLayer(DenseLayer<double>(4, 2));
+    expectTrainingMatchesLayers(layers, {MatrixD(6, 1)});
+
+    // After the first pass, activations and gradients go into the storage of the one before
+    const auto& dense = dynamic_cast<const RecordingDense&>(layers.getLayer(2));
+    const double* output = dense.output;
+    const double* input_gradient = dense.input_gradient;
+    std::ignore = layers.forward({MatrixD::Random(6, 1)});
+    std::ignore = layers.backward({MatrixD::Random(2, 1)}, 0.1);
+    ASSERT_EQ(dense.output, output);
+    ASSERT_EQ(dense.input_gradient, input_gradient);
+
+    LayerVector<double> conv;
+    conv.pushLayer(ConvolutionalLayer<double, f_tanh<double>, f_tanh_prime<double>>(2, 3, 8, 8, 3, 1, 1));
+    conv.pushLayer(MaxPoolLayer<double>(3, 8, 8, 2, 2, 0));
+    conv.pushLayer(ConvolutionalMaxPoolLayer<double, relu<double>, relu_prime<double>>(3, 2, 4, 4, 3, 1, 1, 2, 2));
+    conv.pushLayer(FlatteningLayer<double>(2, 2, 2));
+    expectTrainingMatchesLayers(conv, {MatrixD(8, 8), MatrixD(8, 8)});
+
+    // Checkpointed segments recompute into their own tensors
+    conv.setCheckpointing(2);
+    expectTrainingMatchesLayers(conv, {MatrixD(8, 8), MatrixD(8, 8)});
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
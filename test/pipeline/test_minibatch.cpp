@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+using Conv = ConvolutionalLayer<double, relu<double>, relu_prime<double>>;
+
+TEST(MINIBATCH, ACCUMULATED_UPDATE_IS_MEAN_GRADIENT) {
+    // The weight gradient of a dense layer does not depend on its weights, so
+    // one update by the mean gradient equals per-sample steps at rate / B
+    DenseLayer<double> batched(3, 2);
+    DenseLayer<double> sequential(batched);
+    batched.setGradientAccumulation(true);
+    ASSERT_TRUE(batched.isAccumulatingGradients());
+
+    vector<vector<MatrixD>> inputs, grads;
+    for (int i = 0; i < 4; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        grads.push_back({MatrixD::Random(2, 1)});
+    }
+
+    const MatrixD before = batched.getWeights();
+    for (int i = 0; i < 4; ++i) {
+        batched.forward(inputs[i]);
+        batched.backward(grads[i], 0.1);
+        sequential.forward(inputs[i]);
+        sequential.backward(grads[i], 0.1 / 4);
+    }
+    ASSERT_TRUE(batched.getWeights().isApprox(before));
+
+    batched.applyGradients(0.1, 0.25);
+    ASSERT_TRUE(batched.getWeights().isApprox(sequential.getWeights()));
+    ASSERT_TRUE(batched.getBias().isApprox(sequential.getBias()));
+    for (MatrixD* grad : batched.gradients()) {
+        ASSERT_TRUE(grad->isZero());
+    }
+}
+
+TEST(MINIBATCH, PARAMETERS_AND_GRADIENTS_MATCH) {
+    LayerVector<double> layers;
+    layers.pushLayer(Conv(1, 2, 6, 6, 3, 1, 1));
+    layers.pushLayer(Tanh(2, 6, 6));
+    layers.setGradientAccumulation(true);
+
+    const vector<MatrixD*> params = layers.parameters();
+    const vector<MatrixD*> grads = layers.gradients();
+    ASSERT_EQ(params.size(), 2u);
+    ASSERT_EQ(grads.size(), params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+        ASSERT_EQ(grads[i]->rows(), params[i]->rows());
+        ASSERT_EQ(grads[i]->cols(), params[i]->cols());
+    }
+
+    // Backward leaves the parameters alone until the gradients are applied
+    const MatrixD before = *params[0];
+    vector<MatrixD> input = {MatrixD::Random(6, 6)};
+    layers.forward(input);
+    layers.backward({MatrixD::Random(6, 6), MatrixD::Random(6, 6)}, 0.1);
+    ASSERT_TRUE(params[0]->isApprox(before));
+    ASSERT_FALSE(grads[0]->isZero());
+    layers.applyGradients(0.1);
+    ASSERT_FALSE(params[0]->isApprox(before));
+}
+
+TEST(MINIBATCH, SHUFFLED_EPOCHS_REDUCE_ERROR) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(2, 8));
+    pipeline.pushLayer(Tanh(1, 8, 1));
+    pipeline.pushLayer(DenseLayer<double>(8, 1));
+    pipeline.pushLayer(Tanh(1, 1, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 1));
+
+    SequentialModel<double> model(pipeline);
+    model.set_seed(7);
+    for (int a = 0; a < 2; ++a) {
+        for (int b = 0; b < 2; ++b) {
+            MatrixD input(2, 1);
+            input << a, b;
+            model.add_training_data({input}, {MatrixD::Constant(1, 1, a ^ b)});
+            model.add_test_data({input}, {MatrixD::Constant(1, 1, a ^ b)});
+        }
+    }
+
+    const double before = model.run_tests(0);
+    model.run_epochs(500, 0.1, 0, 2, true);
+    ASSERT_LT(model.run_tests(0), before);
+
+    ASSERT_THROW(model.run_epochs(1, 0.1, 0, 0), std::invalid_argument);
+}
+
+TEST(MINIBATCH, COLUMN_BATCH_MATCHES_PER_SAMPLE) {
+    DenseLayer<double> first(3, 5);
+    Tanh activation(1, 5, 1);
+    DenseLayer<double> second(5, 2);
+
+    Pipeline<double> pipeline;
+    pipeline.setFusion(false);
+    pipeline.pushLayer(first);
+    pipeline.pushLayer(activation);
+    pipeline.pushLayer(second);
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+
+    // Same layers accumulating one sample at a time
+    LayerVector<double> layers;
+    layers.pushLayer(first);
+    layers.pushLayer(activation);
+    layers.pushLayer(second);
+    ASSERT_TRUE(layers.trainsColumns());
+    MeanSquaredError<double> loss(1, 2, 1);
+
+    vector<vector<MatrixD>> inputs, targets;
+    for (int i = 0; i < 6; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        targets.push_back({MatrixD::Random(2, 1)});
+    }
+    const vector<size_t> batch = {4, 0, 2, 5};
+
+    const double error = pipeline.trainBatch(inputs, targets, batch, 0.1);
+
+    double expected = 0;
+    layers.setGradientAccumulation(true);
+    for (const size_t i : batch) {
+        auto x = layers.forward(inputs[i]);
+        expected += loss.forward(x, targets[i]);
+        layers.backward(loss.backward(x, targets[i]), 0.1);
+    }
+    layers.applyGradients(0.1, 0.25);
+    ASSERT_NEAR(error, expected, 1e-12);
+
+    for (auto& input : inputs) {
+        ASSERT_LT((pipeline.predictPipeline(input)[0] - layers.infer(input)[0]).norm(), 1e-12);
+    }
+
+    // Single samples still fit the layers afterwards
+    ASSERT_NO_THROW(pipeline.trainPipeline(inputs[0], targets[0], 0.1));
+    vector<MatrixD> wide = {MatrixD::Random(3, 2)};
+    ASSERT_THROW(layers.forward(wide), std::invalid_argument);
+}
+
+TEST(MINIBATCH, EMPTY_BATCH_LEAVES_PARAMETERS) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+
+    vector<vector<MatrixD>> inputs = {{MatrixD::Random(3, 1)}};
+    vector<vector<MatrixD>> targets = {{MatrixD::Random(2, 1)}};
+    const MatrixD before = pipeline.predictPipeline(inputs[0])[0];
+
+    ASSERT_EQ(pipeline.trainBatch(inputs, targets, {}, 0.1), 0);
+    const MatrixD after = pipeline.predictPipeline(inputs[0])[0];
+    ASSERT_TRUE(after.allFinite());
+    ASSERT_LT((after - before).norm(), 1e-12);
+}
+
+TEST(MINIBATCH, END_LAYER_ACCUMULATES) {
+    SampledSoftmaxLoss<double> loss(4, 20, 5, {}, 3);
+    loss.setGradientAccumulation(true);
+    const MatrixD before = loss.getWeights();
+
+    vector<MatrixD> hidden = {MatrixD::Random(4, 1)};
+    vector<MatrixD> label = {MatrixD::Constant(1, 1, 7)};
+    loss.forward(hidden, label);
+    loss.backward(hidden, label, 0.1);
+    ASSERT_TRUE(loss.getWeights().isApprox(before));
+    ASSERT_FALSE(loss.gradients()[0]->isZero());
+
+    loss.applyGradients(0.1);
+    ASSERT_FALSE(loss.getWeights().isApprox(before));
+    ASSERT_TRUE(loss.gradients()[0]->isZero());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
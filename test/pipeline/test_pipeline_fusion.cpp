@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+// Train copies of a pipeline with and without fusion and compare them
+void expectFusionMatches(Pipeline<double>& pipeline, int fused_layers,
+                         vector<MatrixD> input, vector<MatrixD> target) {
+    Pipeline<double> unfused(pipeline);
+    unfused.setFusion(false);
+    const int layers = unfused.getLayerCount();
+
+    for (int step = 0; step < 5; ++step) {
+        const double expected = unfused.trainPipeline(input, target, 0.05);
+        const double error = pipeline.trainPipeline(input, target, 0.05);
+        ASSERT_NEAR(error, expected, 1e-10);
+    }
+
+    ASSERT_EQ(unfused.getLayerCount(), layers);
+    ASSERT_EQ(pipeline.getLayerCount(), fused_layers);
+
+    auto expected = unfused.predictPipeline(input);
+    auto res = pipeline.predictPipeline(input);
+    for (size_t d = 0; d < res.size(); ++d) {
+        ASSERT_LT((res[d] - expected[d]).norm(), 1e-10);
+    }
+}
+
+TEST(FUSION, DENSE_ACTIVATION) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 5));
+    pipeline.pushLayer(ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>(1, 5, 1));
+    pipeline.pushLayer(DenseLayer<double>(5, 2));
+    pipeline.pushLayer(ActivationLayer<sigmoid<double>, sigmoid_prime<double>, double>(1, 2, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+
+    expectFusionMatches(pipeline, 2, {MatrixD::Random(3, 1)}, {MatrixD::Random(2, 1)});
+}
+
+TEST(FUSION, CONVOLUTION_ACTIVATION_MAX_POOL) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, identity<double>, identity_prime<double>>(2, 3, 8, 8, 3, 1, 1));
+    pipeline.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(3, 8, 8));
+    pipeline.pushLayer(MaxPoolLayer<double>(3, 8, 8, 2, 2, 0));
+    pipeline.pushLayer(FlatteningLayer<double>(3, 4, 4));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 48));
+
+    expectFusionMatches(pipeline, 2,
+        {MatrixD::Random(8, 8), MatrixD::Random(8, 8)}, {MatrixD::Random(1, 48)});
+}
+
+TEST(FUSION, SOFTMAX_CROSS_ENTROPY_OFF_BY_DEFAULT) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 3));
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+
+    vector<MatrixD> target = {MatrixD::Zero(3, 1)};
+    target[0](1, 0) = 1;
+
+    // Training is unchanged, the softmax stays a layer
+    expectFusionMatches(pipeline, 2, {MatrixD::Random(4, 1)}, target);
+}
+
+TEST(FUSION, SOFTMAX_CROSS_ENTROPY) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(4, 3));
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+    pipeline.setSoftmaxCrossEntropyFusion(true);
+
+    vector<MatrixD> input = {MatrixD::Random(4, 1)};
+    vector<MatrixD> target = {MatrixD::Zero(3, 1)};
+    target[0](1, 0) = 1;
+
+    Pipeline<double> unfused(pipeline);
+    unfused.setFusion(false);
+
+    // Same loss and probabilities before any training step
+    auto expected = unfused.testPipeline(input, target);
+    auto res = pipeline.testPipeline(input, target);
+    ASSERT_EQ(pipeline.getLayerCount(), 1);
+    ASSERT_NEAR(res.first, expected.first, 1e-12);
+    ASSERT_LT((res.second[0] - expected.second[0]).norm(), 1e-12);
+
+    // Training reduces the loss
+    for (int step = 0; step < 50; ++step) {
+        pipeline.trainPipeline(input, target, 0.1);
+    }
+    auto trained = pipeline.predictPipeline(input);
+    ASSERT_NEAR(trained[0].sum(), 1, 1e-12);
+    ASSERT_GT(trained[0](1, 0), expected.second[0](1, 0));
+}
+
+TEST(FUSION, SOFTMAX_CROSS_ENTROPY_GRADIENT) {
+    const DenseLayer<double> dense(4, 3);
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(dense);
+    pipeline.pushLayer(SoftmaxLayer<double>(3));
+    pipeline.pushEndLayer(CrossEntropyLoss<double>(3));
+    pipeline.setSoftmaxCrossEntropyFusion(true);
+
+    vector<MatrixD> input = {MatrixD::Random(4, 1)};
+    vector<MatrixD> target = {MatrixD::Zero(3, 1)};
+    target[0](2, 0) = 1;
+
+    // Fused, the gradient w.r.t. the logits is s - t, not the softmax Jacobian times s - t
+    const MatrixD logits = dense.getWeights() * input[0] + dense.getBias();
+    MatrixD s = (logits.array() - logits.maxCoeff()).exp();
+    s /= s.sum();
+    const MatrixD gradient = s - target[0];
+
+    const double learning_rate = 0.1;
+    pipeline.trainPipeline(input, target, learning_rate);
+
+    // Dense layer updated by that gradient, then softmax
+    const MatrixD weights = dense.getWeights() - learning_rate * gradient * input[0].transpose();
+    const MatrixD bias = dense.getBias() - learning_rate * gradient;
+    const MatrixD updated = weights * input[0] + bias;
+    MatrixD expected = (updated.array() - updated.maxCoeff()).exp();
+    expected /= expected.sum();
+
+    auto res = pipeline.predictPipeline(input);
+    ASSERT_LT((res[0] - expected).norm(), 1e-12);
+}
+
+TEST(FUSION, LAYERS_PUSHED_AFTER_FUSION) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(2, 2));
+    pipeline.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(1, 2, 1));
+
+    vector<MatrixD> input = {MatrixD::Random(2, 1)};
+    std::ignore = pipeline.predictPipeline(input);
+    ASSERT_EQ(pipeline.getLayerCount(), 1);
+
+    pipeline.pushLayer(DenseLayer<double>(2, 3));
+    pipeline.pushLayer(ActivationLayer<relu<double>, relu_prime<double>, double>(1, 3, 1));
+    auto res = pipeline.predictPipeline(input);
+    ASSERT_EQ(pipeline.getLayerCount(), 2);
+    ASSERT_EQ(res[0].rows(), 3);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
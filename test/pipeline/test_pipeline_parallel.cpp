@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+// Deep narrow pipeline, fusion off so the layers split into several stages
+Pipeline<double> makePipeline() {
+    Pipeline<double> pipeline;
+    pipeline.setFusion(false);
+    pipeline.pushLayer(DenseLayer<double>(4, 6));
+    for (int i = 0; i < 3; ++i) {
+        pipeline.pushLayer(Tanh(1, 6, 1));
+        pipeline.pushLayer(DenseLayer<double>(6, 6));
+    }
+    pipeline.pushLayer(Tanh(1, 6, 1));
+    pipeline.pushLayer(DenseLayer<double>(6, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+    return pipeline;
+}
+
+// Samples of a smooth target function
+void makeSamples(int count, vector<vector<MatrixD>>& inputs, vector<vector<MatrixD>>& targets) {
+    for (int i = 0; i < count; ++i) {
+        MatrixD x = MatrixD::Random(4, 1);
+        MatrixD y(2, 1);
+        y << 0.5 * std::sin(x.sum()), 0.5 * x(0, 0) * x(1, 0);
+        inputs.push_back({x});
+        targets.push_back({y});
+    }
+}
+
+TEST(PIPELINE_PARALLEL, STAGES) {
+    LayerVector<double> layers;
+    for (int i = 0; i < 5; ++i) {
+        layers.pushLayer(DenseLayer<double>(3, 3));
+    }
+
+    PipelineParallel<double> executor(layers, nullptr, 2);
+    ASSERT_EQ(executor.getStageCount(), 2);
+    ASSERT_EQ(executor.getStageRange(0), std::make_pair(0, 2));
+    ASSERT_EQ(executor.getStageRange(1), std::make_pair(2, 5));
+    ASSERT_EQ(executor.getMaxInFlight(), 4);
+
+    // Never more stages than layers
+    PipelineParallel<double> wide(layers, nullptr, 8, 3);
+    ASSERT_EQ(wide.getStageCount(), 5);
+    ASSERT_EQ(wide.getMaxInFlight(), 3);
+}
+
+TEST(PIPELINE_PARALLEL, PREDICT_MATCHES_FORWARD) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(3, 5));
+    layers.pushLayer(Tanh(1, 5, 1));
+    layers.pushLayer(DenseLayer<double>(5, 2));
+
+    vector<vector<MatrixD>> inputs;
+    for (int i = 0; i < 20; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+    }
+
+    PipelineParallel<double> executor(layers, nullptr, 3);
+    auto res = executor.predict(inputs);
+    ASSERT_EQ(res.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ASSERT_LT((res[i][0] - layers.forward(inputs[i])[0]).norm(), 1e-12);
+    }
+}
+
+TEST(PIPELINE_PARALLEL, PREDICT_KEEPS_TRAINING_MODE) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(3, 5));
+    layers.pushLayer(Tanh(1, 5, 1));
+    layers.getLayer(1).setTraining(false);
+
+    vector<vector<MatrixD>> inputs = {{MatrixD::Random(3, 1)}, {MatrixD::Random(3, 1)}};
+    PipelineParallel<double> executor(layers, nullptr, 2);
+    std::ignore = executor.predict(inputs);
+
+    // Each layer is back in the mode it had before
+    ASSERT_TRUE(layers.getLayer(0).isTraining());
+    ASSERT_FALSE(layers.getLayer(1).isTraining());
+}
+
+TEST(PIPELINE_PARALLEL, ONE_IN_FLIGHT_MATCHES_SEQUENTIAL) {
+    Pipeline<double> pipeline = makePipeline();
+    Pipeline<double> sequential(pipeline);
+
+    vector<vector<MatrixD>> inputs, targets;
+    makeSamples(30, inputs, targets);
+
+    const double error = pipeline.trainPipelineParallel(inputs, targets, 0.05, 4, 1);
+    double expected = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        expected += sequential.trainPipeline(inputs[i], targets[i], 0.05);
+    }
+    ASSERT_NEAR(error, expected, 1e-10);
+    ASSERT_LT((pipeline.predictPipeline(inputs[0])[0] - sequential.predictPipeline(inputs[0])[0]).norm(), 1e-10);
+}
+
+TEST(PIPELINE_PARALLEL, TRAINS_WITH_MANY_IN_FLIGHT) {
+    Pipeline<double> pipeline = makePipeline();
+
+    vector<vector<MatrixD>> inputs, targets;
+    makeSamples(100, inputs, targets);
+
+    const double first = pipeline.trainPipelineParallel(inputs, targets, 0.02, 4);
+    double last = first;
+    for (int epoch = 0; epoch < 30; ++epoch) {
+        last = pipeline.trainPipelineParallel(inputs, targets, 0.02, 4);
+    }
+    ASSERT_LT(last, first);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
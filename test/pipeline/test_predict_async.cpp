@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <HaDo/pipeline/DynamicBatcher.hpp>
+#include <atomic>
+#include <coroutine>
+#include <thread>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+// Fire and forget coroutine, as started by an event loop
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Wait for a count set from another thread
+void waitFor(const std::atomic<int>& count, const int expected) {
+    while (count < expected) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+Pipeline<double> makePipeline() {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 6));
+    pipeline.pushLayer(ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>(1, 6, 1));
+    pipeline.pushLayer(DenseLayer<double>(6, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+    return pipeline;
+}
+
+Detached predictInto(DynamicBatcher<double>& batcher, vector<MatrixD> input, MatrixD& result,
+                     std::atomic<int>& done, std::thread::id& resumed_on) {
+    result = (co_await batcher.predictAsync(std::move(input)))[0];
+    resumed_on = std::this_thread::get_id();
+    done++;
+}
+
+Detached predictOrCancel(DynamicBatcher<double>& batcher, vector<MatrixD> input, std::stop_token stop,
+                         std::atomic<int>& cancelled, std::atomic<int>& done) {
+    try {
+        co_await batcher.predictAsync(std::move(input), stop);
+    } catch (const std::runtime_error&) {
+        cancelled++;
+    }
+    done++;
+}
+
+TEST(PREDICT_ASYNC, RESUMES_WITH_BATCHED_RESULTS) {
+    Pipeline<double> pipeline = makePipeline();
+    DynamicBatcher<double> batcher(std::make_shared<const InferencePlan<double>>(pipeline.freeze()),
+                                   8, std::chrono::milliseconds(20));
+
+    // All coroutines suspend on the calling thread without blocking it
+    const int count = 8;
+    vector<vector<MatrixD>> inputs;
+    vector<MatrixD> results(count);
+    vector<std::thread::id> resumed_on(count);
+    std::atomic<int> done{0};
+    for (int i = 0; i < count; ++i) {
+        inputs.push_back({MatrixD::Random(3, 1)});
+        predictInto(batcher, inputs[i], results[i], done, resumed_on[i]);
+    }
+    waitFor(done, count);
+
+    for (int i = 0; i < count; ++i) {
+        ASSERT_LT((results[i] - pipeline.predictPipeline(inputs[i])[0]).norm(), 1e-12);
+        ASSERT_NE(resumed_on[i], std::this_thread::get_id());
+    }
+    ASSERT_EQ(batcher.getBatchCount(), 1u);
+}
+
+TEST(PREDICT_ASYNC, CANCELLED_BEFORE_BATCH) {
+    Pipeline<double> pipeline = makePipeline();
+    DynamicBatcher<double> batcher(std::make_shared<const InferencePlan<double>>(pipeline.freeze()),
+                                   8, std::chrono::milliseconds(50));
+
+    std::stop_source source;
+    std::atomic<int> cancelled{0}, done{0};
+    predictOrCancel(batcher, {MatrixD::Random(3, 1)}, source.get_token(), cancelled, done);
+    predictOrCancel(batcher, {MatrixD::Random(3, 1)}, {}, cancelled, done);
+    source.request_stop();
+    waitFor(done, 2);
+
+    ASSERT_EQ(cancelled, 1);
+    ASSERT_EQ(batcher.getRequestCount(), 1u);
+
+    // The blocking call takes a stop token too
+    ASSERT_THROW(batcher.predict({MatrixD::Random(3, 1)}, source.get_token()), std::runtime_error);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+#include <thread>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+Pipeline<double> makePipeline() {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, relu<double>, relu_prime<double>>(1, 2, 6, 6, 3, 1, 1));
+    pipeline.pushLayer(FlatteningLayer<double>(2, 6, 6));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 72));
+    return pipeline;
+}
+
+TEST(PREDICTOR, BATCH_MATCHES_PIPELINE) {
+    Pipeline<double> pipeline = makePipeline();
+    Predictor<double> predictor(pipeline, 4);
+    ASSERT_EQ(predictor.getThreadCount(), 4);
+
+    vector<vector<MatrixD>> inputs;
+    for (int i = 0; i < 25; ++i) {
+        inputs.push_back({MatrixD::Random(6, 6)});
+    }
+
+    auto res = predictor.predictBatch(inputs);
+    ASSERT_EQ(res.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ASSERT_LT((res[i][0] - pipeline.predictPipeline(inputs[i])[0]).norm(), 1e-12);
+    }
+}
+
+TEST(PREDICTOR, CONCURRENT_PREDICT_SHARES_PLAN) {
+    Pipeline<double> pipeline = makePipeline();
+    auto plan = std::make_shared<const InferencePlan<double>>(pipeline.freeze());
+    Predictor<double> predictor(plan, 2);
+    ASSERT_EQ(predictor.getPlan().get(), plan.get());
+
+    vector<MatrixD> input = {MatrixD::Random(6, 6)};
+    const MatrixD expected = pipeline.predictPipeline(input)[0];
+
+    vector<int> mismatches(4, 0);
+    vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]{
+            for (int i = 0; i < 50; ++i) {
+                if ((predictor.predict(input)[0] - expected).norm() > 1e-12) {
+                    mismatches[t]++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int count : mismatches) {
+        ASSERT_EQ(count, 0);
+    }
+
+    vector<MatrixD> wrong = {MatrixD::Random(5, 5)};
+    ASSERT_THROW(predictor.predict(wrong), std::invalid_argument);
+    ASSERT_THROW(predictor.predictBatch({input, wrong}), std::invalid_argument);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
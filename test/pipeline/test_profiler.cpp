@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <sstream>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+using Tanh = ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>;
+
+TEST(PROFILER, OFF_BY_DEFAULT) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(3, 4));
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    layers.forward(input);
+    ASSERT_FALSE(layers.getProfiler().isEnabled());
+    ASSERT_TRUE(layers.getProfiler().getLayers().empty());
+}
+
+TEST(PROFILER, COUNTS_CALLS_AND_BYTES) {
+    LayerVector<double> layers;
+    layers.pushLayer(DenseLayer<double>(3, 4));
+    layers.pushLayer(Tanh(1, 4, 1));
+    layers.pushLayer(DenseLayer<double>(4, 2));
+    layers.setProfiling(true);
+
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    for (int i = 0; i < 5; ++i) {
+        layers.forward(input);
+        layers.backward({MatrixD::Random(2, 1)}, 0.01);
+    }
+
+    const auto& profile = layers.getProfiler().getLayers();
+    ASSERT_EQ(profile.size(), 3u);
+    ASSERT_EQ(profile[0].name, "DenseLayer");
+    ASSERT_EQ(profile[1].name, "ActivationLayer");
+    for (const LayerProfile& layer : profile) {
+        ASSERT_EQ(layer.calls[Profiler::FORWARD], 5u);
+        ASSERT_EQ(layer.calls[Profiler::BACKWARD], 5u);
+        ASSERT_GE(layer.seconds[Profiler::FORWARD], 0);
+    }
+    ASSERT_EQ(profile[0].bytes[Profiler::FORWARD], 5 * 4 * sizeof(double));
+    ASSERT_EQ(profile[0].bytes[Profiler::BACKWARD], 5 * 3 * sizeof(double));
+
+    // Recomputed segments count as forward calls
+    layers.getProfiler().reset();
+    layers.setCheckpointing(1);
+    layers.forward(input);
+    layers.backward({MatrixD::Random(2, 1)}, 0.01);
+    ASSERT_EQ(layers.getProfiler().getLayers()[0].calls[Profiler::FORWARD], 2u);
+    ASSERT_EQ(layers.getProfiler().getLayers()[2].calls[Profiler::FORWARD], 1u);
+
+    layers.setProfiling(false);
+    layers.forward(input);
+    ASSERT_EQ(layers.getProfiler().getLayers()[2].calls[Profiler::FORWARD], 1u);
+}
+
+TEST(PROFILER, MODEL_SUMMARY) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(2, 3));
+    pipeline.pushLayer(Tanh(1, 3, 1));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 3, 1));
+
+    SequentialModel<double> model(pipeline);
+    model.add_training_data({MatrixD::Random(2, 1)}, {MatrixD::Random(3, 1)});
+    model.set_profiling(true);
+    model.run_epochs(3, 0.1, 0);
+
+    // Fused into one layer before profiling starts
+    const auto& profile = model.pipeline->getProfiler().getLayers();
+    ASSERT_EQ(profile.size(), 1u);
+    ASSERT_EQ(profile[0].name, "DenseActivationLayer");
+    ASSERT_EQ(profile[0].calls[Profiler::BACKWARD], 3u);
+
+    std::ostringstream summary;
+    model.print_profile(summary);
+    ASSERT_NE(summary.str().find("DenseActivationLayer"), std::string::npos);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
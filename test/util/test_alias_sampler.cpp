@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include <HaDo/util/AliasSampler.hpp>
+
+using namespace hado;
+
+TEST(CONSTRUCTOR, Invalid_Weights) {
+    EXPECT_ANY_THROW({
+        AliasSampler<double> x({});
+    });
+
+    EXPECT_ANY_THROW({
+        AliasSampler<double> x({1, -1});
+    });
+
+    EXPECT_ANY_THROW({
+        AliasSampler<double> x({0, 0});
+    });
+}
+
+TEST(SAMPLING, MATCHES_DISTRIBUTION) {
+    const vector<double> weights = {5, 0, 1, 3, 1};
+    AliasSampler<double> sampler(weights);
+    std::mt19937 rng(7);
+
+    const int n = 200000;
+    vector<int> counts(weights.size(), 0);
+    for (int i = 0; i < n; ++i) {
+        counts[sampler(rng)]++;
+    }
+
+    ASSERT_EQ(counts[1], 0);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        ASSERT_DOUBLE_EQ(sampler.probability(i), weights[i] / 10);
+        EXPECT_NEAR(static_cast<double>(counts[i]) / n, weights[i] / 10, 0.005);
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
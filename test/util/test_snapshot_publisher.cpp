@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <HaDo/DeepNeuralNetwork>
+#include <HaDo/util/SnapshotPublisher.hpp>
+#include <atomic>
+#include <thread>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+// Snapshot counting its live instances, with an invariant readers can check
+struct Counted {
+    static std::atomic<int> alive;
+    int a;
+    int b;
+    explicit Counted(const int a) : a(a), b(2 * a) { alive++; }
+    ~Counted() { alive--; }
+};
+std::atomic<int> Counted::alive{0};
+
+TEST(SNAPSHOT_PUBLISHER, PUBLISH_AND_ACQUIRE) {
+    SnapshotPublisher<Counted> publisher;
+    SnapshotPublisher<Counted>::Reader reader(publisher);
+    ASSERT_EQ(publisher.getVersion(), 0u);
+    ASSERT_FALSE(reader.acquire());
+
+    ASSERT_EQ(publisher.publish(std::make_unique<const Counted>(1)), 1u);
+    {
+        auto guard = reader.acquire();
+        ASSERT_TRUE(guard);
+        ASSERT_EQ(guard->a, 1);
+        ASSERT_EQ(guard.getVersion(), 1u);
+    }
+
+    ASSERT_EQ(publisher.publish(std::make_unique<const Counted>(2)), 2u);
+    ASSERT_EQ(publisher.getVersion(), 2u);
+    ASSERT_EQ((*reader.acquire()).a, 2);
+}
+
+TEST(SNAPSHOT_PUBLISHER, HELD_SNAPSHOT_OUTLIVES_PUBLISH) {
+    {
+        SnapshotPublisher<Counted> publisher;
+        SnapshotPublisher<Counted>::Reader reader(publisher);
+        publisher.publish(std::make_unique<const Counted>(1));
+
+        {
+            auto guard = reader.acquire();
+            publisher.publish(std::make_unique<const Counted>(2));
+            publisher.publish(std::make_unique<const Counted>(3));
+
+            // Snapshot 2 was never held, snapshot 1 still is
+            ASSERT_EQ(publisher.getRetiredCount(), 1u);
+            ASSERT_EQ(Counted::alive, 2);
+            ASSERT_EQ(guard->a, 1);
+        }
+
+        publisher.reclaim();
+        ASSERT_EQ(publisher.getRetiredCount(), 0u);
+        ASSERT_EQ(Counted::alive, 1);
+    }
+    ASSERT_EQ(Counted::alive, 0);
+}
+
+TEST(SNAPSHOT_PUBLISHER, READER_SLOTS) {
+    SnapshotPublisher<Counted> publisher(2);
+    SnapshotPublisher<Counted>::Reader first(publisher);
+    {
+        SnapshotPublisher<Counted>::Reader second(publisher);
+        ASSERT_THROW(SnapshotPublisher<Counted>::Reader third(publisher), std::runtime_error);
+    }
+    // Slot of a destroyed reader is free again
+    SnapshotPublisher<Counted>::Reader again(publisher);
+}
+
+TEST(SNAPSHOT_PUBLISHER, ONE_GUARD_PER_READER) {
+    SnapshotPublisher<Counted> publisher;
+    SnapshotPublisher<Counted>::Reader reader(publisher);
+    {
+        auto empty = reader.acquire();
+        ASSERT_THROW(std::ignore = reader.acquire(), std::logic_error);
+    }
+    publisher.publish(std::make_unique<Counted>(1));
+    {
+        auto guard = reader.acquire();
+        auto moved = std::move(guard);
+        ASSERT_THROW(std::ignore = reader.acquire(), std::logic_error);
+    }
+    // Free again once the guard is gone
+    ASSERT_EQ(reader.acquire().getVersion(), 1u);
+}
+
+TEST(SNAPSHOT_PUBLISHER, CONCURRENT_READERS) {
+    {
+        SnapshotPublisher<Counted> publisher;
+        publisher.publish(std::make_unique<const Counted>(0));
+
+        std::atomic<bool> done{false};
+        vector<int> errors(4, 0);
+        vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&, t]{
+                SnapshotPublisher<Counted>::Reader reader(publisher);
+                uint64_t last = 0;
+                while (!done) {
+                    auto guard = reader.acquire();
+                    if (guard->b != 2 * guard->a || guard.getVersion() < last
+                        || guard.getVersion() != static_cast<uint64_t>(guard->a) + 1) {
+                        errors[t]++;
+                    }
+                    last = guard.getVersion();
+                }
+            });
+        }
+
+        for (int i = 1; i <= 2000; ++i) {
+            publisher.publish(std::make_unique<const Counted>(i));
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        for (int count : errors) {
+            ASSERT_EQ(count, 0);
+        }
+
+        publisher.reclaim();
+        ASSERT_EQ(publisher.getRetiredCount(), 0u);
+        ASSERT_EQ(Counted::alive, 1);
+    }
+    ASSERT_EQ(Counted::alive, 0);
+}
+
+TEST(SNAPSHOT_PUBLISHER, TRAIN_WHILE_SERVE) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(DenseLayer<double>(3, 4));
+    pipeline.pushLayer(ActivationLayer<f_tanh<double>, f_tanh_prime<double>, double>(1, 4, 1));
+    pipeline.pushLayer(DenseLayer<double>(4, 2));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 2, 1));
+
+    SnapshotPublisher<InferencePlan<double>> publisher;
+    ASSERT_EQ(pipeline.publish(publisher), 1u);
+
+    vector<MatrixD> input = {MatrixD::Random(3, 1)};
+    vector<MatrixD> target = {MatrixD::Random(2, 1)};
+    SnapshotPublisher<InferencePlan<double>>::Reader reader(publisher);
+    const MatrixD before = reader.acquire()->predict(input)[0];
+
+    pipeline.trainPipeline(input, target, 0.1);
+    ASSERT_EQ(pipeline.publish(publisher), 2u);
+
+    auto guard = reader.acquire();
+    ASSERT_EQ(guard.getVersion(), 2u);
+    const MatrixD after = guard->predict(input)[0];
+    ASSERT_GT((after - before).norm(), 0);
+    ASSERT_LT((after - pipeline.predictPipeline(input)[0]).norm(), 1e-12);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <HaDo/ConvolutionalNeuralNetwork>
+#include <HaDo/util/TraceWriter.hpp>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <thread>
+
+using namespace hado;
+using MatrixD = Matrix<double, Dynamic, Dynamic>;
+
+// Names of the complete events of a trace
+std::multiset<std::string> spanNames(const json& trace) {
+    std::multiset<std::string> names;
+    for (const json& event : trace["traceEvents"]) {
+        if (event["ph"] == "X") {
+            names.insert(event["name"].get<std::string>());
+        }
+    }
+    return names;
+}
+
+TEST(TRACE_WRITER, OFF_UNTIL_STARTED) {
+    TraceWriter& writer = TraceWriter::global();
+    writer.stop();
+    const size_t before = writer.getEventCount();
+    {
+        HADO_TRACE_SPAN("ignored", "test");
+    }
+    ASSERT_EQ(writer.getEventCount(), before);
+}
+
+TEST(TRACE_WRITER, SPANS_PER_THREAD) {
+    TraceWriter& writer = TraceWriter::global();
+    writer.start();
+    {
+        HADO_TRACE_SPAN("outer", "test");
+        std::thread other([]{ HADO_TRACE_SPAN("worker " + std::to_string(1), "test"); });
+        other.join();
+    }
+    writer.stop();
+
+    json trace = writer.toJson();
+    ASSERT_EQ(trace["traceEvents"].size(), 4u);
+
+    std::set<int> threads;
+    for (const json& event : trace["traceEvents"]) {
+        if (event["ph"] == "X") {
+            threads.insert(event["tid"].get<int>());
+            ASSERT_GE(event["dur"].get<double>(), 0);
+        }
+    }
+    ASSERT_EQ(threads.size(), 2u);
+    ASSERT_EQ(spanNames(trace).count("worker 1"), 1u);
+}
+
+TEST(TRACE_WRITER, MERGES_THREAD_BUFFERS) {
+    TraceWriter& writer = TraceWriter::global();
+    writer.start();
+    vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([]{
+            for (int i = 0; i < 100; ++i) {
+                HADO_TRACE_SPAN("span", "test");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    writer.stop();
+    ASSERT_EQ(writer.getEventCount(), 800u);
+
+    // A new start drops the events of all threads, exited ones included
+    writer.start();
+    writer.stop();
+    ASSERT_EQ(writer.getEventCount(), 0u);
+}
+
+TEST(TRACE_WRITER, TRAINING_AND_INFERENCE) {
+    Pipeline<double> pipeline;
+    pipeline.pushLayer(ConvolutionalLayer<double, relu<double>, relu_prime<double>>(1, 2, 6, 6, 3, 1, 1));
+    pipeline.pushLayer(FlatteningLayer<double>(2, 6, 6));
+    pipeline.pushEndLayer(MeanSquaredError<double>(1, 1, 72));
+    vector<MatrixD> input = {MatrixD::Random(6, 6)};
+    vector<MatrixD> target = {MatrixD::Random(1, 72)};
+    InferencePlan<double> plan = pipeline.freeze();
+
+    TraceWriter& writer = TraceWriter::global();
+    writer.start();
+    pipeline.trainPipeline(input, target, 0.01);
+    plan.predict(input);
+    writer.stop();
+
+    auto names = spanNames(writer.toJson());
+    ASSERT_EQ(names.count("train step"), 1u);
+    ASSERT_EQ(names.count("loss"), 1u);
+    ASSERT_EQ(names.count("ConvolutionalLayer forward"), 1u);
+    ASSERT_EQ(names.count("FlatteningLayer backward"), 1u);
+    ASSERT_EQ(names.count("ConvolutionalLayer"), 1u);
+
+    const std::string path = "hado_trace_test.json";
+    writer.write(path);
+    std::ifstream file(path);
+    json loaded;
+    file >> loaded;
+    ASSERT_EQ(loaded["traceEvents"].size(), writer.toJson()["traceEvents"].size());
+    std::remove(path.c_str());
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}